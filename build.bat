@@ -14,6 +14,7 @@ call "shell.bat"
 :: /Od         - Disables optimizations to improve debugging and speed up compilation.
 :: /O2         - Enables full optimization for speed, favoring performance over size.
 :: /c          - Compiles source files without linking, producing object files (.obj).
+:: /arch:AVX2 - Allows AVX2 and FMA instructions and defines __AVX2__, which enables 8-wide paths of the software renderer.
 
 set B_UNICODE_FLAGS=/DUNICODE /D_UNICODE
 
@@ -21,7 +22,7 @@ set B_DEBUG_DEPENDANT_ARGS=/Zi /Od /D_DEBUG /MDd
 if /i "%1"=="release" set B_DEBUG_DEPENDANT_ARGS=/O2 /DNDEBUG /MD
 if /i "%1"=="profile" set B_DEBUG_DEPENDANT_ARGS=/O2 /DNDEBUG /MD /DENABLE_DETAILED_PERF_LOG
 
-set B_COMMON_FLAGS=/std:c++20 /EHsc %B_DEBUG_DEPENDANT_ARGS%
+set B_COMMON_FLAGS=/std:c++20 /EHsc /arch:AVX2 %B_DEBUG_DEPENDANT_ARGS%
 set B_COMMON_INCLUDES=/I"..\src\renderer" /I"..\src\common" /I"..\extern\imgui" /I"..\extern\imgui\backends"
 
 set B_TESTS_INCLUDES=/I"%VCInstallDir%Auxiliary\VS\UnitTest\include"
@@ -36,7 +37,8 @@ echo ------------------------------------------------
 echo Copy assets...
 echo ------------------------------------------------
 
-call robocopy "assets" "build\assets" /MIR
+:: derived data written next to the assets is kept
+call robocopy "assets" "build\assets" /MIR /XF *.mips *.cache
 call :FailIfError 8
 
 pushd build
@@ -67,6 +69,14 @@ echo ------------------------------------------------
 cl /I"..\src\application" %B_COMMON_INCLUDES% /D_CONSOLE %B_UNICODE_FLAGS% %B_COMMON_FLAGS% ../src/application/application.cpp /link renderer.lib
 call :FailIfError 1
 
+echo ------------------------------------------------
+echo Building benchmarks...
+echo ------------------------------------------------
+
+:: not run here, the timings only mean something in release builds
+cl /I"..\src\benchmarks" %B_COMMON_INCLUDES% /D_CONSOLE %B_COMMON_FLAGS% ../src/benchmarks/benchmarks.cpp /link renderer.lib
+call :FailIfError 1
+
 echo ------------------------------------------------
 echo Building tests...
 echo ------------------------------------------------
@@ -7,6 +7,7 @@
 #include <renderer/color.h>
 #include <renderer/scene.h>
 #include <renderer/texture.h>
+#include <renderer/texturecache.h>
 
 #include <utils.h>
 
@@ -92,7 +93,8 @@ struct WindowContext
         , hardwareRenderer(assetsDir, device)
         , imguiRenderer(device, WindowWidth, WindowHeight, hWnd)
     {
-        NOT_FAILED(Renderer::Load(assetsDir + "cars\\scene.sce", scene), false);
+        Renderer::TextureCache::GetInstance().SetDerivedDataCache(true);
+        NOT_FAILED(Renderer::Load(assetsDir + "cars\\scene.sce", scene, Renderer::NoWelding, true), false);
         renderer = &hardwareRenderer;
     }
 
@@ -136,6 +138,7 @@ LRESULT CALLBACK MainWindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPar
 
             std::stringstream ss;
             Utils::FrameCounter::GetInstance().GetPerformanceString(ss);
+            Utils::MemoryCounter::GetInstance().GetMemoryString(ss);
 
             windowContext->imguiRenderer.Render(result, [&result, &ss](ImTextureID id) {
                 if (ImGui::BeginMainMenuBar())
@@ -205,6 +208,121 @@ LRESULT CALLBACK MainWindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPar
                     windowContext->scene.debugContext.DisplayedGBufferTextureIndex = 2;
                 }
 
+                ImGui::Separator();
+                ImGui::Text("Software shading math: ");
+
+                if (ImGui::SmallButton("Exact"))
+                {
+                    windowContext->softwareRenderer.SetMathAccuracy(Renderer::MathAccuracy::Exact);
+                }
+
+                if (ImGui::SmallButton("Fast"))
+                {
+                    windowContext->softwareRenderer.SetMathAccuracy(Renderer::MathAccuracy::Fast);
+                }
+
+                if (ImGui::SmallButton("Fastest"))
+                {
+                    windowContext->softwareRenderer.SetMathAccuracy(Renderer::MathAccuracy::Fastest);
+                }
+
+                ImGui::Text("Software texture filter: ");
+
+                if (ImGui::SmallButton("Nearest"))
+                {
+                    windowContext->softwareRenderer.SetTextureFilter(Renderer::TextureFilter::Nearest);
+                }
+
+                if (ImGui::SmallButton("Bilinear"))
+                {
+                    windowContext->softwareRenderer.SetTextureFilter(Renderer::TextureFilter::Bilinear);
+                }
+
+                if (ImGui::SmallButton("Trilinear"))
+                {
+                    windowContext->softwareRenderer.SetTextureFilter(Renderer::TextureFilter::Trilinear);
+                }
+
+                ImGui::Text("Software texture layout: ");
+
+                if (ImGui::SmallButton("Linear"))
+                {
+                    windowContext->softwareRenderer.SetTextureLayout(Renderer::TextureLayout::Linear);
+                }
+
+                if (ImGui::SmallButton("Tiled"))
+                {
+                    windowContext->softwareRenderer.SetTextureLayout(Renderer::TextureLayout::Tiled);
+                }
+
+                ImGui::Text("Software texture format: ");
+
+                if (ImGui::SmallButton("RGBA8"))
+                {
+                    windowContext->softwareRenderer.SetTextureFormat(Renderer::TextureFormat::RGBA8);
+                }
+
+                if (ImGui::SmallButton("RGBA16F"))
+                {
+                    windowContext->softwareRenderer.SetTextureFormat(Renderer::TextureFormat::RGBA16F);
+                }
+
+                if (ImGui::SmallButton("RGBA32F"))
+                {
+                    windowContext->softwareRenderer.SetTextureFormat(Renderer::TextureFormat::RGBA32F);
+                }
+
+                if (ImGui::SmallButton("BC1"))
+                {
+                    windowContext->softwareRenderer.SetTextureFormat(Renderer::TextureFormat::BC1);
+                }
+
+                if (ImGui::SmallButton("BC3"))
+                {
+                    windowContext->softwareRenderer.SetTextureFormat(Renderer::TextureFormat::BC3);
+                }
+
+                ImGui::Text("Software texture atlas: ");
+
+                if (ImGui::SmallButton("Separate textures"))
+                {
+                    windowContext->softwareRenderer.SetTextureAtlasSize(0);
+                }
+
+                if (ImGui::SmallButton("2048 atlases"))
+                {
+                    windowContext->softwareRenderer.SetTextureAtlasSize(2048);
+                }
+
+                ImGui::Text("Software texture residency: ");
+
+                if (ImGui::SmallButton("Whole textures"))
+                {
+                    windowContext->softwareRenderer.SetVirtualTexturing(false);
+                }
+
+                if (ImGui::SmallButton("Virtual pages"))
+                {
+                    windowContext->softwareRenderer.SetVirtualTexturing(true);
+                }
+
+                ImGui::Text("Software shadows: ");
+
+                if (ImGui::SmallButton("Off"))
+                {
+                    windowContext->softwareRenderer.SetShadowMapResolution(0);
+                }
+
+                if (ImGui::SmallButton("1024"))
+                {
+                    windowContext->softwareRenderer.SetShadowMapResolution(1024);
+                }
+
+                if (ImGui::SmallButton("2048"))
+                {
+                    windowContext->softwareRenderer.SetShadowMapResolution(2048);
+                }
+
                 if (ImGui::IsKeyPressed(ImGuiKey::ImGuiKey_R))
                 {
                     windowContext->renderer = windowContext->renderer == &windowContext->hardwareRenderer ? 
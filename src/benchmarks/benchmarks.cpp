@@ -0,0 +1 @@
+#include <main.cpp>
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include <renderer/pixels.h>
+#include <renderer/texture.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // Best of a few runs, the first one also brings the data into the caches.
+    template<typename F>
+    double MeasureMs(F&& func)
+    {
+        constexpr size_t Runs = 5;
+        double best = std::numeric_limits<double>::max();
+        for (size_t run = 0; run < Runs; run++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            func();
+            best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+        return best;
+    }
+
+    void ConversionBenchmark()
+    {
+        std::vector<Renderer::Vec> colors(3840 * 2160, Renderer::Vec{ 0.25f, 0.5f, 0.75f, 1.0f });
+        Renderer::Texture texture(3840, 2160);
+        Renderer::Texture flipped(3840, 2160);
+
+        double scalarMs = MeasureMs([&]() {
+            for (size_t i = 0; i < colors.size(); i++)
+            {
+                texture.SetColor(i, Renderer::Color(colors[i]));
+            }
+        });
+        double packMs = MeasureMs([&]() { Renderer::ConvertFloatToRGBA8(colors.data(), texture.GetBuffer(), colors.size()); });
+        double swizzleMs = MeasureMs([&]() { Renderer::ConvertRGBA8ToBGRA8(texture.GetBuffer(), flipped.GetBuffer(), texture.GetSize()); });
+        double flipMs = MeasureMs([&]() { Renderer::FlipRows(texture.GetBuffer(), flipped.GetBuffer(), texture.GetWidth() * Renderer::Texture::BytesPerColor, texture.GetHeight()); });
+
+        std::cout << "4K float to RGBA8 per pixel: " << scalarMs << "ms, batched: " << packMs << "ms, RGBA8 to BGRA8: " << swizzleMs << "ms, y-flip: " << flipMs << "ms" << std::endl;
+    }
+
+    void FormatSamplingBenchmark()
+    {
+        Renderer::Texture texture(2048, 2048);
+        for (size_t i = 0; i < texture.GetSize(); i++)
+        {
+            texture.SetColor(i, Renderer::Color(static_cast<uint32_t>(i * 2654435761u)));
+        }
+
+        // the sum keeps the reads from being optimized away
+        Renderer::Vec sum;
+        double colorMs = MeasureMs([&]() {
+            for (size_t i = 0; i < texture.GetSize(); i++)
+            {
+                Renderer::Vec texel = texture.GetColor(i).GetVec();
+                sum.x += texel.x;
+                sum.y += texel.y;
+                sum.z += texel.z;
+            }
+        });
+        std::cout << "2K texture, GetColor: " << colorMs << "ms" << std::endl;
+
+        const std::pair<Renderer::TextureFormat, const char*> formats[] = {
+            { Renderer::TextureFormat::RGBA8, "RGBA8" },
+            { Renderer::TextureFormat::RGBA16F, "RGBA16F" },
+            { Renderer::TextureFormat::RGBA32F, "RGBA32F" },
+            { Renderer::TextureFormat::BC1, "BC1" },
+            { Renderer::TextureFormat::BC3, "BC3" }
+        };
+        for (const auto& [format, name] : formats)
+        {
+            texture.Prepare(Renderer::TextureLayout::Linear, format);
+            Renderer::TextureView view(texture);
+            double viewMs = MeasureMs([&]() {
+                for (size_t y = 0; y < view.GetHeight(); y++)
+                {
+                    for (size_t x = 0; x < view.GetWidth(); x++)
+                    {
+                        Renderer::Vec texel = view.GetTexel(x, y);
+                        sum.x += texel.x;
+                        sum.y += texel.y;
+                        sum.z += texel.z;
+                    }
+                }
+            });
+
+            std::cout << "2K texture, " << name << " view of " << texture.GetByteSize() / 1024 << "KB: " << viewMs << "ms" << std::endl;
+        }
+        std::cout << "(" << sum.x + sum.y + sum.z << ")" << std::endl;
+    }
+
+    void TiledSamplingBenchmark()
+    {
+        Renderer::Texture texture(4096, 4096);
+        for (size_t i = 0; i < texture.GetSize(); i++)
+        {
+            texture.SetColor(i, Renderer::Color(static_cast<uint32_t>(i * 2654435761u)));
+        }
+
+        // bilinear footprints of a surface of pixels x pixels turned by about 30 degrees, every pixel steps by scale texels,
+        // coordinates wrap like repeat addressing
+        uint32_t sum = 0;
+        auto rotatedMs = [&sum](const Renderer::Texture& level, int32_t pixels, float scale) {
+            return MeasureMs([&]() {
+                float c = cosf(0.5f) * scale;
+                float s = sinf(0.5f) * scale;
+                size_t mask = level.GetWidth() - 1;
+                for (int32_t j = -pixels / 2; j < pixels / 2; j++)
+                {
+                    for (int32_t i = -pixels / 2; i < pixels / 2; i++)
+                    {
+                        size_t x = static_cast<size_t>(8192.0f + i * c - j * s);
+                        size_t y = static_cast<size_t>(8192.0f + i * s + j * c);
+                        sum += level.GetTexel(x & mask, y & mask)[0] + level.GetTexel((x + 1) & mask, y & mask)[0] +
+                            level.GetTexel(x & mask, (y + 1) & mask)[0] + level.GetTexel((x + 1) & mask, (y + 1) & mask)[0];
+                    }
+                }
+            });
+        };
+
+        for (Renderer::TextureLayout layout : { Renderer::TextureLayout::Linear, Renderer::TextureLayout::Tiled })
+        {
+            texture.Prepare(layout);
+
+            // surface turned by 90 degrees walks down the columns
+            double columnsMs = MeasureMs([&]() {
+                for (size_t x = 0; x < texture.GetWidth(); x++)
+                {
+                    for (size_t y = 0; y < texture.GetHeight(); y++)
+                    {
+                        sum += texture.GetTexel(x, y)[0];
+                    }
+                }
+            });
+
+            double rotatedLevel0Ms = rotatedMs(texture, 2048, 1.0f);
+            // a surface minified 4 times, sampled from level 0 as without mips and from level 2 where mip selection puts it
+            double minifiedLevel0Ms = rotatedMs(texture, 1024, 4.0f);
+            double minifiedLevel2Ms = rotatedMs(texture.GetMip(2), 1024, 1.0f);
+
+            std::cout << (layout == Renderer::TextureLayout::Linear ? "Linear" : "Tiled") << " 4K texture, column walk: " << columnsMs << "ms, rotated: " << rotatedLevel0Ms <<
+                "ms, minified 4x from level 0: " << minifiedLevel0Ms << "ms, from level 2: " << minifiedLevel2Ms << "ms" << std::endl;
+        }
+        std::cout << "(" << sum << ")" << std::endl;
+    }
+}
+
+// Timings of the kernels and texture paths of the software renderer, meaningful in release builds only.
+int main()
+{
+    ConversionBenchmark();
+    FormatSamplingBenchmark();
+    TiledSamplingBenchmark();
+    return 0;
+}
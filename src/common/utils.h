@@ -104,6 +104,30 @@ namespace Utils
         std::map<std::string, Sample> samples;
         std::stack<std::string> lastName;
     };
+
+    struct MemoryCounter
+    {
+        static MemoryCounter& GetInstance()
+        {
+            static MemoryCounter memoryCounter;
+            return memoryCounter;
+        }
+
+        void Set(const std::string& name, size_t bytes)
+        {
+            samples[name] = bytes;
+        }
+
+        void GetMemoryString(std::stringstream& ss)
+        {
+            for (const auto& sample : samples)
+            {
+                ss << sample.first << ": " << sample.second / 1024 << "KB\n";
+            }
+        }
+
+        std::map<std::string, size_t> samples;
+    };
 }
 
 #define LOG(message) Utils::DebugUtils::GetInstance().Log(std::stringstream() << "File: " << __FILE__ << "|Line: " << __LINE__ << "|" << message << "\n")
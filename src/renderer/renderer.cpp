@@ -9,7 +9,12 @@ using Microsoft::WRL::ComPtr;
 
 #include <renderer/math.cpp>
 #include <renderer/color.cpp>
+#include <renderer/pixels.cpp>
+#include <renderer/framearena.cpp>
 #include <renderer/texture.cpp>
+#include <renderer/texturecache.cpp>
+#include <renderer/textureatlas.cpp>
+#include <renderer/virtualtextures.cpp>
 #include <renderer/scene.cpp>
 #include <renderer/devicedx12.cpp>
 #include <renderer/imguirendererdx12.cpp>
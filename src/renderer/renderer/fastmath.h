@@ -0,0 +1,184 @@
+#pragma once
+
+#include <renderer/math.h>
+#include <renderer/simd.h>
+
+#include <cmath>
+
+namespace Renderer
+{
+    // Accuracy tiers of the shading math. Maximum errors are checked by tests:
+    // Exact - std functions and 1 / sqrt, the same results as the scalar code in math.cpp.
+    // Fast - polynomial exp2 and log2 and rsqrt refined by a Newton step, a few ULPs off, pow loses more, up to 256 ULPs for results above 1e-30.
+    // Fastest - short polynomials and raw rsqrt estimate, around 12 correct bits, enough for 8 bit color.
+    enum class MathAccuracy
+    {
+        Exact,
+        Fast,
+        Fastest
+    };
+
+    namespace FastMath
+    {
+        template<typename Float, size_t Size>
+        Float Polynomial(Float x, const float (&coefficients)[Size])
+        {
+            Float result = Float::Broadcast(coefficients[Size - 1]);
+            for (size_t i = Size - 1; i > 0; i--)
+            {
+                result = result * x + Float::Broadcast(coefficients[i - 1]);
+            }
+            return result;
+        }
+
+        template<typename Float, typename Function>
+        Float PerLane(Float x, Function function)
+        {
+            alignas(32) float lanes[Float::Width];
+            x.Store(lanes);
+            for (float& lane : lanes)
+            {
+                lane = function(lane);
+            }
+            return Float::Load(lanes);
+        }
+    }
+
+    template<MathAccuracy Accuracy, typename Float>
+    Float Rsqrt(Float x)
+    {
+        if constexpr (Accuracy == MathAccuracy::Exact)
+        {
+            return Float::Broadcast(1.0f) / Sqrt(x);
+        }
+        else if constexpr (Accuracy == MathAccuracy::Fast)
+        {
+            Float estimate = RsqrtApproximate(x);
+            return estimate * (Float::Broadcast(1.5f) - Float::Broadcast(0.5f) * x * estimate * estimate);
+        }
+        else
+        {
+            return RsqrtApproximate(x);
+        }
+    }
+
+    // Flushes results below the smallest normal float to 0.
+    template<MathAccuracy Accuracy, typename Float>
+    Float Exp2(Float x)
+    {
+        if constexpr (Accuracy == MathAccuracy::Exact)
+        {
+            return FastMath::PerLane(x, [](float lane) { return std::exp2(lane); });
+        }
+        else
+        {
+            // Least squares fits of 2^f on 0 to 1 range, relative error is 2e-9 and 8e-5.
+            static constexpr float FastCoefficients[] = { 1.000000001828035f, 0.6931469861204106f, 0.24022980707512573f, 0.0554834755443532f, 0.009678569185020525f, 0.0012442209436762026f, 0.00021693552839852702f };
+            static constexpr float FastestCoefficients[] = { 0.999927826644595f, 0.6957770964260178f, 0.22623319420354177f, 0.0779071637714232f };
+
+            Float clamped = Min(Max(x, Float::Broadcast(-126.0f)), Float::Broadcast(127.0f));
+            Float integral = Floor(clamped);
+            Float fraction = clamped - integral;
+
+            Float result = PowerOfTwo(integral) * (Accuracy == MathAccuracy::Fast ? FastMath::Polynomial(fraction, FastCoefficients) : FastMath::Polynomial(fraction, FastestCoefficients));
+            return Select(LessThan(x, Float::Broadcast(-126.0f)), Float::Broadcast(0.0f), result);
+        }
+    }
+
+    // Defined for positive normal values.
+    template<MathAccuracy Accuracy, typename Float>
+    Float Log2(Float x)
+    {
+        if constexpr (Accuracy == MathAccuracy::Exact)
+        {
+            return FastMath::PerLane(x, [](float lane) { return std::log2(lane); });
+        }
+        else
+        {
+            // log2(1 + u) = u * q(u) with least squares fits of q on 1/sqrt(2) - 1 to sqrt(2) - 1 range, relative error is 3e-8 and 4e-4.
+            static constexpr float FastCoefficients[] = { 1.4426950035483863f, -0.7213474817865672f, 0.48091076782227243f, -0.36069210946286057f, 0.2879017526632695f, -0.23919487347358911f, 0.21611910259375286f, -0.205705813256578f, 0.12280560584825402f };
+            static constexpr float FastestCoefficients[] = { 1.4423167519000144f, -0.7247994775492534f, 0.5099000236889304f, -0.32133024780548747f };
+
+            Float exponent = GetExponent(x);
+            Float mantissa = GetMantissa(x);
+
+            // keep the mantissa around 1, so the polynomial is accurate for values close to 1
+            Float isLarge = GreaterThan(mantissa, Float::Broadcast(1.41421356f));
+            mantissa = Select(isLarge, mantissa * Float::Broadcast(0.5f), mantissa);
+            exponent = exponent + And(isLarge, Float::Broadcast(1.0f));
+
+            Float u = mantissa - Float::Broadcast(1.0f);
+            Float q = Accuracy == MathAccuracy::Fast ? FastMath::Polynomial(u, FastCoefficients) : FastMath::Polynomial(u, FastestCoefficients);
+            return exponent + u * q;
+        }
+    }
+
+    // Defined for non-negative x, pow(0, y) is 0 for any y.
+    template<MathAccuracy Accuracy, typename Float>
+    Float Pow(Float x, Float y)
+    {
+        if constexpr (Accuracy == MathAccuracy::Exact)
+        {
+            alignas(32) float xs[Float::Width];
+            alignas(32) float ys[Float::Width];
+            x.Store(xs);
+            y.Store(ys);
+            for (size_t i = 0; i < Float::Width; i++)
+            {
+                xs[i] = pow(xs[i], ys[i]);
+            }
+            return Float::Load(xs);
+        }
+        else
+        {
+            Float result = Exp2<Accuracy>(y * Log2<Accuracy>(x));
+            return Select(GreaterThan(x, Float::Broadcast(0.0f)), result, Float::Broadcast(0.0f));
+        }
+    }
+
+    // Scalar versions compute a single SSE lane, so they give the same results as the SIMD versions.
+    template<MathAccuracy Accuracy>
+    float Rsqrt(float x)
+    {
+        if constexpr (Accuracy == MathAccuracy::Exact)
+        {
+            return 1.0f / sqrt(x);
+        }
+        else
+        {
+            return Rsqrt<Accuracy>(Float4::Broadcast(x)).GetFirst();
+        }
+    }
+
+    template<MathAccuracy Accuracy>
+    float Exp2(float x)
+    {
+        return Exp2<Accuracy>(Float4::Broadcast(x)).GetFirst();
+    }
+
+    template<MathAccuracy Accuracy>
+    float Log2(float x)
+    {
+        return Log2<Accuracy>(Float4::Broadcast(x)).GetFirst();
+    }
+
+    template<MathAccuracy Accuracy>
+    float Pow(float x, float y)
+    {
+        if constexpr (Accuracy == MathAccuracy::Exact)
+        {
+            return pow(x, y);
+        }
+        else
+        {
+            return Pow<Accuracy>(Float4::Broadcast(x), Float4::Broadcast(y)).GetFirst();
+        }
+    }
+
+    template<MathAccuracy Accuracy>
+    Vec Normalize(const Vec& v)
+    {
+        float norm = Rsqrt<Accuracy>(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w);
+        return Vec{ v.x * norm, v.y * norm, v.z * norm, v.w * norm };
+    }
+}
@@ -0,0 +1,193 @@
+#include <renderer/framearena.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace Renderer
+{
+    namespace
+    {
+        constexpr size_t MinimumBlockSize = size_t(64) * 1024;
+
+        size_t AlignUp(size_t value, size_t alignment)
+        {
+            return (value + alignment - 1) & ~(alignment - 1);
+        }
+    }
+
+    FrameArena::FrameArena(size_t capacity) : capacity(capacity)
+    {
+    }
+
+    void* FrameArena::Allocate(size_t size, size_t alignment)
+    {
+        assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+        if (size == 0)
+        {
+            size = 1;
+        }
+
+        size_t alignedOffset = 0;
+        if (!blocks.empty())
+        {
+            uintptr_t base = reinterpret_cast<uintptr_t>(blocks.back().memory.get());
+            alignedOffset = AlignUp(base + offset, alignment) - base;
+        }
+
+        if (blocks.empty() || alignedOffset + size > blocks.back().size)
+        {
+            if (!AddBlock(size + alignment))
+            {
+                return nullptr;
+            }
+
+            uintptr_t base = reinterpret_cast<uintptr_t>(blocks.back().memory.get());
+            alignedOffset = AlignUp(base, alignment) - base;
+        }
+
+        if (used + (alignedOffset - offset) + size > capacity)
+        {
+            return nullptr;
+        }
+
+        used += alignedOffset - offset + size;
+        offset = alignedOffset + size;
+        highWaterMark = std::max(highWaterMark, used);
+
+        if (!stages.empty())
+        {
+            stages.back().second += size;
+        }
+
+        return blocks.back().memory.get() + alignedOffset;
+    }
+
+    bool FrameArena::AddBlock(size_t minimumSize)
+    {
+        // Nothing is allocated, so the blocks kept from the previous frames are replaced instead of taking the budget from the new one.
+        if (used == 0 && !blocks.empty())
+        {
+            blocks.clear();
+            reserved = 0;
+            offset = 0;
+        }
+
+        if (reserved + minimumSize > capacity)
+        {
+            return false;
+        }
+
+        // Double the reservation each time, so a frame does a logarithmic number of heap allocations until the high-water mark is known.
+        size_t size = std::min(std::max({ minimumSize, reserved, MinimumBlockSize }), capacity - reserved);
+
+        Block block;
+        block.memory = std::make_unique_for_overwrite<uint8_t[]>(size);
+        block.size = size;
+
+        // The tail of the previous block is lost, count it as used.
+        if (!blocks.empty())
+        {
+            used += blocks.back().size - offset;
+        }
+
+        blocks.push_back(std::move(block));
+        reserved += size;
+        offset = 0;
+        return true;
+    }
+
+    FrameArena::Marker FrameArena::GetMarker() const
+    {
+        return { blocks.size(), offset, used };
+    }
+
+    void FrameArena::Rewind(const Marker& marker)
+    {
+        assert(marker.blocks <= blocks.size() && marker.used <= used);
+
+        // Blocks added after the marker are freed, Reset reserves the high-water mark again for the next frame.
+        while (blocks.size() > std::max<size_t>(marker.blocks, 1))
+        {
+            reserved -= blocks.back().size;
+            blocks.pop_back();
+        }
+
+        offset = marker.blocks > 0 ? marker.offset : 0;
+        used = marker.used;
+    }
+
+    void FrameArena::SetStage(const std::string& name)
+    {
+        for (size_t i = 0; i < stages.size(); i++)
+        {
+            if (stages[i].first == name)
+            {
+                std::swap(stages[i], stages.back());
+                return;
+            }
+        }
+
+        stages.push_back({ name, 0 });
+    }
+
+    void FrameArena::Reset()
+    {
+        for (auto& stage : stages)
+        {
+            Utils::MemoryCounter::GetInstance().Set("Frame arena, " + stage.first, stage.second);
+            stage.second = 0;
+        }
+
+        Utils::MemoryCounter::GetInstance().Set("Frame arena high-water mark", highWaterMark);
+        Utils::MemoryCounter::GetInstance().Set("Frame arena capacity", capacity);
+
+        size_t size = std::min(std::max(reserved, highWaterMark), capacity);
+        if (blocks.size() > 1 || reserved < size)
+        {
+            blocks.clear();
+
+            Block block;
+            block.memory = std::make_unique_for_overwrite<uint8_t[]>(size);
+            block.size = size;
+            blocks.push_back(std::move(block));
+            reserved = size;
+        }
+
+        offset = 0;
+        used = 0;
+    }
+
+    void FrameArena::SetCapacity(size_t bytes)
+    {
+        capacity = bytes;
+
+        if (reserved > capacity)
+        {
+            blocks.clear();
+            reserved = 0;
+            offset = 0;
+            used = 0;
+        }
+    }
+
+    size_t FrameArena::GetCapacity() const
+    {
+        return capacity;
+    }
+
+    size_t FrameArena::GetUsed() const
+    {
+        return used;
+    }
+
+    size_t FrameArena::GetAvailable() const
+    {
+        return capacity > used ? capacity - used : 0;
+    }
+
+    size_t FrameArena::GetHighWaterMark() const
+    {
+        return highWaterMark;
+    }
+}
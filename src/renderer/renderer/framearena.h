@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <utils.h>
+
+namespace Renderer
+{
+    // Linear allocator for data that lives for a single frame.
+    // Memory grows in blocks up to the capacity, after a reset the blocks are merged into one block of the high-water mark size,
+    // so in a steady state a frame does no heap allocations and Reset is O(1).
+    // Nothing allocated from the arena is destructed, only trivially destructible types should be placed here.
+    struct FrameArena
+    {
+        static constexpr size_t DefaultCapacity = size_t(512) * 1024 * 1024;
+
+        DELETE_CTORS(FrameArena);
+        explicit FrameArena(size_t capacity = DefaultCapacity);
+
+        // Returns nullptr when the allocation would exceed the capacity.
+        void* Allocate(size_t size, size_t alignment);
+
+        template<typename T>
+        T* Allocate(size_t count)
+        {
+            return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+        }
+
+        // Position of the next allocation, see Rewind.
+        struct Marker
+        {
+            size_t blocks = 0;
+            size_t offset = 0;
+            size_t used = 0;
+        };
+
+        Marker GetMarker() const;
+
+        // Makes the memory allocated after the marker available again, none of it may be in use any more.
+        // Stages keep counting what was allocated under them.
+        void Rewind(const Marker& marker);
+
+        // Allocations made after this call are reported under the stage name.
+        void SetStage(const std::string& name);
+
+        // Reports usage to Utils::MemoryCounter and makes all the memory available again.
+        void Reset();
+
+        // Must not be called while memory from the arena is in use.
+        void SetCapacity(size_t bytes);
+        size_t GetCapacity() const;
+        size_t GetUsed() const;
+        size_t GetAvailable() const;
+        size_t GetHighWaterMark() const;
+
+    private:
+        struct Block
+        {
+            std::unique_ptr<uint8_t[]> memory;
+            size_t size = 0;
+        };
+
+        bool AddBlock(size_t minimumSize);
+
+        std::vector<Block> blocks;
+        size_t offset = 0; // in the last block
+        size_t reserved = 0; // total size of all blocks
+        size_t used = 0;
+        size_t highWaterMark = 0;
+        size_t capacity = 0;
+
+        std::vector<std::pair<std::string, size_t>> stages;
+    };
+}
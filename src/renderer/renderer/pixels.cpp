@@ -0,0 +1,534 @@
+#include <renderer/pixels.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+#include <immintrin.h>
+
+namespace Renderer
+{
+    namespace
+    {
+        uint8_t ToByte(float channel)
+        {
+            return static_cast<uint8_t>(std::clamp(channel, 0.0f, 1.0f) * 255);
+        }
+
+        uint16_t To565(const uint8_t* rgb)
+        {
+            return static_cast<uint16_t>(((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3));
+        }
+
+        void From565(uint16_t color, uint8_t* rgb)
+        {
+            uint32_t r = (color >> 11) & 0x1F;
+            uint32_t g = (color >> 5) & 0x3F;
+            uint32_t b = color & 0x1F;
+            rgb[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+            rgb[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+            rgb[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+        }
+
+        // Color of a BC1 index, 4 colors when the first endpoint is greater, otherwise 3 colors and transparent black.
+        // Color blocks of BC3 always have 4 colors.
+        uint32_t GetColorValue(const uint8_t* block, bool fourColors, uint32_t code)
+        {
+            uint16_t color0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+            uint16_t color1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+            fourColors = fourColors || color0 > color1;
+
+            uint8_t a[3];
+            uint8_t b[3];
+            From565(color0, a);
+            From565(color1, b);
+
+            // weights of the endpoints in thirds, or in halves for 3 colors
+            static constexpr uint32_t Weights[2][4][2] = { { { 2, 0 }, { 0, 2 }, { 1, 1 }, { 0, 0 } }, { { 3, 0 }, { 0, 3 }, { 2, 1 }, { 1, 2 } } };
+            const uint32_t* weights = Weights[fourColors][code];
+
+            uint32_t pixel = fourColors || code != 3 ? 0xFF000000u : 0u;
+            for (size_t channel = 0; channel < 3; channel++)
+            {
+                uint32_t value = weights[0] * a[channel] + weights[1] * b[channel];
+                pixel |= (fourColors ? value / 3 : value / 2) << (channel * 8);
+            }
+
+            return pixel;
+        }
+
+        void DecodeColorBlock(const uint8_t* block, bool fourColors, uint32_t* rgba)
+        {
+            uint32_t palette[4];
+            for (uint32_t code = 0; code < 4; code++)
+            {
+                palette[code] = GetColorValue(block, fourColors, code);
+            }
+
+            uint32_t indices;
+            std::memcpy(&indices, block + 4, sizeof(indices));
+            for (size_t i = 0; i < 16; i++)
+            {
+                rgba[i] = palette[(indices >> (i * 2)) & 3];
+            }
+        }
+
+        // Alpha of a BC3 index, 8 values between the endpoints when the first one is greater, otherwise 6 values, 0 and 255.
+        uint8_t GetBC3AlphaValue(uint32_t alpha0, uint32_t alpha1, uint32_t code)
+        {
+            if (code < 2)
+            {
+                return static_cast<uint8_t>(code == 0 ? alpha0 : alpha1);
+            }
+
+            if (alpha0 > alpha1)
+            {
+                return static_cast<uint8_t>(((8 - code) * alpha0 + (code - 1) * alpha1) / 7);
+            }
+
+            if (code < 6)
+            {
+                return static_cast<uint8_t>(((6 - code) * alpha0 + (code - 1) * alpha1) / 5);
+            }
+
+            return code == 6 ? 0 : 255;
+        }
+
+        // Writes the endpoints and the closest palette entry of every texel, returns the squared error of the block.
+        int32_t EncodeColorEndpoints(const uint8_t* rgba, const uint8_t* maximum, const uint8_t* minimum, uint8_t* block)
+        {
+            uint16_t color0 = To565(maximum);
+            uint16_t color1 = To565(minimum);
+            block[0] = static_cast<uint8_t>(color0);
+            block[1] = static_cast<uint8_t>(color0 >> 8);
+            block[2] = static_cast<uint8_t>(color1);
+            block[3] = static_cast<uint8_t>(color1 >> 8);
+
+            // every channel of the maximum is at least the minimum, so the first endpoint is greater unless they are the same color,
+            // then all entries are the same and every index is 0
+            uint8_t palette[4][4];
+            for (uint32_t entry = 0; entry < 4; entry++)
+            {
+                uint32_t pixel = GetColorValue(block, true, entry);
+                std::memcpy(palette[entry], &pixel, sizeof(pixel));
+            }
+
+            uint32_t indices = 0;
+            int32_t error = 0;
+            for (size_t i = 0; i < 16; i++)
+            {
+                uint32_t best = 0;
+                int32_t bestDistance = INT32_MAX;
+                for (uint32_t entry = 0; entry < 4; entry++)
+                {
+                    int32_t distance = 0;
+                    for (size_t channel = 0; channel < 3; channel++)
+                    {
+                        int32_t difference = static_cast<int32_t>(rgba[i * 4 + channel]) - palette[entry][channel];
+                        distance += difference * difference;
+                    }
+
+                    if (distance < bestDistance)
+                    {
+                        best = entry;
+                        bestDistance = distance;
+                    }
+                }
+
+                indices |= best << (i * 2);
+                error += bestDistance;
+            }
+
+            std::memcpy(block + 4, &indices, sizeof(indices));
+            return error;
+        }
+
+        void EncodeColorBlock(const uint8_t* rgba, uint8_t* block)
+        {
+            uint8_t minimum[3] = { 255, 255, 255 };
+            uint8_t maximum[3] = { 0, 0, 0 };
+            for (size_t i = 0; i < 16; i++)
+            {
+                for (size_t channel = 0; channel < 3; channel++)
+                {
+                    minimum[channel] = std::min(minimum[channel], rgba[i * 4 + channel]);
+                    maximum[channel] = std::max(maximum[channel], rgba[i * 4 + channel]);
+                }
+            }
+
+            // The bounding box keeps two tone blocks exact, insetting it by 1/16 of the range lets the interpolated colors cover
+            // gradients better. The endpoints with the smaller error win.
+            uint8_t insetMinimum[3];
+            uint8_t insetMaximum[3];
+            for (size_t channel = 0; channel < 3; channel++)
+            {
+                uint8_t inset = static_cast<uint8_t>((maximum[channel] - minimum[channel]) / 16);
+                insetMinimum[channel] = static_cast<uint8_t>(minimum[channel] + inset);
+                insetMaximum[channel] = static_cast<uint8_t>(maximum[channel] - inset);
+            }
+
+            uint8_t inset[BC1BlockBytes];
+            if (EncodeColorEndpoints(rgba, insetMaximum, insetMinimum, inset) < EncodeColorEndpoints(rgba, maximum, minimum, block))
+            {
+                std::memcpy(block, inset, BC1BlockBytes);
+            }
+        }
+
+        void EncodeAlphaBlock(const uint8_t* rgba, uint8_t* block)
+        {
+            uint8_t minimum = 255;
+            uint8_t maximum = 0;
+            for (size_t i = 0; i < 16; i++)
+            {
+                minimum = std::min(minimum, rgba[i * 4 + 3]);
+                maximum = std::max(maximum, rgba[i * 4 + 3]);
+            }
+
+            // 8 values between the endpoints, when they are the same every index is 0
+            block[0] = maximum;
+            block[1] = minimum;
+
+            uint64_t indices = 0;
+            if (maximum != minimum)
+            {
+                for (size_t i = 0; i < 16; i++)
+                {
+                    uint64_t best = 0;
+                    int32_t bestDistance = INT32_MAX;
+                    for (uint32_t code = 0; code < 8; code++)
+                    {
+                        int32_t distance = std::abs(static_cast<int32_t>(rgba[i * 4 + 3]) - GetBC3AlphaValue(maximum, minimum, code));
+                        if (distance < bestDistance)
+                        {
+                            best = code;
+                            bestDistance = distance;
+                        }
+                    }
+
+                    indices |= best << (i * 3);
+                }
+            }
+
+            std::memcpy(block + 2, &indices, 6);
+        }
+
+        uint32_t SwapRedBlue(uint32_t pixel)
+        {
+            return (pixel & 0xFF00FF00) | ((pixel & 0x00FF0000) >> 16) | ((pixel & 0x000000FF) << 16);
+        }
+    }
+
+    uint32_t ToRGBA8(const Color& color)
+    {
+        return ((color.rgba & 0xFF000000) >> 24) | ((color.rgba & 0x00FF0000) >> 8) | ((color.rgba & 0x0000FF00) << 8) | ((color.rgba & 0x000000FF) << 24);
+    }
+
+    void ConvertFloatToRGBA8(const Vec* colors, uint8_t* rgba, size_t count)
+    {
+        const float* source = &colors[0].x;
+        size_t i = 0;
+
+#if defined(__AVX2__)
+        const __m256 zero8 = _mm256_setzero_ps();
+        const __m256 one8 = _mm256_set1_ps(1.0f);
+        const __m256 scale8 = _mm256_set1_ps(255.0f);
+        // packs work inside 128 bit lanes, so after packing pixels are ordered as 0 2 4 6 1 3 5 7
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i c0 = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source + i * 4 + 0), zero8), one8), scale8));
+            __m256i c1 = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source + i * 4 + 8), zero8), one8), scale8));
+            __m256i c2 = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source + i * 4 + 16), zero8), one8), scale8));
+            __m256i c3 = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source + i * 4 + 24), zero8), one8), scale8));
+
+            __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(c0, c1), _mm256_packs_epi32(c2, c3));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + i * 4), _mm256_permutevar8x32_epi32(packed, order));
+        }
+#endif
+
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 scale = _mm_set1_ps(255.0f);
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i c0 = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + i * 4 + 0), zero), one), scale));
+            __m128i c1 = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + i * 4 + 4), zero), one), scale));
+            __m128i c2 = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + i * 4 + 8), zero), one), scale));
+            __m128i c3 = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(source + i * 4 + 12), zero), one), scale));
+
+            __m128i packed = _mm_packus_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), packed);
+        }
+
+        for (; i < count; i++)
+        {
+            rgba[i * 4 + 0] = ToByte(colors[i].x);
+            rgba[i * 4 + 1] = ToByte(colors[i].y);
+            rgba[i * 4 + 2] = ToByte(colors[i].z);
+            rgba[i * 4 + 3] = ToByte(colors[i].w);
+        }
+    }
+
+    void ConvertRGBA8ToBGRA8(const uint8_t* rgba, uint8_t* bgra, size_t count)
+    {
+        size_t i = 0;
+
+#if defined(__AVX2__)
+        const __m256i swap8 = _mm256_setr_epi8(
+            2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+            2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + i * 4));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(bgra + i * 4), _mm256_shuffle_epi8(pixels, swap8));
+        }
+#endif
+
+        const __m128i greenAlpha = _mm_set1_epi32(static_cast<int32_t>(0xFF00FF00));
+        const __m128i lowByte = _mm_set1_epi32(0x000000FF);
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+            __m128i red = _mm_slli_epi32(_mm_and_si128(pixels, lowByte), 16);
+            __m128i blue = _mm_and_si128(_mm_srli_epi32(pixels, 16), lowByte);
+            __m128i swapped = _mm_or_si128(_mm_and_si128(pixels, greenAlpha), _mm_or_si128(red, blue));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bgra + i * 4), swapped);
+        }
+
+        for (; i < count; i++)
+        {
+            uint32_t pixel;
+            std::memcpy(&pixel, rgba + i * 4, sizeof(pixel));
+            pixel = SwapRedBlue(pixel);
+            std::memcpy(bgra + i * 4, &pixel, sizeof(pixel));
+        }
+    }
+
+    void FlipRows(const uint8_t* source, uint8_t* destination, size_t rowSize, size_t rowCount)
+    {
+        for (size_t row = 0; row < rowCount; row++)
+        {
+            std::memcpy(destination + (rowCount - 1 - row) * rowSize, source + row * rowSize, rowSize);
+        }
+    }
+
+    uint32_t DiffRGBA8(const uint8_t* lhs, const uint8_t* rhs, uint8_t* result, size_t count, uint32_t highlight)
+    {
+        uint32_t differentPixelsCount = 0;
+        size_t i = 0;
+
+#if defined(__AVX2__)
+        const __m256i rgbMask8 = _mm256_set1_epi32(0x00FFFFFF);
+        const __m256i alphaMask8 = _mm256_set1_epi32(static_cast<int32_t>(0xFF000000));
+        const __m256i highlight8 = _mm256_set1_epi32(static_cast<int32_t>(highlight));
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i * 4));
+            __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + i * 4));
+            __m256i equal = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_xor_si256(l, r), rgbMask8), _mm256_setzero_si256());
+            __m256i pixels = _mm256_blendv_epi8(highlight8, _mm256_or_si256(l, alphaMask8), equal);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(result + i * 4), pixels);
+            differentPixelsCount += 8 - std::popcount(static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(equal))));
+        }
+#endif
+
+        const __m128i rgbMask = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i alphaMask = _mm_set1_epi32(static_cast<int32_t>(0xFF000000));
+        const __m128i highlight4 = _mm_set1_epi32(static_cast<int32_t>(highlight));
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i * 4));
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + i * 4));
+            __m128i equal = _mm_cmpeq_epi32(_mm_and_si128(_mm_xor_si128(l, r), rgbMask), _mm_setzero_si128());
+            __m128i pixels = _mm_or_si128(_mm_and_si128(equal, _mm_or_si128(l, alphaMask)), _mm_andnot_si128(equal, highlight4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(result + i * 4), pixels);
+            differentPixelsCount += 4 - std::popcount(static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(equal))));
+        }
+
+        for (; i < count; i++)
+        {
+            uint32_t l, r;
+            std::memcpy(&l, lhs + i * 4, sizeof(l));
+            std::memcpy(&r, rhs + i * 4, sizeof(r));
+
+            uint32_t pixel = highlight;
+            if (((l ^ r) & 0x00FFFFFF) == 0)
+            {
+                pixel = l | 0xFF000000;
+            }
+            else
+            {
+                differentPixelsCount++;
+            }
+
+            std::memcpy(result + i * 4, &pixel, sizeof(pixel));
+        }
+
+        return differentPixelsCount;
+    }
+
+    void DownsampleRGBA8(const uint8_t* top, const uint8_t* bottom, uint8_t* destination, size_t count)
+    {
+        size_t i = 0;
+
+#if defined(__AVX2__)
+        const __m256i zero8 = _mm256_setzero_si256();
+        const __m256i two8 = _mm256_set1_epi16(2);
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m256i upper = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(top + i * 8));
+            __m256i lower = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bottom + i * 8));
+
+            // unpacks work inside 128 bit lanes, low halves hold pixels 0 1 and 4 5, high halves 2 3 and 6 7
+            __m256i low = _mm256_add_epi16(_mm256_unpacklo_epi8(upper, zero8), _mm256_unpacklo_epi8(lower, zero8));
+            __m256i high = _mm256_add_epi16(_mm256_unpackhi_epi8(upper, zero8), _mm256_unpackhi_epi8(lower, zero8));
+            __m256i sums = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(low, high), _mm256_unpackhi_epi64(low, high)), two8);
+
+            __m256i packed = _mm256_packus_epi16(_mm256_srli_epi16(sums, 2), zero8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + i * 4), _mm256_castsi256_si128(_mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0))));
+        }
+#endif
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi16(2);
+
+        for (; i + 2 <= count; i += 2)
+        {
+            __m128i upper = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i * 8));
+            __m128i lower = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i * 8));
+
+            __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(upper, zero), _mm_unpacklo_epi8(lower, zero));
+            __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(upper, zero), _mm_unpackhi_epi8(lower, zero));
+            __m128i sums = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi64(low, high), _mm_unpackhi_epi64(low, high)), two);
+
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(destination + i * 4), _mm_packus_epi16(_mm_srli_epi16(sums, 2), zero));
+        }
+
+        for (; i < count; i++)
+        {
+            for (size_t channel = 0; channel < 4; channel++)
+            {
+                destination[i * 4 + channel] = static_cast<uint8_t>((top[i * 8 + channel] + top[i * 8 + 4 + channel] + bottom[i * 8 + channel] + bottom[i * 8 + 4 + channel] + 2) / 4);
+            }
+        }
+    }
+
+    void DownsampleSRGBA8(const uint8_t* top, const uint8_t* bottom, uint8_t* destination, size_t count)
+    {
+        // linear values are encoded back through 4096 steps, enough to round to the closest byte except in the darkest tones
+        struct Tables
+        {
+            float toLinear[256];
+            uint8_t fromLinear[4096];
+
+            Tables()
+            {
+                for (size_t i = 0; i < 256; i++)
+                {
+                    float value = i / 255.0f;
+                    toLinear[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+                }
+
+                for (size_t i = 0; i < 4096; i++)
+                {
+                    float value = i / 4095.0f;
+                    float encoded = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+                    fromLinear[i] = static_cast<uint8_t>(std::clamp(encoded, 0.0f, 1.0f) * 255.0f + 0.5f);
+                }
+            }
+        };
+        static const Tables tables;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            for (size_t channel = 0; channel < 3; channel++)
+            {
+                float sum = tables.toLinear[top[i * 8 + channel]] + tables.toLinear[top[i * 8 + 4 + channel]] + tables.toLinear[bottom[i * 8 + channel]] + tables.toLinear[bottom[i * 8 + 4 + channel]];
+                destination[i * 4 + channel] = tables.fromLinear[static_cast<size_t>(sum * (4095.0f / 4.0f) + 0.5f)];
+            }
+
+            destination[i * 4 + 3] = static_cast<uint8_t>((top[i * 8 + 3] + top[i * 8 + 7] + bottom[i * 8 + 3] + bottom[i * 8 + 7] + 2) / 4);
+        }
+    }
+
+    uint16_t ConvertFloatToHalf(float value)
+    {
+        uint32_t bits = std::bit_cast<uint32_t>(value);
+        uint32_t sign = (bits >> 16) & 0x8000u;
+        bits &= 0x7FFFFFFFu;
+
+        // infinity or NaN, and finite values that round to a magnitude above 65504
+        if (bits >= 0x47800000u)
+        {
+            return static_cast<uint16_t>(sign | (bits > 0x7F800000u ? 0x7E00u : 0x7C00u));
+        }
+
+        // below the smallest normal half, adding 0.5 aligns the mantissa so the float unit does the rounding
+        if (bits < 0x38800000u)
+        {
+            float aligned = std::bit_cast<float>(bits) + 0.5f;
+            return static_cast<uint16_t>(sign | (std::bit_cast<uint32_t>(aligned) - 0x3F000000u));
+        }
+
+        uint32_t odd = (bits >> 13) & 1u;
+        bits += 0xC8000FFFu + odd; // rebias the exponent from 127 to 15 and round
+        return static_cast<uint16_t>(sign | (bits >> 13));
+    }
+
+    float ConvertHalfToFloat(uint16_t value)
+    {
+        uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+        uint32_t bits = static_cast<uint32_t>(value & 0x7FFFu) << 13;
+
+        // multiplying rebiases the exponent from 15 to 127 and turns denormal halves into normal floats
+        float magnitude = std::bit_cast<float>(bits) * 0x1p112f;
+        if (bits >= 0x0F800000u)
+        {
+            magnitude = std::bit_cast<float>(bits | 0x7F800000u); // infinity or NaN
+        }
+
+        return std::bit_cast<float>(std::bit_cast<uint32_t>(magnitude) | sign);
+    }
+
+    void EncodeBC1Block(const uint8_t* rgba, uint8_t* block)
+    {
+        EncodeColorBlock(rgba, block);
+    }
+
+    void EncodeBC3Block(const uint8_t* rgba, uint8_t* block)
+    {
+        EncodeAlphaBlock(rgba, block);
+        EncodeColorBlock(rgba, block + BC1BlockBytes);
+    }
+
+    void DecodeBC1Block(const uint8_t* block, uint32_t* rgba)
+    {
+        DecodeColorBlock(block, false, rgba);
+    }
+
+    void DecodeBC3Block(const uint8_t* block, uint32_t* rgba)
+    {
+        DecodeColorBlock(block + BC1BlockBytes, true, rgba);
+
+        uint8_t alphas[8];
+        for (uint32_t code = 0; code < 8; code++)
+        {
+            alphas[code] = GetBC3AlphaValue(block[0], block[1], code);
+        }
+
+        uint64_t indices = 0;
+        std::memcpy(&indices, block + 2, 6);
+        for (size_t i = 0; i < 16; i++)
+        {
+            rgba[i] = (rgba[i] & 0x00FFFFFFu) | (static_cast<uint32_t>(alphas[(indices >> (i * 3)) & 7]) << 24);
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <renderer/color.h>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace Renderer
+{
+    // Batch pixel conversions. RGBA8 is the byte order Texture keeps in memory: r, g, b, a.
+    // Every kernel handles 8 pixels per iteration with AVX2 and 4 pixels with SSE2, the tail is converted one by one.
+
+    // Packs a color into a single RGBA8 pixel.
+    uint32_t ToRGBA8(const Color& color);
+
+    // Clamps channels to [0, 1] and truncates the same way Color(const Vec&) does, so results are identical to per pixel conversion.
+    void ConvertFloatToRGBA8(const Vec* colors, uint8_t* rgba, size_t count);
+
+    // Swaps red and blue channels. Source and destination may be the same buffer.
+    void ConvertRGBA8ToBGRA8(const uint8_t* rgba, uint8_t* bgra, size_t count);
+
+    // First source row becomes the last destination row. Source and destination must not overlap.
+    void FlipRows(const uint8_t* source, uint8_t* destination, size_t rowSize, size_t rowCount);
+
+    // Compares rgb of RGBA8 pixels ignoring alpha. Equal pixels are written to result as opaque lhs, different ones as highlight.
+    // Returns the number of different pixels.
+    uint32_t DiffRGBA8(const uint8_t* lhs, const uint8_t* rhs, uint8_t* result, size_t count, uint32_t highlight);
+
+    // Averages 2x2 RGBA8 pixels of two rows into count pixels, (a + b + c + d + 2) / 4 per channel. The rows hold 2 * count pixels
+    // and may be the same row.
+    void DownsampleRGBA8(const uint8_t* top, const uint8_t* bottom, uint8_t* destination, size_t count);
+
+    // The same for sRGB colors, rgb is averaged in linear space, so dark and bright texels keep their brightness, alpha is linear.
+    // One pixel at a time through tables.
+    void DownsampleSRGBA8(const uint8_t* top, const uint8_t* bottom, uint8_t* destination, size_t count);
+
+    // Block compression of 4x4 RGBA8 texels given row by row. BC1 keeps rgb in 8 bytes, two 565 endpoints and a 2 bit index per texel
+    // into the palette interpolated between them. BC3 adds 8 bytes of alpha, two 8 bit endpoints and a 3 bit index per texel.
+    constexpr size_t CompressedBlockSize = 4;
+    constexpr size_t BC1BlockBytes = 8;
+    constexpr size_t BC3BlockBytes = 16;
+
+    // Endpoints are the corners of the bounding box of the colors, or of the box inset a little when that fits the block better.
+    // BC1 is always encoded opaque.
+    void EncodeBC1Block(const uint8_t* rgba, uint8_t* block);
+    void EncodeBC3Block(const uint8_t* rgba, uint8_t* block);
+
+    // Writes the 16 texels of a block as RGBA8 pixels row by row.
+    void DecodeBC1Block(const uint8_t* block, uint32_t* rgba);
+    void DecodeBC3Block(const uint8_t* block, uint32_t* rgba);
+
+    // IEEE 754 half precision, one value at a time. Rounds to nearest even, values out of range become infinity and NaN stays NaN.
+    uint16_t ConvertFloatToHalf(float value);
+    float ConvertHalfToFloat(uint16_t value);
+}
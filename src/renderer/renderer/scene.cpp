@@ -1,14 +1,28 @@
 #include <renderer/scene.h>
+#include <renderer/texture.h>
 
 #include <utils.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
+#include <type_traits>
 #include <map>
 #include <cassert>
 #include <iostream>
+#include <limits>
 
 namespace Renderer
 {
@@ -95,58 +109,6 @@ namespace Renderer
             return true;
         }
 
-        bool Read(std::stringstream& lineStream, const Context& loadContext, std::vector<Vertex>& vertices)
-        {
-            std::string faceDescription;
-            while (lineStream >> faceDescription)
-            {
-                Vertex vert;
-
-                std::stringstream faceDescriptionStream(faceDescription);
-
-                int32_t positionIndex;
-                if (faceDescriptionStream >> positionIndex)
-                {
-                    int32_t index = --positionIndex;
-                    vert.position = loadContext.positions.at(index);
-                    vert.color = loadContext.colors.at(index);
-                }
-                else
-                {
-                    REPORT_ERROR();
-                }
-
-                faceDescriptionStream.ignore(1);
-
-                int32_t textureCoordIndex;
-                if (faceDescriptionStream >> textureCoordIndex)
-                {
-                    vert.textureCoord = loadContext.textureCoords.at(--textureCoordIndex);
-                }
-                else
-                {
-                    REPORT_ERROR();
-                }
-
-                faceDescriptionStream.ignore(1);
-
-                int32_t normalIndex;
-                if (faceDescriptionStream >> normalIndex)
-                {
-                    vert.normal = loadContext.normals.at(--normalIndex);
-                }
-                else
-                {
-                    REPORT_ERROR();
-                }
-
-                vert.materialId = loadContext.currentMaterialId;
-                vertices.push_back(vert);
-            }
-
-            return true;
-        }
-
         bool Load(const std::string& fullFileName, std::vector<Material>& materials)
         {
             const char* TYPE_MATERIAL= "newmtl";
@@ -196,257 +158,391 @@ namespace Renderer
             REPORT_ERROR_IF_FALSE(file.is_open());
         }
 
-        bool Load(const std::string& fullFileName, Model& model)
+        // Whole file in one buffer, scanned token by token in place. Numbers are parsed with from_chars, without locales or copies.
+        struct TextReader
         {
-            const char* TYPE_VERTEX = "v";
-            const char* TYPE_NORMAL = "vn";
-            const char* TYPE_TEXTURE_COORDS = "vt";
-            const char* TYPE_FACE = "f";
-            const char* TYPE_MATERIAL_LIB = "mtllib";
-            const char* TYPE_MATERIAL = "usemtl";
+            const char* current = nullptr;
+            const char* end = nullptr;
 
-            Context loadContext;
+            void SkipSpaces()
+            {
+                while (current < end && (*current == ' ' || *current == '\t'))
+                {
+                    current++;
+                }
+            }
 
-            std::map<Vertex, uint32_t> vertexIndices;
+            void SkipLine()
+            {
+                const char* lineEnd = static_cast<const char*>(std::memchr(current, '\n', end - current));
+                current = lineEnd != nullptr ? lineEnd + 1 : end;
+            }
 
-            std::fstream file(fullFileName);
-            std::string line;
+            bool IsLineEnd() const
+            {
+                return current == end || *current == '\n' || *current == '\r';
+            }
 
-            while (std::getline(file, line))
+            // Characters up to the next space or line end, empty at the end of the line.
+            std::string_view ReadToken()
             {
-                std::stringstream lineStream(line);
-                std::string primitiveType;
-                if (lineStream >> primitiveType)
+                SkipSpaces();
+                const char* begin = current;
+                while (current < end && *current != ' ' && *current != '\t' && *current != '\n' && *current != '\r')
                 {
-                    if (primitiveType == TYPE_VERTEX)
-                    {
-                        Vec position;
-                        if (Read(lineStream, 3, 1.0f, position))
-                        {
-                            loadContext.positions.push_back(position);
+                    current++;
+                }
+                return std::string_view(begin, current - begin);
+            }
 
-                            Vec color;
-                            if (Read(lineStream, 3, 1.0f, color))
-                            {
-                                loadContext.colors.push_back(Color(color));
-                            }
-                            else
-                            {
-                                loadContext.colors.push_back(Color());
-                            }
-                        }
-                        else
-                        {
-                            REPORT_ERROR();
-                        }
-                    }
-                    else if (primitiveType == TYPE_NORMAL)
-                    {
-                        Vec normal;
-                        if (Read(lineStream, 3, 0.0f, normal))
-                        {
-                            loadContext.normals.push_back(normal);
-                        }
-                        else
-                        {
-                            REPORT_ERROR();
-                        }
-                    }
-                    else if (primitiveType == TYPE_TEXTURE_COORDS)
-                    {
-                        Vec uv;
-                        if (Read(lineStream, 2, 0.0f, uv))
-                        {
-                            loadContext.textureCoords.push_back(uv);
-                        }
-                        else
-                        {
-                            REPORT_ERROR();
-                        }
-                    }
-                    else if (primitiveType == TYPE_FACE)
-                    {
-                        std::vector<Vertex> vertices;
-                        if (Read(lineStream, loadContext, vertices))
-                        {
-                            for (const Vertex& vertex : vertices)
-                            {
-                                if (vertexIndices.count(vertex) == 0)
-                                {
-                                    model.vertices.push_back(vertex);
-                                    vertexIndices[vertex] = static_cast<uint32_t>(model.vertices.size()) - 1;
-                                }
+            template<typename T>
+            bool ReadNumber(T& value)
+            {
+                SkipSpaces();
+                // from_chars doesn't take the plus sign >> does
+                if (current < end && *current == '+')
+                {
+                    current++;
+                }
 
-                                model.indices.push_back(vertexIndices[vertex]);
-                            }
-                        }
-                        else
-                        {
-                            REPORT_ERROR();
-                        }
-                    }
-                    else if (primitiveType == TYPE_MATERIAL_LIB)
-                    {
-                        std::string materialFileName;
-                        if (lineStream >> materialFileName)
-                        {
-                            if (Load(ReplaceFileNameInFullPath(fullFileName, materialFileName), model.materials))
-                            {
-                                for (size_t i = 0; i < model.materials.size(); i++)
-                                {
-                                    loadContext.materials[model.materials[i].name] = static_cast<uint32_t>(i);
-                                }
-                            }
-                            else
-                            {
-                                REPORT_ERROR();
-                            }
-                        }
-                        else
-                        {
-                            REPORT_ERROR();
-                        }
-                    }
-                    else if (primitiveType == TYPE_MATERIAL)
-                    {
-                        std::string currentMaterial;
-                        if (lineStream >> currentMaterial)
-                        {
-                            loadContext.currentMaterialId = loadContext.materials.at(currentMaterial);
-                        }
-                        else
-                        {
-                            REPORT_ERROR();
-                        }
-                    }
+                std::from_chars_result result = std::from_chars(current, end, value);
+                if (result.ec != std::errc())
+                {
+                    return false;
+                }
+
+                current = result.ptr;
+                return true;
+            }
+        };
+
+        bool Read(TextReader& reader, uint32_t elements, float defaultVal, Vec& vec)
+        {
+            for (uint32_t currentIndex = 0; currentIndex < 4; currentIndex++)
+            {
+                float val = defaultVal;
+                if (currentIndex < elements && !reader.ReadNumber(val))
+                {
+                    // do not log error, can be optional, error will be logged further
+                    return false;
                 }
+
+                vec.Set(currentIndex, val);
             }
 
-            REPORT_ERROR_IF_FALSE(file.is_open());
+            return true;
         }
 
-        bool Load(const std::string& fullFileName, Light& light)
+        // Open addressing table of indices of entries kept by the caller, probed linearly over a power of two number of slots that is
+        // at most half full. Slots keep the hash next to the index, so most mismatches are skipped without touching the entries and
+        // growing doesn't need them.
+        struct HashIndex
         {
-            std::fstream file(fullFileName);
-            std::string line;
+            static constexpr uint32_t Empty = UINT32_MAX;
 
-            if (std::getline(file, line))
+            // Index of the first entry with the hash that equal accepts, Empty when there is none.
+            template<typename Equal>
+            uint32_t Find(uint64_t hash, Equal&& equal) const
             {
-                std::stringstream lineStream(line);
+                if (slots.empty())
+                {
+                    return Empty;
+                }
 
-                Vec params;
-                if (Read(lineStream, 3, 0.0f, params))
+                size_t mask = slots.size() - 1;
+                for (size_t slot = hash & mask; slots[slot].index != Empty; slot = (slot + 1) & mask)
                 {
-                    light.ambientStrength = params.x;
-                    light.specularStrength = params.y;
-                    light.specularShininess = params.z;
+                    if (slots[slot].hash == static_cast<uint32_t>(hash) && equal(slots[slot].index))
+                    {
+                        return slots[slot].index;
+                    }
                 }
-                else
+
+                return Empty;
+            }
+
+            // Like Find, but when there is no such entry the index is added and returned, in a single probe.
+            template<typename Equal>
+            uint32_t FindOrInsert(uint64_t hash, uint32_t index, Equal&& equal)
+            {
+                Reserve(count + 1);
+
+                size_t mask = slots.size() - 1;
+                size_t slot = hash & mask;
+                for (; slots[slot].index != Empty; slot = (slot + 1) & mask)
                 {
-                    REPORT_ERROR();
+                    if (slots[slot].hash == static_cast<uint32_t>(hash) && equal(slots[slot].index))
+                    {
+                        return slots[slot].index;
+                    }
                 }
+
+                slots[slot] = { static_cast<uint32_t>(hash), index };
+                count++;
+                return index;
             }
-            else
+
+            // Entries with the same hash, equal or not, are all kept.
+            void Insert(uint64_t hash, uint32_t index)
             {
-                REPORT_ERROR();
+                FindOrInsert(hash, index, [](uint32_t) { return false; });
             }
 
-            if (std::getline(file, line))
+        private:
+            struct Slot
             {
-                std::stringstream lineStream(line);
+                uint32_t hash = 0;
+                uint32_t index = Empty;
+            };
 
-                Vec color;
-                if (Read(lineStream, 3, 1.0f, color))
+            void Reserve(size_t entries)
+            {
+                if (entries * 2 <= slots.size())
                 {
-                    light.color = Color(color);
+                    return;
                 }
-                else
+
+                std::vector<Slot> previous(std::max<size_t>(std::bit_ceil(entries * 2), 64));
+                previous.swap(slots);
+
+                size_t mask = slots.size() - 1;
+                for (const Slot& entry : previous)
                 {
-                    REPORT_ERROR();
+                    if (entry.index != Empty)
+                    {
+                        size_t slot = entry.hash & mask;
+                        while (slots[slot].index != Empty)
+                        {
+                            slot = (slot + 1) & mask;
+                        }
+                        slots[slot] = entry;
+                    }
                 }
             }
-            else
-            {
-                REPORT_ERROR();
-            }
 
-            REPORT_ERROR_IF_FALSE(file.is_open());
+            std::vector<Slot> slots;
+            size_t count = 0;
+        };
+
+        uint64_t Mix(uint64_t value)
+        {
+            // splitmix64 finalizer, every input bit reaches the low bits the slot is picked from
+            value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+            value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+            return value ^ (value >> 31);
         }
 
-        bool Load(const std::string& fullFileName, Camera& camera)
+        // What a face corner refers to, equal corners are the same vertex.
+        struct CornerKey
         {
-            std::fstream file(fullFileName);
-            std::string line;
+            uint32_t position = 0;
+            uint32_t textureCoord = 0;
+            uint32_t normal = 0;
+            int32_t materialId = -1;
 
-            if (std::getline(file, line))
+            bool operator==(const CornerKey&) const = default;
+        };
+
+        uint64_t Hash(const CornerKey& key)
+        {
+            return Mix((static_cast<uint64_t>(key.position) << 32 | key.textureCoord) ^ Mix(static_cast<uint64_t>(key.normal) << 32 | static_cast<uint32_t>(key.materialId)));
+        }
+
+        bool IsClose(const Vec& lhs, const Vec& rhs, float tolerance)
+        {
+            return std::abs(lhs.x - rhs.x) <= tolerance && std::abs(lhs.y - rhs.y) <= tolerance &&
+                std::abs(lhs.z - rhs.z) <= tolerance && std::abs(lhs.w - rhs.w) <= tolerance;
+        }
+
+        // Merges vertices of a material whose positions, normals, texture coordinates and colors differ by at most tolerance
+        // in every component into the first of them. Vertices are looked up in a grid of tolerance sized cells, so only the
+        // neighbouring cells are searched, with no tolerance the cells are the positions themselves.
+        void Weld(float tolerance, Model& model)
+        {
+            using Cell = std::array<int64_t, 3>;
+            auto getCell = [tolerance](const Vec& position) {
+                if (tolerance > 0.0f)
+                {
+                    return Cell{ static_cast<int64_t>(std::floor(position.x / tolerance)), static_cast<int64_t>(std::floor(position.y / tolerance)),
+                        static_cast<int64_t>(std::floor(position.z / tolerance)) };
+                }
+
+                // adding zero turns -0 into 0, they compare equal
+                return Cell{ std::bit_cast<int32_t>(position.x + 0.0f), std::bit_cast<int32_t>(position.y + 0.0f), std::bit_cast<int32_t>(position.z + 0.0f) };
+            };
+            auto hashCell = [](const Cell& cell) {
+                return Mix(static_cast<uint64_t>(cell[0]) ^ Mix(static_cast<uint64_t>(cell[1]) ^ Mix(static_cast<uint64_t>(cell[2]))));
+            };
+            int64_t range = tolerance > 0.0f ? 1 : 0;
+
+            std::vector<Vertex> welded;
+            std::vector<Cell> weldedCells;
+            std::vector<uint32_t> remap(model.vertices.size());
+            HashIndex cells;
+            for (size_t i = 0; i < model.vertices.size(); i++)
             {
-                std::stringstream lineStream(line);
+                const Vertex& vertex = model.vertices[i];
+                Cell cell = getCell(vertex.position);
 
-                Vec rotation;
-                if (Read(lineStream, 2, 0.0f, rotation))
+                uint32_t match = HashIndex::Empty;
+                for (int64_t z = -range; z <= range; z++)
                 {
-                    camera.pitch = rotation.x;
-                    camera.yaw = rotation.y;
+                    for (int64_t y = -range; y <= range; y++)
+                    {
+                        for (int64_t x = -range; x <= range; x++)
+                        {
+                            Cell neighbour{ cell[0] + x, cell[1] + y, cell[2] + z };
+                            cells.Find(hashCell(neighbour), [&](uint32_t candidate) {
+                                const Vertex& other = welded[candidate];
+                                if (candidate < match && weldedCells[candidate] == neighbour && other.materialId == vertex.materialId &&
+                                    IsClose(other.position, vertex.position, tolerance) && IsClose(other.normal, vertex.normal, tolerance) &&
+                                    IsClose(other.textureCoord, vertex.textureCoord, tolerance) && IsClose(other.color.rgba_vec, vertex.color.rgba_vec, tolerance))
+                                {
+                                    match = candidate;
+                                }
+                                // keep looking for an earlier vertex
+                                return false;
+                            });
+                        }
+                    }
                 }
-                else
+
+                if (match == HashIndex::Empty)
                 {
-                    REPORT_ERROR();
+                    match = static_cast<uint32_t>(welded.size());
+                    cells.Insert(hashCell(cell), match);
+                    welded.push_back(vertex);
+                    weldedCells.push_back(cell);
                 }
+
+                remap[i] = match;
             }
 
-            REPORT_ERROR_IF_FALSE(file.is_open());
+            for (uint32_t& index : model.indices)
+            {
+                index = remap[index];
+            }
+            model.vertices = std::move(welded);
         }
-    }
 
-    bool operator<(const Vertex& lhs, const Vertex& rhs)
-    {
-        return std::tie(lhs.materialId, lhs.color.rgba_vec, lhs.normal, lhs.position, lhs.textureCoord) <
-            std::tie(rhs.materialId, rhs.color.rgba_vec, rhs.normal, rhs.position, rhs.textureCoord);
-    }
+        // Records of a run of whole lines, parsed on its own. Faces keep their indices as written along with the number of elements
+        // read before them in the chunk, they are resolved in the merge once the elements of the chunks before are known.
+        struct ObjChunk
+        {
+            struct Corner
+            {
+                int64_t position = 0;
+                int64_t textureCoord = 0;
+                int64_t normal = 0;
+            };
 
-    bool operator==(const Vertex& lhs, const Vertex& rhs)
-    {
-        return !(lhs < rhs) && !(rhs < lhs);
-    }
+            struct Face
+            {
+                size_t cornerCount = 0;
+                size_t positionCount = 0;
+                size_t textureCoordCount = 0;
+                size_t normalCount = 0;
+            };
+
+            // mtllib and usemtl lines, applied before the face they precede
+            struct Directive
+            {
+                size_t face = 0;
+                bool library = false;
+                std::string name;
+            };
 
-    bool Load(const std::string& fullFileName, Scene& scene)
-    {
-        const char* EXTENSION_MODEL = "obj";
-        const char* EXTENSION_LIGHT = "lig";
-        const char* EXTENSION_CAMERA = "cam";
+            const char* begin = nullptr;
+            const char* end = nullptr;
+
+            std::vector<Vec> positions;
+            std::vector<Color> colors;
+            std::vector<Vec> textureCoords;
+            std::vector<Vec> normals;
+            std::vector<Corner> corners;
+            std::vector<Face> faces;
+            std::vector<Directive> directives;
+
+            // elements of the chunks before
+            size_t positionBase = 0;
+            size_t textureCoordBase = 0;
+            size_t normalBase = 0;
+        };
+
+        // One based index into the count elements read so far, negative ones count back from the last element.
+        bool ResolveIndex(int64_t value, size_t count, size_t& index)
+        {
+            value = value < 0 ? static_cast<int64_t>(count) + value : value - 1;
+            if (value < 0 || value >= static_cast<int64_t>(count))
+            {
+                return false;
+            }
 
-        scene.name = GetSceneName(fullFileName);
+            index = static_cast<size_t>(value);
+            return true;
+        }
 
-        std::fstream file(fullFileName);
-        std::string line;
+        bool ReadSeparator(TextReader& reader)
+        {
+            return reader.current < reader.end && *reader.current++ == '/';
+        }
 
-        while (std::getline(file, line))
+        // Every vertex of a face is position/texture coordinates/normal.
+        bool ReadFace(TextReader& reader, ObjChunk& chunk)
         {
-            std::stringstream lineStream(line);
+            ObjChunk::Face face;
+            face.positionCount = chunk.positions.size();
+            face.textureCoordCount = chunk.textureCoords.size();
+            face.normalCount = chunk.normals.size();
 
-            std::string fileName;
-            if (lineStream >> fileName)
+            reader.SkipSpaces();
+            while (!reader.IsLineEnd())
             {
-                std::string extension = GetFileExtension(fileName);
+                ObjChunk::Corner corner;
+                if (!reader.ReadNumber(corner.position) ||
+                    !ReadSeparator(reader) || !reader.ReadNumber(corner.textureCoord) ||
+                    !ReadSeparator(reader) || !reader.ReadNumber(corner.normal))
+                {
+                    REPORT_ERROR();
+                }
+
+                chunk.corners.push_back(corner);
+                face.cornerCount++;
+                reader.SkipSpaces();
+            }
+
+            chunk.faces.push_back(face);
+            return true;
+        }
 
-                if (extension == EXTENSION_MODEL)
+        bool Parse(ObjChunk& chunk)
+        {
+            constexpr std::string_view TYPE_VERTEX = "v";
+            constexpr std::string_view TYPE_NORMAL = "vn";
+            constexpr std::string_view TYPE_TEXTURE_COORDS = "vt";
+            constexpr std::string_view TYPE_FACE = "f";
+            constexpr std::string_view TYPE_MATERIAL_LIB = "mtllib";
+            constexpr std::string_view TYPE_MATERIAL = "usemtl";
+
+            TextReader reader{ chunk.begin, chunk.end };
+            for (; reader.current < reader.end; reader.SkipLine())
+            {
+                std::string_view primitiveType = reader.ReadToken();
+                if (primitiveType == TYPE_VERTEX)
                 {
-                    Model model;
-                    if (Read(lineStream, 3, 1.0f, model.position))
+                    Vec position;
+                    if (Read(reader, 3, 1.0f, position))
                     {
-                        if (Load(ReplaceFileNameInFullPath(fullFileName, fileName), model))
-                        {
-                            std::string culling;
-                            if (lineStream >> culling)
-                            {
-                                model.backfaceCulling = culling != "culling_off";
-                            }
+                        chunk.positions.push_back(position);
 
-                            scene.models.push_back(std::move(model));
+                        Vec color;
+                        if (Read(reader, 3, 1.0f, color))
+                        {
+                            chunk.colors.push_back(Color(color));
                         }
                         else
                         {
-                            REPORT_ERROR();
+                            chunk.colors.push_back(Color());
                         }
                     }
                     else
@@ -454,44 +550,1567 @@ namespace Renderer
                         REPORT_ERROR();
                     }
                 }
-                else if (extension == EXTENSION_CAMERA)
+                else if (primitiveType == TYPE_NORMAL)
                 {
-                    if (Read(lineStream, 3, 1.0f, scene.camera.position))
+                    Vec normal;
+                    if (Read(reader, 3, 0.0f, normal))
                     {
-                        if (!Load(ReplaceFileNameInFullPath(fullFileName, fileName), scene.camera))
-                        {
-                            REPORT_ERROR();
-                        }
+                        chunk.normals.push_back(normal);
+                    }
+                    else
+                    {
+                        REPORT_ERROR();
+                    }
+                }
+                else if (primitiveType == TYPE_TEXTURE_COORDS)
+                {
+                    Vec uv;
+                    if (Read(reader, 2, 0.0f, uv))
+                    {
+                        chunk.textureCoords.push_back(uv);
                     }
                     else
                     {
                         REPORT_ERROR();
                     }
                 }
-                else if (extension == EXTENSION_LIGHT)
+                else if (primitiveType == TYPE_FACE)
+                {
+                    if (!ReadFace(reader, chunk))
+                    {
+                        REPORT_ERROR();
+                    }
+                }
+                else if (primitiveType == TYPE_MATERIAL_LIB || primitiveType == TYPE_MATERIAL)
+                {
+                    std::string_view name = reader.ReadToken();
+                    if (name.empty())
+                    {
+                        REPORT_ERROR();
+                    }
+
+                    chunk.directives.push_back({ chunk.faces.size(), primitiveType == TYPE_MATERIAL_LIB, std::string(name) });
+                }
+            }
+
+            return true;
+        }
+
+        // Splits the buffer into chunks of whole lines, about one per MinChunkSize bytes and a few per core, so they balance out.
+        std::vector<ObjChunk> SplitLines(const std::vector<char>& buffer)
+        {
+            constexpr size_t MinChunkSize = 256 * 1024;
+            size_t maxChunkCount = std::max<size_t>(std::thread::hardware_concurrency(), 1) * 4;
+            size_t chunkCount = std::clamp<size_t>(buffer.size() / MinChunkSize, 1, maxChunkCount);
+
+            std::vector<ObjChunk> chunks(chunkCount);
+            const char* end = buffer.data() + buffer.size();
+            const char* begin = buffer.data();
+            for (size_t i = 0; i < chunkCount; i++)
+            {
+                const char* split = i + 1 < chunkCount ? std::max(begin, buffer.data() + buffer.size() * (i + 1) / chunkCount) : end;
+                const char* lineEnd = static_cast<const char*>(std::memchr(split, '\n', end - split));
+
+                chunks[i].begin = begin;
+                chunks[i].end = lineEnd != nullptr ? lineEnd + 1 : end;
+                begin = chunks[i].end;
+            }
+
+            return chunks;
+        }
+
+        bool Load(const std::string& fullFileName, float weldTolerance, Model& model, std::vector<std::string>& sources)
+        {
+            std::ifstream file(fullFileName, std::ios::binary | std::ios::ate);
+            if (!file.is_open())
+            {
+                REPORT_ERROR();
+            }
+
+            std::vector<char> buffer(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            if (!file.read(buffer.data(), buffer.size()))
+            {
+                REPORT_ERROR();
+            }
+
+            std::vector<ObjChunk> chunks = SplitLines(buffer);
+
+            std::atomic<bool> parsed = true;
+            std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&parsed](ObjChunk& chunk) {
+                if (!Parse(chunk))
+                {
+                    parsed = false;
+                }
+            });
+
+            if (!parsed)
+            {
+                REPORT_ERROR();
+            }
+
+            Context loadContext;
+            for (ObjChunk& chunk : chunks)
+            {
+                chunk.positionBase = loadContext.positions.size();
+                chunk.textureCoordBase = loadContext.textureCoords.size();
+                chunk.normalBase = loadContext.normals.size();
+
+                loadContext.positions.insert(loadContext.positions.end(), chunk.positions.begin(), chunk.positions.end());
+                loadContext.colors.insert(loadContext.colors.end(), chunk.colors.begin(), chunk.colors.end());
+                loadContext.textureCoords.insert(loadContext.textureCoords.end(), chunk.textureCoords.begin(), chunk.textureCoords.end());
+                loadContext.normals.insert(loadContext.normals.end(), chunk.normals.begin(), chunk.normals.end());
+            }
+
+            // faces and materials in file order, so vertices are numbered as they first appear like a single pass would,
+            // corners are told apart by the elements they refer to and only the first of each is expanded into a vertex
+            std::vector<CornerKey> keys;
+            HashIndex vertexIndices;
+            for (const ObjChunk& chunk : chunks)
+            {
+                const ObjChunk::Corner* corner = chunk.corners.data();
+                auto directive = chunk.directives.begin();
+                for (size_t face = 0; face <= chunk.faces.size(); face++)
                 {
-                    if (Read(lineStream, 3, 1.0f, scene.light.position))
+                    for (; directive != chunk.directives.end() && directive->face == face; directive++)
+                    {
+                        if (directive->library)
+                        {
+                            sources.push_back(ReplaceFileNameInFullPath(fullFileName, directive->name));
+                            if (!Load(sources.back(), model.materials))
+                            {
+                                REPORT_ERROR();
+                            }
+
+                            for (size_t i = 0; i < model.materials.size(); i++)
+                            {
+                                loadContext.materials[model.materials[i].name] = static_cast<uint32_t>(i);
+                            }
+                        }
+                        else
+                        {
+                            auto material = loadContext.materials.find(directive->name);
+                            if (material == loadContext.materials.end())
+                            {
+                                REPORT_ERROR();
+                            }
+
+                            loadContext.currentMaterialId = material->second;
+                        }
+                    }
+
+                    if (face == chunk.faces.size())
+                    {
+                        break;
+                    }
+
+                    const ObjChunk::Face& counts = chunk.faces[face];
+                    for (size_t i = 0; i < counts.cornerCount; i++, corner++)
                     {
-                        if (!Load(ReplaceFileNameInFullPath(fullFileName, fileName), scene.light))
+                        size_t positionIndex = 0;
+                        size_t textureCoordIndex = 0;
+                        size_t normalIndex = 0;
+                        if (!ResolveIndex(corner->position, chunk.positionBase + counts.positionCount, positionIndex) ||
+                            !ResolveIndex(corner->textureCoord, chunk.textureCoordBase + counts.textureCoordCount, textureCoordIndex) ||
+                            !ResolveIndex(corner->normal, chunk.normalBase + counts.normalCount, normalIndex))
                         {
                             REPORT_ERROR();
                         }
+
+                        CornerKey key{ static_cast<uint32_t>(positionIndex), static_cast<uint32_t>(textureCoordIndex), static_cast<uint32_t>(normalIndex),
+                            loadContext.currentMaterialId };
+                        uint32_t index = vertexIndices.FindOrInsert(Hash(key), static_cast<uint32_t>(keys.size()), [&keys, &key](uint32_t other) {
+                            return keys[other] == key;
+                        });
+
+                        if (index == keys.size())
+                        {
+                            keys.push_back(key);
+
+                            Vertex vertex;
+                            vertex.position = loadContext.positions[positionIndex];
+                            vertex.color = loadContext.colors[positionIndex];
+                            vertex.textureCoord = loadContext.textureCoords[textureCoordIndex];
+                            vertex.normal = loadContext.normals[normalIndex];
+                            vertex.materialId = loadContext.currentMaterialId;
+                            model.vertices.push_back(vertex);
+                        }
+
+                        model.indices.push_back(index);
                     }
-                    else
+                }
+            }
+
+            if (weldTolerance >= 0.0f)
+            {
+                Weld(weldTolerance, model);
+            }
+
+            return true;
+        }
+
+        // Just enough JSON for glTF: the document is parsed into a tree of values, objects keep their keys in order.
+        struct JsonValue
+        {
+            enum class Type
+            {
+                Null,
+                Bool,
+                Number,
+                String,
+                Array,
+                Object
+            };
+
+            Type type = Type::Null;
+            double number = 0.0;
+            std::string string;
+            // elements of an array or values of an object
+            std::vector<JsonValue> elements;
+            std::vector<std::string> keys;
+
+            const JsonValue* Find(std::string_view key) const
+            {
+                for (size_t i = 0; i < keys.size(); i++)
+                {
+                    if (keys[i] == key)
                     {
-                        REPORT_ERROR();
+                        return &elements[i];
                     }
                 }
+                return nullptr;
             }
-            else
+
+            // Element of an array member, nullptr when either is missing.
+            const JsonValue* Find(std::string_view key, size_t index) const
+            {
+                const JsonValue* value = Find(key);
+                return value != nullptr && value->type == Type::Array && index < value->elements.size() ? &value->elements[index] : nullptr;
+            }
+
+            double GetNumber(std::string_view key, double defaultValue) const
+            {
+                const JsonValue* value = Find(key);
+                return value != nullptr && value->type == Type::Number ? value->number : defaultValue;
+            }
+
+            // Non negative integer, SIZE_MAX when the value isn't one.
+            size_t GetIndex() const
+            {
+                return type == Type::Number && number >= 0.0 && number < 4294967296.0 && number == std::floor(number) ? static_cast<size_t>(number) : SIZE_MAX;
+            }
+
+            // Non negative integer member, SIZE_MAX when it is missing or isn't one.
+            size_t GetIndex(std::string_view key) const
+            {
+                const JsonValue* value = Find(key);
+                return value != nullptr ? value->GetIndex() : SIZE_MAX;
+            }
+
+            std::string_view GetString(std::string_view key) const
+            {
+                const JsonValue* value = Find(key);
+                return value != nullptr && value->type == Type::String ? std::string_view(value->string) : std::string_view();
+            }
+        };
+
+        struct JsonReader
+        {
+            // nesting of glTF documents is shallow, this only keeps hostile files from running out of stack
+            static constexpr size_t MaxDepth = 64;
+
+            const char* current = nullptr;
+            const char* end = nullptr;
+
+            void SkipSpaces()
+            {
+                while (current < end && (*current == ' ' || *current == '\t' || *current == '\n' || *current == '\r'))
+                {
+                    current++;
+                }
+            }
+
+            bool Expect(char character)
+            {
+                SkipSpaces();
+                if (current < end && *current == character)
+                {
+                    current++;
+                    return true;
+                }
+                return false;
+            }
+
+            bool ExpectWord(std::string_view word)
+            {
+                if (static_cast<size_t>(end - current) < word.size() || std::string_view(current, word.size()) != word)
+                {
+                    return false;
+                }
+
+                current += word.size();
+                return true;
+            }
+
+            bool ReadString(std::string& value)
+            {
+                if (!Expect('"'))
+                {
+                    return false;
+                }
+
+                value.clear();
+                while (current < end && *current != '"')
+                {
+                    char character = *current++;
+                    if (character != '\\')
+                    {
+                        value.push_back(character);
+                        continue;
+                    }
+
+                    if (current == end)
+                    {
+                        return false;
+                    }
+
+                    character = *current++;
+                    switch (character)
+                    {
+                    case 'b': value.push_back('\b'); break;
+                    case 'f': value.push_back('\f'); break;
+                    case 'n': value.push_back('\n'); break;
+                    case 'r': value.push_back('\r'); break;
+                    case 't': value.push_back('\t'); break;
+                    case 'u':
+                    {
+                        uint32_t code = 0;
+                        if (end - current < 4 || std::from_chars(current, current + 4, code, 16).ptr != current + 4)
+                        {
+                            return false;
+                        }
+                        current += 4;
+
+                        // UTF-8, surrogate pairs are kept as two code points
+                        if (code < 0x80)
+                        {
+                            value.push_back(static_cast<char>(code));
+                        }
+                        else if (code < 0x800)
+                        {
+                            value.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                            value.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                        }
+                        else
+                        {
+                            value.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                            value.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                            value.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+                        }
+                        break;
+                    }
+                    default: value.push_back(character); break;
+                    }
+                }
+
+                return Expect('"');
+            }
+
+            bool Read(JsonValue& value, size_t depth = 0)
+            {
+                SkipSpaces();
+                if (current == end || depth > MaxDepth)
+                {
+                    return false;
+                }
+
+                switch (*current)
+                {
+                case '{':
+                    value.type = JsonValue::Type::Object;
+                    current++;
+                    if (Expect('}'))
+                    {
+                        return true;
+                    }
+
+                    do
+                    {
+                        value.keys.emplace_back();
+                        value.elements.emplace_back();
+                        if (!ReadString(value.keys.back()) || !Expect(':') || !Read(value.elements.back(), depth + 1))
+                        {
+                            return false;
+                        }
+                    } while (Expect(','));
+                    return Expect('}');
+                case '[':
+                    value.type = JsonValue::Type::Array;
+                    current++;
+                    if (Expect(']'))
+                    {
+                        return true;
+                    }
+
+                    do
+                    {
+                        value.elements.emplace_back();
+                        if (!Read(value.elements.back(), depth + 1))
+                        {
+                            return false;
+                        }
+                    } while (Expect(','));
+                    return Expect(']');
+                case '"':
+                    value.type = JsonValue::Type::String;
+                    return ReadString(value.string);
+                case 't':
+                case 'f':
+                    value.type = JsonValue::Type::Bool;
+                    value.number = *current == 't' ? 1.0 : 0.0;
+                    return ExpectWord(*current == 't' ? "true" : "false");
+                case 'n':
+                    return ExpectWord("null");
+                default:
+                {
+                    value.type = JsonValue::Type::Number;
+                    std::from_chars_result result = std::from_chars(current, end, value.number);
+                    current = result.ptr;
+                    return result.ec == std::errc();
+                }
+                }
+            }
+        };
+
+        // glTF 2.0 binary: a 12 byte header, then a JSON chunk and an optional binary chunk, both 4 byte aligned.
+        // Only the binary chunk is read as buffer data, buffers in other files are not supported.
+        struct BinaryGltf
+        {
+            static constexpr uint32_t Magic = 0x46546C67; // "glTF"
+            static constexpr uint32_t ChunkJson = 0x4E4F534A; // "JSON"
+            static constexpr uint32_t ChunkBinary = 0x004E4942; // "BIN\0"
+
+            JsonValue document;
+            std::vector<uint8_t> binaryChunk;
+            // nullptr when the binary chunk wasn't read
+            const uint8_t* binary = nullptr;
+            size_t binarySize = 0;
+            // where the binary chunk starts in the file
+            size_t binaryOffset = 0;
+
+            // Offset of a buffer view in the binary chunk, false when it isn't within the chunk.
+            bool GetBufferViewRange(size_t index, size_t& offset, size_t& size, size_t& stride) const
+            {
+                const JsonValue* view = document.Find("bufferViews", index);
+                if (view == nullptr || view->GetIndex("buffer") != 0)
+                {
+                    return false;
+                }
+
+                const JsonValue* buffer = document.Find("buffers", 0);
+                offset = view->GetIndex("byteOffset") == SIZE_MAX ? 0 : view->GetIndex("byteOffset");
+                size = view->GetIndex("byteLength");
+                stride = view->GetIndex("byteStride") == SIZE_MAX ? 0 : view->GetIndex("byteStride");
+                return buffer != nullptr && buffer->Find("uri") == nullptr && binaryOffset != 0 && size != SIZE_MAX && offset <= binarySize && size <= binarySize - offset;
+            }
+
+            // Bytes of a buffer view, false when it isn't within the binary chunk or the chunk wasn't read.
+            bool GetBufferView(size_t index, const uint8_t*& data, size_t& size, size_t& stride) const
+            {
+                size_t offset = 0;
+                if (binary == nullptr || !GetBufferViewRange(index, offset, size, stride))
+                {
+                    return false;
+                }
+
+                data = binary + offset;
+                return true;
+            }
+
+            // Calls write(element, components) for every element of an accessor, with at least four components and the missing ones 0.
+            // Normalized integers become floats in 0..1 or -1..1, the rest are converted as they are.
+            template<typename Value, typename Write>
+            bool ReadAccessor(size_t index, size_t minComponents, Write&& write) const
+            {
+                const JsonValue* accessor = document.Find("accessors", index);
+                if (accessor == nullptr || accessor->Find("sparse") != nullptr)
+                {
+                    return false;
+                }
+
+                std::string_view type = accessor->GetString("type");
+                size_t components = type == "SCALAR" ? 1 : type == "VEC2" ? 2 : type == "VEC3" ? 3 : type == "VEC4" ? 4 : 0;
+                size_t componentType = accessor->GetIndex("componentType");
+                size_t componentSize = componentType == 5120 || componentType == 5121 ? 1 : componentType == 5122 || componentType == 5123 ? 2 :
+                    componentType == 5125 || componentType == 5126 ? 4 : 0;
+                size_t count = accessor->GetIndex("count");
+                const JsonValue* normalizedValue = accessor->Find("normalized");
+                bool normalized = normalizedValue != nullptr && normalizedValue->number != 0.0;
+
+                const uint8_t* data = nullptr;
+                size_t size = 0;
+                size_t stride = 0;
+                size_t offset = accessor->GetIndex("byteOffset") == SIZE_MAX ? 0 : accessor->GetIndex("byteOffset");
+                if (components < minComponents || componentSize == 0 || count == SIZE_MAX || !GetBufferView(accessor->GetIndex("bufferView"), data, size, stride))
+                {
+                    return false;
+                }
+
+                size_t elementSize = components * componentSize;
+                stride = stride != 0 ? stride : elementSize;
+                if (count > 0 && (offset > size || elementSize > size - offset || (count - 1) > (size - offset - elementSize) / stride))
+                {
+                    return false;
+                }
+
+                for (size_t element = 0; element < count; element++)
+                {
+                    const uint8_t* source = data + offset + element * stride;
+                    Value values[4] = {};
+                    for (size_t component = 0; component < components; component++, source += componentSize)
+                    {
+                        switch (componentType)
+                        {
+                        case 5120: values[component] = ConvertComponent<Value, int8_t>(source, normalized); break;
+                        case 5121: values[component] = ConvertComponent<Value, uint8_t>(source, normalized); break;
+                        case 5122: values[component] = ConvertComponent<Value, int16_t>(source, normalized); break;
+                        case 5123: values[component] = ConvertComponent<Value, uint16_t>(source, normalized); break;
+                        case 5125: values[component] = ConvertComponent<Value, uint32_t>(source, normalized); break;
+                        default: values[component] = ConvertComponent<Value, float>(source, normalized); break;
+                        }
+                    }
+                    write(element, values);
+                }
+
+                return true;
+            }
+
+            template<typename Value, typename Component>
+            static Value ConvertComponent(const uint8_t* source, bool normalized)
+            {
+                Component component;
+                std::memcpy(&component, source, sizeof(Component));
+                if constexpr (std::is_integral_v<Component> && std::is_floating_point_v<Value>)
+                {
+                    if (normalized)
+                    {
+                        return std::max(static_cast<Value>(component) / std::numeric_limits<Component>::max(), Value(-1));
+                    }
+                }
+                return static_cast<Value>(component);
+            }
+
+            size_t GetCount(size_t accessor) const
+            {
+                const JsonValue* value = document.Find("accessors", accessor);
+                return value != nullptr ? value->GetIndex("count") : SIZE_MAX;
+            }
+        };
+
+        // Reads the document and the binary chunk, without readBinary only where the binary chunk is.
+        bool Open(const std::string& fullFileName, BinaryGltf& gltf, bool readBinary = true)
+        {
+            std::ifstream file(fullFileName, std::ios::binary | std::ios::ate);
+            if (!file.is_open())
+            {
+                REPORT_ERROR();
+            }
+
+            size_t fileSize = static_cast<size_t>(file.tellg());
+            file.seekg(0);
+
+            uint32_t header[3] = {};
+            if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != BinaryGltf::Magic || header[1] != 2 || header[2] > fileSize)
             {
                 REPORT_ERROR();
             }
 
+            bool hasDocument = false;
+            for (size_t offset = sizeof(header); offset + 8 <= header[2];)
+            {
+                uint32_t chunk[2] = {};
+                file.seekg(offset);
+                if (!file.read(reinterpret_cast<char*>(chunk), sizeof(chunk)))
+                {
+                    REPORT_ERROR();
+                }
+
+                offset += sizeof(chunk);
+                if (chunk[0] > header[2] - offset)
+                {
+                    REPORT_ERROR();
+                }
+
+                if (chunk[1] == BinaryGltf::ChunkJson && !hasDocument)
+                {
+                    std::vector<char> json(chunk[0]);
+                    if (!file.read(json.data(), json.size()))
+                    {
+                        REPORT_ERROR();
+                    }
 
+                    JsonReader reader{ json.data(), json.data() + json.size() };
+                    if (!reader.Read(gltf.document) || gltf.document.type != JsonValue::Type::Object)
+                    {
+                        REPORT_ERROR();
+                    }
+                    hasDocument = true;
+                }
+                else if (chunk[1] == BinaryGltf::ChunkBinary && gltf.binaryOffset == 0)
+                {
+                    gltf.binaryOffset = offset;
+                    gltf.binarySize = chunk[0];
+                    if (readBinary)
+                    {
+                        gltf.binaryChunk.resize(chunk[0]);
+                        if (!file.read(reinterpret_cast<char*>(gltf.binaryChunk.data()), gltf.binaryChunk.size()))
+                        {
+                            REPORT_ERROR();
+                        }
+                        gltf.binary = gltf.binaryChunk.data();
+                    }
+                }
+
+                offset += (chunk[0] + 3) / 4 * 4;
+            }
+
+            REPORT_ERROR_IF_FALSE(hasDocument);
+        }
+
+        // Row major like the rest of Matrix, glTF stores column major matrices and rotations as x, y, z, w quaternions.
+        Matrix GetNodeTransform(const JsonValue& node)
+        {
+            Matrix transform;
+            if (const JsonValue* matrix = node.Find("matrix"); matrix != nullptr && matrix->elements.size() == 16)
+            {
+                for (size_t i = 0; i < 16; i++)
+                {
+                    transform.m[(i % 4) * 4 + i / 4] = static_cast<float>(matrix->elements[i].number);
+                }
+                return transform;
+            }
+
+            auto get = [&node](std::string_view key, size_t index, float defaultValue) {
+                const JsonValue* value = node.Find(key, index);
+                return value != nullptr ? static_cast<float>(value->number) : defaultValue;
+            };
+
+            float x = get("rotation", 0, 0.0f);
+            float y = get("rotation", 1, 0.0f);
+            float z = get("rotation", 2, 0.0f);
+            float w = get("rotation", 3, 1.0f);
+            float rotation[9] = {
+                1 - 2 * (y * y + z * z), 2 * (x * y - z * w), 2 * (x * z + y * w),
+                2 * (x * y + z * w), 1 - 2 * (x * x + z * z), 2 * (y * z - x * w),
+                2 * (x * z - y * w), 2 * (y * z + x * w), 1 - 2 * (x * x + y * y)
+            };
+
+            for (size_t row = 0; row < 3; row++)
+            {
+                for (size_t column = 0; column < 3; column++)
+                {
+                    transform.m[row * 4 + column] = rotation[row * 3 + column] * get("scale", column, 1.0f);
+                }
+                transform.m[row * 4 + 3] = get("translation", row, 0.0f);
+            }
+            transform.m[15] = 1.0f;
+            return transform;
+        }
+
+        // Materials with a base color texture become materials of the model, their image either embedded or in a file next to the model.
+        // Others, and those whose image can't be found, leave their vertices without a material, colored by the base color factor.
+        void LoadMaterials(const std::string& fullFileName, const BinaryGltf& gltf, Model& model, std::vector<int32_t>& materialIds, std::vector<Vec>& baseColors)
+        {
+            const JsonValue* materials = gltf.document.Find("materials");
+            size_t materialCount = materials != nullptr ? materials->elements.size() : 0;
+            materialIds.assign(materialCount, -1);
+            baseColors.assign(materialCount, Vec{ 1.0f, 1.0f, 1.0f, 1.0f });
+
+            for (size_t i = 0; i < materialCount; i++)
+            {
+                const JsonValue& material = materials->elements[i];
+                const JsonValue* pbr = material.Find("pbrMetallicRoughness");
+                if (pbr == nullptr)
+                {
+                    continue;
+                }
+
+                for (int32_t component = 0; component < 4; component++)
+                {
+                    if (const JsonValue* factor = pbr->Find("baseColorFactor", component))
+                    {
+                        baseColors[i].Set(component, static_cast<float>(factor->number));
+                    }
+                }
+
+                const JsonValue* baseColorTexture = pbr->Find("baseColorTexture");
+                const JsonValue* texture = baseColorTexture != nullptr ? gltf.document.Find("textures", baseColorTexture->GetIndex("index")) : nullptr;
+                size_t imageIndex = texture != nullptr ? texture->GetIndex("source") : SIZE_MAX;
+                const JsonValue* image = gltf.document.Find("images", imageIndex);
+                if (image == nullptr)
+                {
+                    continue;
+                }
+
+                std::string textureName;
+                std::string_view uri = image->GetString("uri");
+                const uint8_t* data = nullptr;
+                size_t size = 0;
+                size_t stride = 0;
+                if (!uri.empty() && !uri.starts_with("data:"))
+                {
+                    textureName = ReplaceFileNameInFullPath(fullFileName, std::string(uri));
+                }
+                else if (gltf.GetBufferView(image->GetIndex("bufferView"), data, size, stride))
+                {
+                    // decoded from the model when a renderer loads it, see ReadEmbeddedImage
+                    textureName = fullFileName + EmbeddedImageMarker + std::to_string(imageIndex);
+                }
+                else
+                {
+                    LOG("Image " << imageIndex << " is not supported.");
+                    continue;
+                }
+
+                materialIds[i] = static_cast<int32_t>(model.materials.size());
+                std::string name(material.GetString("name"));
+                model.materials.push_back({ name.empty() ? "material_" + std::to_string(i) : name, textureName });
+            }
+        }
+
+        bool AddPrimitive(const BinaryGltf& gltf, const JsonValue& primitive, const Matrix& transform, const std::vector<int32_t>& materialIds,
+            const std::vector<Vec>& baseColors, Model& model)
+        {
+            // points, lines, strips and fans are left out
+            if (primitive.GetNumber("mode", 4.0) != 4.0)
+            {
+                return true;
+            }
+
+            const JsonValue* attributes = primitive.Find("attributes");
+            if (attributes == nullptr)
+            {
+                REPORT_ERROR();
+            }
+
+            size_t positions = attributes->GetIndex("POSITION");
+            size_t count = gltf.GetCount(positions);
+            if (count == SIZE_MAX)
+            {
+                REPORT_ERROR();
+            }
+
+            size_t material = primitive.GetIndex("material");
+            Vertex defaultVertex;
+            defaultVertex.materialId = material < materialIds.size() ? materialIds[material] : -1;
+            defaultVertex.color = Color(material < baseColors.size() ? baseColors[material] : Vec{ 1.0f, 1.0f, 1.0f, 1.0f });
+
+            size_t first = model.vertices.size();
+            model.vertices.resize(first + count, defaultVertex);
+            Vertex* vertices = model.vertices.data() + first;
+
+            // normals go through the inverse transpose of the upper 3x3, which is its cofactor matrix scaled by the determinant
+            Vec columns[3];
+            for (int32_t column = 0; column < 3; column++)
+            {
+                columns[column] = { transform.m[column], transform.m[4 + column], transform.m[8 + column], 0.0f };
+            }
+            Vec cofactors[3] = { cross(columns[1], columns[2]), cross(columns[2], columns[0]), cross(columns[0], columns[1]) };
+            bool mirrored = dot(columns[0], cofactors[0]) < 0.0f;
+
+            bool read = gltf.ReadAccessor<float>(positions, 3, [&](size_t i, const float* values) {
+                vertices[i].position = transform * Vec{ values[0], values[1], values[2], 1.0f };
+            });
+
+            size_t normals = attributes->GetIndex("NORMAL");
+            if (normals != SIZE_MAX)
+            {
+                read = read && gltf.GetCount(normals) == count && gltf.ReadAccessor<float>(normals, 3, [&](size_t i, const float* values) {
+                    Vec normal = cofactors[0] * values[0] + cofactors[1] * values[1] + cofactors[2] * values[2];
+                    vertices[i].normal = normalize(mirrored ? -normal : normal);
+                });
+            }
+
+            size_t textureCoords = attributes->GetIndex("TEXCOORD_0");
+            if (textureCoords != SIZE_MAX)
+            {
+                // glTF texture coordinates start at the top of the image
+                read = read && gltf.GetCount(textureCoords) == count && gltf.ReadAccessor<float>(textureCoords, 2, [&](size_t i, const float* values) {
+                    vertices[i].textureCoord = { values[0], 1.0f - values[1], 0.0f, 0.0f };
+                });
+            }
+
+            size_t colors = attributes->GetIndex("COLOR_0");
+            if (colors != SIZE_MAX)
+            {
+                const JsonValue* accessor = gltf.document.Find("accessors", colors);
+                bool hasAlpha = accessor != nullptr && accessor->GetString("type") == "VEC4";
+                read = read && gltf.GetCount(colors) == count && gltf.ReadAccessor<float>(colors, 3, [&](size_t i, const float* values) {
+                    vertices[i].color = Color(vertices[i].color.rgba_vec * Vec{ values[0], values[1], values[2], hasAlpha ? values[3] : 1.0f });
+                });
+            }
+
+            if (!read)
+            {
+                REPORT_ERROR();
+            }
+
+            size_t firstIndex = model.indices.size();
+            size_t indices = primitive.GetIndex("indices");
+            if (indices != SIZE_MAX)
+            {
+                // indices are unsigned integers
+                const JsonValue* accessor = gltf.document.Find("accessors", indices);
+                size_t componentType = accessor != nullptr ? accessor->GetIndex("componentType") : SIZE_MAX;
+                size_t indexCount = gltf.GetCount(indices);
+                model.indices.resize(firstIndex + (indexCount == SIZE_MAX ? 0 : indexCount));
+                bool valid = indexCount != SIZE_MAX && (componentType == 5121 || componentType == 5123 || componentType == 5125);
+                if (!valid || !gltf.ReadAccessor<uint32_t>(indices, 1, [&](size_t i, const uint32_t* values) {
+                    valid = valid && values[0] < count;
+                    model.indices[firstIndex + i] = static_cast<uint32_t>(first + values[0]);
+                }) || !valid)
+                {
+                    REPORT_ERROR();
+                }
+            }
+            else
+            {
+                for (size_t i = 0; i < count; i++)
+                {
+                    model.indices.push_back(static_cast<uint32_t>(first + i));
+                }
+            }
+
+            // incomplete triangles are dropped, mirroring transforms flip the winding back
+            model.indices.resize(firstIndex + (model.indices.size() - firstIndex) / 3 * 3);
+            if (mirrored)
+            {
+                for (size_t i = firstIndex; i < model.indices.size(); i += 3)
+                {
+                    std::swap(model.indices[i + 1], model.indices[i + 2]);
+                }
+            }
+
+            // missing normals come from the faces, a vertex shared by several gets their area weighted average
+            if (normals == SIZE_MAX)
+            {
+                for (size_t i = firstIndex; i < model.indices.size(); i += 3)
+                {
+                    Vertex& a = model.vertices[model.indices[i]];
+                    Vertex& b = model.vertices[model.indices[i + 1]];
+                    Vertex& c = model.vertices[model.indices[i + 2]];
+                    Vec normal = cross(b.position - a.position, c.position - a.position);
+                    a.normal = a.normal + normal;
+                    b.normal = b.normal + normal;
+                    c.normal = c.normal + normal;
+                }
+
+                for (size_t i = first; i < model.vertices.size(); i++)
+                {
+                    Vec& normal = model.vertices[i].normal;
+                    if (dot(normal, normal) > 0.0f)
+                    {
+                        normal = normalize(normal);
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        enum class NodeState : uint8_t
+        {
+            NotVisited,
+            OnPath,
+            Visited
+        };
+
+        // Meshes of every node of the default scene, instances included, are flattened into the model with the node transforms applied.
+        // Node hierarchies are disjoint trees, a node reached twice is either in a cycle or shared and the file is rejected.
+        bool AddNode(const BinaryGltf& gltf, size_t nodeIndex, const Matrix& parentTransform, size_t depth, const std::vector<int32_t>& materialIds,
+            const std::vector<Vec>& baseColors, std::vector<NodeState>& nodeStates, Model& model)
+        {
+            const JsonValue* node = gltf.document.Find("nodes", nodeIndex);
+            if (node == nullptr || depth > JsonReader::MaxDepth || nodeStates[nodeIndex] != NodeState::NotVisited)
+            {
+                REPORT_ERROR();
+            }
+            nodeStates[nodeIndex] = NodeState::OnPath;
+
+            Matrix transform = parentTransform * GetNodeTransform(*node);
+            if (const JsonValue* mesh = gltf.document.Find("meshes", node->GetIndex("mesh")))
+            {
+                if (const JsonValue* primitives = mesh->Find("primitives"))
+                {
+                    for (const JsonValue& primitive : primitives->elements)
+                    {
+                        if (!AddPrimitive(gltf, primitive, transform, materialIds, baseColors, model))
+                        {
+                            REPORT_ERROR();
+                        }
+                    }
+                }
+            }
+
+            if (const JsonValue* children = node->Find("children"))
+            {
+                for (const JsonValue& child : children->elements)
+                {
+                    if (!AddNode(gltf, child.GetIndex(), transform, depth + 1, materialIds, baseColors, nodeStates, model))
+                    {
+                        REPORT_ERROR();
+                    }
+                }
+            }
+
+            nodeStates[nodeIndex] = NodeState::Visited;
+            return true;
+        }
+
+        bool LoadBinaryGltf(const std::string& fullFileName, float weldTolerance, Model& model)
+        {
+            BinaryGltf gltf;
+            if (!Open(fullFileName, gltf))
+            {
+                REPORT_ERROR();
+            }
+
+            std::vector<int32_t> materialIds;
+            std::vector<Vec> baseColors;
+            LoadMaterials(fullFileName, gltf, model, materialIds, baseColors);
+
+            // without scenes every node that isn't a child is a root
+            std::vector<size_t> roots;
+            size_t sceneIndex = gltf.document.GetIndex("scene");
+            if (const JsonValue* scene = gltf.document.Find("scenes", sceneIndex == SIZE_MAX ? 0 : sceneIndex))
+            {
+                if (const JsonValue* nodes = scene->Find("nodes"))
+                {
+                    for (const JsonValue& node : nodes->elements)
+                    {
+                        roots.push_back(node.GetIndex());
+                    }
+                }
+            }
+            else if (const JsonValue* nodes = gltf.document.Find("nodes"))
+            {
+                std::vector<bool> children(nodes->elements.size());
+                for (const JsonValue& node : nodes->elements)
+                {
+                    if (const JsonValue* nodeChildren = node.Find("children"))
+                    {
+                        for (const JsonValue& child : nodeChildren->elements)
+                        {
+                            size_t childIndex = child.GetIndex();
+                            if (childIndex < children.size())
+                            {
+                                children[childIndex] = true;
+                            }
+                        }
+                    }
+                }
+
+                for (size_t i = 0; i < children.size(); i++)
+                {
+                    if (!children[i])
+                    {
+                        roots.push_back(i);
+                    }
+                }
+            }
+
+            const JsonValue* nodes = gltf.document.Find("nodes");
+            std::vector<NodeState> nodeStates(nodes != nullptr ? nodes->elements.size() : 0, NodeState::NotVisited);
+            Matrix identity;
+            identity.m[0] = identity.m[5] = identity.m[10] = identity.m[15] = 1.0f;
+            for (size_t root : roots)
+            {
+                if (!AddNode(gltf, root, identity, 0, materialIds, baseColors, nodeStates, model))
+                {
+                    REPORT_ERROR();
+                }
+            }
+
+            if (weldTolerance >= 0.0f)
+            {
+                Weld(weldTolerance, model);
+            }
+
+            return true;
+        }
+
+        bool Load(const std::string& fullFileName, Light& light)
+        {
+            std::fstream file(fullFileName);
+            std::string line;
+
+            if (std::getline(file, line))
+            {
+                std::stringstream lineStream(line);
+
+                Vec params;
+                if (Read(lineStream, 3, 0.0f, params))
+                {
+                    light.ambientStrength = params.x;
+                    light.specularStrength = params.y;
+                    light.specularShininess = params.z;
+                }
+                else
+                {
+                    REPORT_ERROR();
+                }
+            }
+            else
+            {
+                REPORT_ERROR();
+            }
+
+            if (std::getline(file, line))
+            {
+                std::stringstream lineStream(line);
+
+                Vec color;
+                if (Read(lineStream, 3, 1.0f, color))
+                {
+                    light.color = Color(color);
+                }
+                else
+                {
+                    REPORT_ERROR();
+                }
+            }
+            else
+            {
+                REPORT_ERROR();
+            }
+
+            // optional third line is the radius of a point light
+            if (std::getline(file, line) && !line.empty())
+            {
+                std::stringstream lineStream(line);
+
+                Vec radius;
+                if (Read(lineStream, 1, 0.0f, radius))
+                {
+                    light.radius = radius.x;
+                }
+                else
+                {
+                    REPORT_ERROR();
+                }
+            }
+
+            REPORT_ERROR_IF_FALSE(file.is_open());
+        }
+
+        bool Load(const std::string& fullFileName, Camera& camera)
+        {
+            std::fstream file(fullFileName);
+            std::string line;
+
+            if (std::getline(file, line))
+            {
+                std::stringstream lineStream(line);
+
+                Vec rotation;
+                if (Read(lineStream, 2, 0.0f, rotation))
+                {
+                    camera.pitch = rotation.x;
+                    camera.yaw = rotation.y;
+                }
+                else
+                {
+                    REPORT_ERROR();
+                }
+            }
+
+            REPORT_ERROR_IF_FALSE(file.is_open());
+        }
+
+        // Reads the text description of the scene and the files it refers to, which are added to sources.
+        bool LoadDescription(const std::string& fullFileName, float weldTolerance, Scene& scene, std::vector<std::string>& sources)
+        {
+            const char* EXTENSION_MODEL = "obj";
+            const char* EXTENSION_BINARY_GLTF = "glb";
+            const char* EXTENSION_LIGHT = "lig";
+            const char* EXTENSION_CAMERA = "cam";
+
+            scene.name = GetSceneName(fullFileName);
+            sources.push_back(fullFileName);
+
+            std::fstream file(fullFileName);
+            std::string line;
+            bool hasLight = false;
+
+            while (std::getline(file, line))
+            {
+                std::stringstream lineStream(line);
+
+                std::string fileName;
+                if (lineStream >> fileName)
+                {
+                    std::string extension = GetFileExtension(fileName);
+
+                    if (extension == EXTENSION_MODEL || extension == EXTENSION_BINARY_GLTF)
+                    {
+                        Model model;
+                        if (Read(lineStream, 3, 1.0f, model.position))
+                        {
+                            std::string modelFileName = ReplaceFileNameInFullPath(fullFileName, fileName);
+                            sources.push_back(modelFileName);
+                            bool loaded = extension == EXTENSION_MODEL ? Load(modelFileName, weldTolerance, model, sources) : LoadBinaryGltf(modelFileName, weldTolerance, model);
+                            if (loaded)
+                            {
+                                std::string culling;
+                                if (lineStream >> culling)
+                                {
+                                    model.backfaceCulling = culling != "culling_off";
+                                }
+
+                                scene.models.push_back(std::move(model));
+                            }
+                            else
+                            {
+                                REPORT_ERROR();
+                            }
+                        }
+                        else
+                        {
+                            REPORT_ERROR();
+                        }
+                    }
+                    else if (extension == EXTENSION_CAMERA)
+                    {
+                        if (Read(lineStream, 3, 1.0f, scene.camera.position))
+                        {
+                            sources.push_back(ReplaceFileNameInFullPath(fullFileName, fileName));
+                            if (!Load(sources.back(), scene.camera))
+                            {
+                                REPORT_ERROR();
+                            }
+                        }
+                        else
+                        {
+                            REPORT_ERROR();
+                        }
+                    }
+                    else if (extension == EXTENSION_LIGHT)
+                    {
+                        // the first light goes to scene.light, each following one, repeated files included, is added to scene.lights
+                        Light light;
+                        if (Read(lineStream, 3, 1.0f, light.position))
+                        {
+                            sources.push_back(ReplaceFileNameInFullPath(fullFileName, fileName));
+                            if (!Load(sources.back(), light))
+                            {
+                                REPORT_ERROR();
+                            }
+
+                            if (hasLight)
+                            {
+                                scene.lights.push_back(light);
+                            }
+                            else
+                            {
+                                scene.light = light;
+                                hasLight = true;
+                            }
+                        }
+                        else
+                        {
+                            REPORT_ERROR();
+                        }
+                    }
+                }
+                else
+                {
+                    REPORT_ERROR();
+                }
+
+
+            }
+
+            REPORT_ERROR_IF_FALSE(file.is_open());
+        }
+
+        // "PSCN"
+        constexpr uint32_t SceneCacheMagic = 0x4E435350;
+        constexpr uint32_t SceneCacheVersion = 1;
+        // vertex and index arrays start at multiples of this, so they can be used in place from a mapped file
+        constexpr size_t SceneCacheAlignment = 64;
+
+        struct SceneCacheHeader
+        {
+            uint32_t magic = SceneCacheMagic;
+            uint32_t version = SceneCacheVersion;
+            // the arrays are stored as they are in memory, a cache of another layout is stale
+            uint32_t vertexSize = sizeof(Vertex);
+            uint32_t lightSize = sizeof(Light);
+            float weldTolerance = NoWelding;
+            uint32_t sourceCount = 0;
+            uint32_t lightCount = 0;
+            uint32_t modelCount = 0;
+        };
+
+        // A source is unchanged when its size and write time are, or, when only the time changed, its contents hash the same.
+        struct SceneCacheSource
+        {
+            uint64_t size = 0;
+            int64_t writeTime = 0;
+            uint64_t hash = 0;
+        };
+
+        static_assert(std::is_trivially_copyable_v<Vertex> && std::is_trivially_copyable_v<Light>);
+
+        uint64_t HashFile(const std::string& fullFileName)
+        {
+            std::ifstream stream(fullFileName, std::ios::binary);
+            std::vector<char> bytes((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+            // FNV-1a
+            uint64_t hash = 14695981039346656037ull;
+            for (char byte : bytes)
+            {
+                hash = (hash ^ static_cast<uint8_t>(byte)) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+        bool GetSourceInfo(const std::string& fullFileName, uint64_t& size, int64_t& writeTime)
+        {
+            std::error_code error;
+            size = std::filesystem::file_size(fullFileName, error);
+            if (error)
+            {
+                return false;
+            }
+
+            writeTime = static_cast<int64_t>(std::filesystem::last_write_time(fullFileName, error).time_since_epoch().count());
+            return !error;
+        }
+
+        template<typename T>
+        void WriteValue(std::ofstream& stream, const T& value)
+        {
+            stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        void WriteString(std::ofstream& stream, const std::string& value)
+        {
+            WriteValue(stream, static_cast<uint32_t>(value.size()));
+            stream.write(value.data(), value.size());
+        }
+
+        template<typename T>
+        void WriteArray(std::ofstream& stream, const std::vector<T>& values)
+        {
+            WriteValue(stream, static_cast<uint64_t>(values.size()));
+
+            static constexpr char Padding[SceneCacheAlignment] = {};
+            size_t offset = static_cast<size_t>(stream.tellp());
+            stream.write(Padding, (SceneCacheAlignment - offset % SceneCacheAlignment) % SceneCacheAlignment);
+            stream.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+        }
+
+        template<typename T>
+        bool ReadValue(std::ifstream& stream, T& value)
+        {
+            return static_cast<bool>(stream.read(reinterpret_cast<char*>(&value), sizeof(T)));
+        }
+
+        bool ReadString(std::ifstream& stream, size_t fileSize, std::string& value)
+        {
+            uint32_t size = 0;
+            if (!ReadValue(stream, size) || size > fileSize - static_cast<size_t>(stream.tellg()))
+            {
+                return false;
+            }
+
+            value.resize(size);
+            return static_cast<bool>(stream.read(value.data(), size));
+        }
+
+        // Counts are checked against what is left of the file before anything is allocated.
+        template<typename T>
+        bool ReadArray(std::ifstream& stream, size_t fileSize, std::vector<T>& values)
+        {
+            uint64_t count = 0;
+            if (!ReadValue(stream, count))
+            {
+                return false;
+            }
+
+            size_t offset = static_cast<size_t>(stream.tellg());
+            offset += (SceneCacheAlignment - offset % SceneCacheAlignment) % SceneCacheAlignment;
+            if (offset > fileSize || count > (fileSize - offset) / sizeof(T))
+            {
+                return false;
+            }
+
+            values.resize(static_cast<size_t>(count));
+            stream.seekg(offset);
+            return static_cast<bool>(stream.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T)));
+        }
+
+        bool SaveCache(const std::string& cacheFileName, const Scene& scene, float weldTolerance, const std::vector<std::string>& sources)
+        {
+            SceneCacheHeader header;
+            header.weldTolerance = weldTolerance;
+            header.sourceCount = static_cast<uint32_t>(sources.size());
+            header.lightCount = static_cast<uint32_t>(scene.lights.size());
+            header.modelCount = static_cast<uint32_t>(scene.models.size());
+
+            // written under another name first, so a reader never sees a half written file
+            std::string temporaryFileName = cacheFileName + ".tmp";
+            {
+                std::ofstream stream(temporaryFileName, std::ios::binary);
+                WriteValue(stream, header);
+
+                for (const std::string& source : sources)
+                {
+                    SceneCacheSource info;
+                    if (!GetSourceInfo(source, info.size, info.writeTime))
+                    {
+                        REPORT_ERROR();
+                    }
+
+                    info.hash = HashFile(source);
+                    WriteValue(stream, info);
+                    WriteString(stream, source);
+                }
+
+                WriteString(stream, scene.name);
+                WriteValue(stream, scene.light);
+                for (const Light& light : scene.lights)
+                {
+                    WriteValue(stream, light);
+                }
+
+                const Camera& camera = scene.camera;
+                for (float value : { camera.farPlane, camera.nearPlane, camera.fieldOfView, camera.pitch, camera.yaw })
+                {
+                    WriteValue(stream, value);
+                }
+                WriteValue(stream, camera.position);
+
+                for (const Model& model : scene.models)
+                {
+                    WriteValue(stream, model.position);
+                    WriteValue(stream, static_cast<uint32_t>(model.backfaceCulling));
+                    WriteValue(stream, static_cast<uint32_t>(model.materials.size()));
+                    for (const Material& material : model.materials)
+                    {
+                        WriteString(stream, material.name);
+                        WriteString(stream, material.textureName);
+                    }
+
+                    WriteArray(stream, model.vertices);
+                    WriteArray(stream, model.indices);
+                }
+
+                if (!stream)
+                {
+                    REPORT_ERROR();
+                }
+            }
+
+            std::error_code error;
+            std::filesystem::rename(temporaryFileName, cacheFileName, error);
+            return !error;
+        }
+
+        // Fails without touching the scene when the cache is missing, damaged, of another version or weld tolerance,
+        // or when any of the files it was made from changed. Sets refresh when a file was only written again with the same contents,
+        // the cache should then be saved with the new write time so the file isn't hashed on every load.
+        bool LoadCache(const std::string& cacheFileName, float weldTolerance, Scene& scene, std::vector<std::string>& sources, bool& refresh)
+        {
+            refresh = false;
+            sources.clear();
+
+            std::error_code error;
+            size_t fileSize = static_cast<size_t>(std::filesystem::file_size(cacheFileName, error));
+            std::ifstream stream(cacheFileName, std::ios::binary);
+            SceneCacheHeader header;
+            if (error || !ReadValue(stream, header) || header.magic != SceneCacheMagic || header.version != SceneCacheVersion ||
+                header.vertexSize != sizeof(Vertex) || header.lightSize != sizeof(Light) || header.weldTolerance != weldTolerance)
+            {
+                return false;
+            }
+
+            for (uint32_t i = 0; i < header.sourceCount; i++)
+            {
+                SceneCacheSource info;
+                std::string source;
+                if (!ReadValue(stream, info) || !ReadString(stream, fileSize, source))
+                {
+                    return false;
+                }
+
+                SceneCacheSource current;
+                if (!GetSourceInfo(source, current.size, current.writeTime) || current.size != info.size)
+                {
+                    return false;
+                }
+
+                if (current.writeTime != info.writeTime)
+                {
+                    if (HashFile(source) != info.hash)
+                    {
+                        return false;
+                    }
+                    refresh = true;
+                }
+                sources.push_back(std::move(source));
+            }
+
+            std::string name;
+            Light light;
+            std::vector<Light> lights(std::min<size_t>(header.lightCount, fileSize / sizeof(Light)));
+            if (!ReadString(stream, fileSize, name) || !ReadValue(stream, light) || lights.size() != header.lightCount)
+            {
+                return false;
+            }
+
+            for (Light& other : lights)
+            {
+                if (!ReadValue(stream, other))
+                {
+                    return false;
+                }
+            }
+
+            float cameraValues[5] = {};
+            Vec cameraPosition;
+            if (!ReadValue(stream, cameraValues) || !ReadValue(stream, cameraPosition))
+            {
+                return false;
+            }
+
+            std::vector<Model> models;
+            for (uint32_t i = 0; i < header.modelCount; i++)
+            {
+                Model model;
+                uint32_t backfaceCulling = 0;
+                uint32_t materialCount = 0;
+                if (!ReadValue(stream, model.position) || !ReadValue(stream, backfaceCulling) || !ReadValue(stream, materialCount))
+                {
+                    return false;
+                }
+
+                model.backfaceCulling = backfaceCulling != 0;
+                for (uint32_t j = 0; j < materialCount; j++)
+                {
+                    Material material;
+                    if (!ReadString(stream, fileSize, material.name) || !ReadString(stream, fileSize, material.textureName))
+                    {
+                        return false;
+                    }
+                    model.materials.push_back(std::move(material));
+                }
+
+                if (!ReadArray(stream, fileSize, model.vertices) || !ReadArray(stream, fileSize, model.indices))
+                {
+                    return false;
+                }
+
+                for (uint32_t index : model.indices)
+                {
+                    if (index >= model.vertices.size())
+                    {
+                        return false;
+                    }
+                }
+
+                models.push_back(std::move(model));
+            }
+
+            scene.name = std::move(name);
+            scene.light = light;
+            scene.lights = std::move(lights);
+            scene.camera.farPlane = cameraValues[0];
+            scene.camera.nearPlane = cameraValues[1];
+            scene.camera.fieldOfView = cameraValues[2];
+            scene.camera.pitch = cameraValues[3];
+            scene.camera.yaw = cameraValues[4];
+            scene.camera.position = cameraPosition;
+            scene.models = std::move(models);
+            return true;
+        }
+    }
+
+    bool operator<(const Vertex& lhs, const Vertex& rhs)
+    {
+        return std::tie(lhs.materialId, lhs.color.rgba_vec, lhs.normal, lhs.position, lhs.textureCoord) <
+            std::tie(rhs.materialId, rhs.color.rgba_vec, rhs.normal, rhs.position, rhs.textureCoord);
+    }
+
+    bool operator==(const Vertex& lhs, const Vertex& rhs)
+    {
+        return !(lhs < rhs) && !(rhs < lhs);
+    }
+
+    bool Load(const std::string& fullFileName, Scene& scene, float weldTolerance, bool useCache)
+    {
+        std::string cacheFileName = fullFileName + SceneCacheExtension;
+        std::vector<std::string> cachedSources;
+        bool refresh = false;
+        if (useCache && LoadCache(cacheFileName, weldTolerance, scene, cachedSources, refresh))
+        {
+            if (refresh)
+            {
+                SaveCache(cacheFileName, scene, weldTolerance, cachedSources);
+            }
+            return true;
+        }
+
+        std::vector<std::string> sources;
+        if (!LoadDescription(fullFileName, weldTolerance, scene, sources))
+        {
+            REPORT_ERROR();
+        }
+
+        // a scene that loads fine is still usable when the cache can't be written
+        if (useCache)
+        {
+            SaveCache(cacheFileName, scene, weldTolerance, sources);
+        }
+
+        return true;
+    }
+
+    bool ConvertToCache(const std::string& fullFileName, float weldTolerance)
+    {
+        Scene scene;
+        std::vector<std::string> sources;
+        if (!LoadDescription(fullFileName, weldTolerance, scene, sources))
+        {
+            REPORT_ERROR();
+        }
+
+        return SaveCache(fullFileName + SceneCacheExtension, scene, weldTolerance, sources);
+    }
+
+    bool ReadEmbeddedImage(const std::string& fullFileName, size_t imageIndex, std::vector<uint8_t>& bytes)
+    {
+        BinaryGltf gltf;
+        if (!Open(fullFileName, gltf, false))
+        {
+            REPORT_ERROR();
+        }
+
+        const JsonValue* image = gltf.document.Find("images", imageIndex);
+        size_t offset = 0;
+        size_t size = 0;
+        size_t stride = 0;
+        if (image == nullptr || !gltf.GetBufferViewRange(image->GetIndex("bufferView"), offset, size, stride))
+        {
+            REPORT_ERROR();
         }
 
-        REPORT_ERROR_IF_FALSE(file.is_open());
+        std::ifstream file(fullFileName, std::ios::binary);
+        file.seekg(gltf.binaryOffset + offset);
+        bytes.resize(size);
+        REPORT_ERROR_IF_FALSE(file.read(reinterpret_cast<char*>(bytes.data()), size));
     }
 
     Matrix PerspectiveTransform(const Camera& camera, float width, float height)
@@ -32,6 +32,9 @@ namespace Renderer
         std::vector<Vertex> vertices;
         std::vector<uint32_t> indices;
         bool backfaceCulling = true;
+
+        // Code that changes vertices or indices after loading increments it, renderers keep data derived from the geometry until it changes.
+        uint64_t version = 0;
     };
 
     struct Light
@@ -42,6 +45,9 @@ namespace Renderer
         float specularStrength = 0.0f;
         float specularShininess = 0.0f;
         Color color = Color::White;
+
+        // Point light fades out to nothing at this distance, 0 means that the light reaches everything. Not used for the first light of the scene.
+        float radius = 0.0f;
     };
 
     struct Camera
@@ -67,12 +73,33 @@ namespace Renderer
     {
         std::string name;
         DebugContext debugContext;
+        // The first light of the scene description, the only one drawn by the hardware renderer.
         Light light;
+        // The rest of the lights, software renderer culls them per screen tile, so they should have a radius.
+        std::vector<Light> lights;
         Camera camera;
         std::vector<Model> models;
     };
 
-    bool Load(const std::string& fullFileName, Scene& scene);
+    // Models are .obj files, or .glb files whose meshes are flattened with their node transforms, glTF vertices are kept as they are indexed.
+    // Embedded images of a .glb file are named "<model>#image<index>" in the materials and decoded from the model in memory when a texture
+    // is loaded, see ReadEmbeddedImage. No files are written for them.
+    // OBJ models keep a vertex for every distinct combination of position, texture coordinates, normal and material their faces refer to.
+    // With a weldTolerance of 0 or more, vertices of a material whose attributes all differ by at most the tolerance are merged too,
+    // which joins seams of models that repeat the same values under different indices.
+    // With useCache the scene is read from its binary cache, fullFileName + SceneCacheExtension, as long as the cache was made with
+    // the same tolerance from files that haven't changed since. Otherwise the text files are parsed and the cache is written again.
+    constexpr float NoWelding = -1.0f;
+    constexpr const char* SceneCacheExtension = ".cache";
+    bool Load(const std::string& fullFileName, Scene& scene, float weldTolerance = NoWelding, bool useCache = false);
+
+    // Writes the binary cache of the scene whether or not it is up to date. The cache keeps the files the scene was read from with
+    // their sizes, write times and hashes, then the vertices and indices of the models as they are in memory, in sections aligned
+    // so they could be used in place from a mapped file.
+    bool ConvertToCache(const std::string& fullFileName, float weldTolerance = NoWelding);
+
+    // Bytes of an image embedded in a binary glTF model, only the document and the image are read from the file.
+    bool ReadEmbeddedImage(const std::string& fullFileName, size_t imageIndex, std::vector<uint8_t>& bytes);
 
     // In view space we are at 0 looking down the negative z axis.
     // Near plane of the camera frustum is at -Near, far plane of the camera frustum is at -Far.
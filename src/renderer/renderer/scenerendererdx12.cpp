@@ -1,5 +1,6 @@
 #include <renderer/scenerendererdx12.h>
 #include <renderer/devicedx12.h>
+#include <renderer/texturecache.h>
 
 #include <utils.h>
 
@@ -164,16 +165,21 @@ namespace Renderer
 
             indexBufferView = UploadDataToGPU<uint16_t, D3D12_INDEX_BUFFER_VIEW>(indexData, indexBuffer);
 
-            size_t totalIndex = 0;
-            textureBuffers.resize(totalMaterials);
+            std::vector<std::string> texturePaths;
             for (const Model& model : scene.models)
             {
-                for (size_t i = 0; i < model.materials.size(); i++)
+                for (const Material& material : model.materials)
                 {
-                    UploadTexturesToGPU(model.materials[i].textureName, static_cast<int32_t>(totalIndex), textureBuffers[totalIndex]);
-                    totalIndex += 1;
+                    texturePaths.push_back(material.textureName);
                 }
             }
+
+            std::vector<std::shared_ptr<const Texture>> textures = TextureCache::GetInstance().Load(texturePaths);
+            textureBuffers.resize(totalMaterials);
+            for (size_t i = 0; i < textures.size(); i++)
+            {
+                UploadTexturesToGPU(*textures[i], static_cast<int32_t>(i), textureBuffers[i]);
+            }
         }
 
         uint64_t AlignBytes(uint64_t size, uint64_t alignment = 256)
@@ -449,11 +455,8 @@ namespace Renderer
             return bufferView;
         }
 
-        void UploadTexturesToGPU(const std::string& textureName, int32_t index, ComPtr<ID3D12Resource>& dataBuffer)
+        void UploadTexturesToGPU(const Texture& texture, int32_t index, ComPtr<ID3D12Resource>& dataBuffer)
         {
-            Texture texture;
-            Load(textureName, texture);
-
             D3D12_RESOURCE_DESC textureDesc = {};
             textureDesc.MipLevels = 1;
             textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
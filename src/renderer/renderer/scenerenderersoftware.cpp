@@ -1,4 +1,11 @@
 #include <renderer/scenerenderersoftware.h>
+#include <renderer/pixels.h>
+#include <renderer/framearena.h>
+#include <renderer/texturecache.h>
+#include <renderer/virtualtextures.h>
+#include <renderer/textureatlas.h>
+#include <renderer/simd.h>
+#include <renderer/fastmath.h>
 
 #include <stdint.h>
 #include <algorithm>
@@ -9,12 +16,71 @@
 #include <execution>
 #include <ranges>
 #include <utility>
+#include <numeric>
+#include <bit>
+#include <cfloat>
+#include <cstring>
 
 #include "utils.h"
 
 namespace Renderer
 {
-    static constexpr uint32_t InterpolantsSize = 13;
+    // Channels interpolated across a triangle and stored in G buffer, all of them are divided by w.
+    // The layout is picked per frame from what the model needs, so textured meshes don't carry vertex colors,
+    // untextured ones don't carry texture coordinates and single colored ones carry neither.
+    template<bool WithColor, bool WithTexCoord>
+    struct AttributeLayout
+    {
+        static constexpr bool HasColor = WithColor;
+        static constexpr bool HasTexCoord = WithTexCoord;
+
+        static constexpr uint32_t Color = 0;
+        static constexpr uint32_t TexCoord = Color + (HasColor ? 3 : 0);
+        static constexpr uint32_t Normal = TexCoord + (HasTexCoord ? 2 : 0);
+        static constexpr uint32_t PositionView = Normal + 3;
+        // Number of channels set up on demand from the source triangle.
+        static constexpr uint32_t AttributesSize = PositionView + 3;
+        static constexpr uint32_t InverseW = AttributesSize;
+        // Depth is kept in Z buffer only.
+        static constexpr uint32_t Size = InverseW + 1;
+    };
+
+    using TexturedLayout = AttributeLayout<false, true>;
+    using ColoredLayout = AttributeLayout<true, false>;
+    using SingleColorLayout = AttributeLayout<false, false>;
+
+    static constexpr uint32_t MaxInterpolantsSize = AttributeLayout<true, true>::Size;
+
+    // Shading features fixed for the whole frame. Every combination gets its own ShadePixels, so disabled features cost nothing per pixel.
+    template<typename Layout, bool WithSpecular, bool WithToneMapping, MathAccuracy WithAccuracy>
+    struct ShadingPermutation
+    {
+        using Attributes = Layout;
+        static constexpr bool HasSpecular = WithSpecular;
+        // Reinhard tone mapping instead of clamping the color to 0 to 1 range.
+        static constexpr bool HasToneMapping = WithToneMapping;
+        static constexpr MathAccuracy Accuracy = WithAccuracy;
+    };
+
+    // Buffers are cleared lazily in square tiles of this size, shading works on one tile wide span at a time.
+    static constexpr size_t TileSize = 64;
+    // Lights are culled per tile of this size, small enough for the depth range of a tile to stay tight.
+    // Spans of FloatLanes never cross a light tile.
+    static constexpr size_t LightTileSize = 16;
+    static_assert(TileSize % LightTileSize == 0 && LightTileSize % FloatLanes::Width == 0);
+    // Triangles the shadow map is set up and rasterized in at a time.
+    static constexpr size_t ShadowChunkSize = 4096;
+    // A filtered lookup reads 4 texels in each of 2 levels.
+    static constexpr size_t MaxPageRequestsPerPixel = 8;
+    // Room a band of tiles has for page requests besides one of every page, so it doesn't have to dedup too often.
+    static constexpr size_t PageRequestsSlack = 1024;
+    static constexpr float ClearDepth = 2.0f;
+
+    // Shadow map lookups move the position along the normal by this many texels, so lit surfaces don't shadow themselves.
+    static constexpr float ShadowNormalOffset = 1.5f;
+
+    // Clipping a triangle against each of the 6 frustum planes adds at most one vertex.
+    static constexpr size_t MaxClippedVertices = 3 + 6;
 
     struct InterpolationPoint
     {
@@ -45,7 +111,7 @@ namespace Renderer
         float minC = 0.0f;
         float midC = 0.0f;
 
-        float CalculateC(float dx, float dy, bool isMin)
+        float CalculateC(float dx, float dy, bool isMin) const
         {
             return (isMin ? minC : midC) + dy * stepY + dx * stepX;
         }
@@ -55,17 +121,15 @@ namespace Renderer
     {
         Light light;
         Vec position_view;
+        float inverseRadiusSquared = 0.0f; // 0 for lights without radius
     };
 
+    // Vertex during triangle setup. Only the position goes through clipping, attributes are recovered
+    // from the source model triangle with the barycentric weights once the triangle turns out to be visible.
     struct VertexS
     {
-        Vertex v;
-        Vec pos_view;
-
-        // todo.pavelza: need to get rid of these, just needed for easier interpolation
-        float red = 0.0f;
-        float green = 0.0f;
-        float blue = 0.0f;
+        Vec position;
+        std::array<float, 3> barycentric;
     };
 
     struct Edge
@@ -74,7 +138,7 @@ namespace Renderer
         {
         }
 
-        Edge(Vec b, Vec e, bool isMin = true) : begin(b), isBeginMin(isMin), pixelX(0)
+        Edge(const Vec& b, const Vec& e, bool isMin = true) : beginX(b.x), beginY(b.y), isBeginMin(isMin)
         {
             pixelYBegin = static_cast<int32_t>(ceil(b.y));
             pixelYEnd = static_cast<int32_t>(ceil(e.y));
@@ -84,525 +148,2176 @@ namespace Renderer
             stepX = distanceY > 0.0f ? distanceX / distanceY : 0.0f;
         }
 
-        void CalculateC(std::array<Interpolant, InterpolantsSize>& interpolants, int32_t y)
+        int32_t GetPixelX(int32_t y) const
         {
-            pixelX = static_cast<int32_t>(ceil(begin.x + (y - begin.y) * stepX));
-            for (size_t i = 0; i < InterpolantsSize; i++)
-            {
-                currentC[i] = interpolants[i].CalculateC(pixelX - begin.x, y - begin.y, isBeginMin);
-            }
+            return static_cast<int32_t>(ceil(beginX + (y - beginY) * stepX));
         }
 
-        void CalculateCForZOnly(std::array<Interpolant, InterpolantsSize>& interpolants, int32_t y)
+        float CalculateC(const Interpolant& interpolant, int32_t pixelX, int32_t y) const
         {
-            pixelX = static_cast<int32_t>(ceil(begin.x + (y - begin.y) * stepX));
-            currentC[12] = interpolants[12].CalculateC(pixelX - begin.x, y - begin.y, isBeginMin);
+            return interpolant.CalculateC(pixelX - beginX, y - beginY, isBeginMin);
         }
 
-        int32_t pixelYBegin;
-        int32_t pixelYEnd;
-        int32_t pixelX;
-
-        float stepX;
-        bool isBeginMin;
-        Vec begin;
+        int32_t pixelYBegin = 0;
+        int32_t pixelYEnd = 0;
 
-        // todo.pavelza: C along the edge. Need to rename the C into interpolated value or something like this.
-        std::array<float, InterpolantsSize> currentC;
+        float stepX = 0.0f;
+        float beginX = 0.0f;
+        float beginY = 0.0f;
+        bool isBeginMin = true;
     };
 
+    // Compact setup record. Only edges, depth and 1/w planes are set up for every triangle,
+    // the rest of the interpolants are calculated on demand from the source triangle for triangles that win visibility.
     struct Triangle
     {
         uint32_t texture = 0;
+        uint32_t sourceIndex = 0; // triangle index in the model
+
+        // Screen space x and y, z divided by w and clip space w, sorted by y.
+        std::array<Vec, 3> positions;
+        // Weights of the source triangle vertices for each of the positions, differ from identity only for clipped triangles.
+        std::array<std::array<float, 3>, 3> barycentrics;
 
-        std::array<Interpolant, InterpolantsSize> interpolants;
-        std::vector<VertexS> vertices;
+        Interpolant depth;
+        Interpolant inverseW;
 
         Edge minMax;
         Edge minMiddle;
         Edge middleMax;
     };
 
+    // Depth of the model as seen from the main light. The light looks at the bounding sphere of the model with a frustum that
+    // just fits the sphere, so the map is only rendered when the light is outside of the sphere.
+    struct ShadowMap
+    {
+        std::vector<float> depth;
+        size_t resolution = 0;
+        bool valid = false;
+
+        // World space to light clip space.
+        Matrix lightViewProjection;
+        // World space size of a texel at the far side of the bounding sphere.
+        float texelSize = 0.0f;
+
+        // The map is rendered again only when one of these changes.
+        Vec lightPosition;
+        const Vertex* vertices = nullptr;
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        uint64_t modelVersion = 0;
+
+        size_t renderCount = 0;
+    };
+
+    struct ClippedPolygon
+    {
+        std::array<VertexS, MaxClippedVertices> vertices;
+        size_t size = 0;
+    };
+
+    // Triangles ready for rasterization, stored in the frame arena.
+    struct TriangleBatch
+    {
+        Triangle* triangles = nullptr;
+        size_t size = 0;
+        size_t capacity = 0;
+
+        // Set when the batch had to be rasterized before all triangles were added, because it ran out of memory.
+        bool flushed = false;
+
+        // Where the batch starts in the frame arena, the memory goes back to the arena once the triangles are rasterized.
+        FrameArena::Marker marker;
+    };
+
+    struct MaterialTexture
+    {
+        uint32_t texture = 0;
+        TextureRect rect;
+        size_t mipCount = 0;
+    };
+
     struct SceneRendererSoftwareContext
     {
-        SceneRendererSoftwareContext(const Scene& scene): scene(scene) {}
+        SceneRendererSoftwareContext(const Scene& scene, size_t frameMemoryBudget): scene(scene), arena(frameMemoryBudget)
+        {
+            const std::vector<Vertex>& vertices = scene.models[0].vertices;
+            if (!vertices.empty())
+            {
+                SingleColor = vertices[0].color;
+                HasVertexColors = std::any_of(vertices.begin(), vertices.end(), [this](const Vertex& v) { return v.color.rgba != SingleColor.rgba; });
+            }
+        }
 
         const Scene& scene;
+        FrameArena arena;
+
+        Matrix View;
+        Matrix ViewProjection;
 
-        size_t OutputWidth;
-        size_t OutputHeight;
+        size_t OutputWidth = 0;
+        size_t OutputHeight = 0;
 
+        // RGBA8 pixels in the same row order as the G buffer, i.e. bottom row first.
         std::vector<uint32_t> BackBuffer;
         std::vector<float> ZBuffer;
+        // Textures of the materials, with atlas packing small ones share atlases.
         std::vector<Texture> Textures;
+        // Per texture a view of every mip level, set up after the textures are prepared for the frame.
+        std::vector<std::vector<TextureView>> TextureViews;
+        // Per material the texture, the virtual one with virtual texturing, the texels it covers and the levels it has there.
+        std::vector<MaterialTexture> MaterialTextures;
+        size_t AtlasSize = 0;
+        // What the textures were prepared as, textures are copied from the texture cache again when it changes,
+        // so converting never starts from texels that an earlier format already lost.
+        TextureLayout PreparedLayout = TextureLayout::Linear;
+        TextureFormat PreparedFormat = TextureFormat::RGBA8;
+        // Used instead of Textures when virtual texturing is on, the pages the G buffer samples are made resident before shading.
+        VirtualTextures VirtualPages;
+        bool VirtualTexturing = false;
         LightS light;
 
-        std::vector<std::array<float, InterpolantsSize>> GBuffer;
+        // Point lights besides the main one, and per light tile the indices of the lights that reach the geometry of the tile,
+        // TileLightCounts of them from TileLightOffsets on in TileLightIndices. The tile arrays are in the frame arena.
+        std::vector<LightS> Lights;
+        uint32_t* TileLightOffsets = nullptr;
+        uint32_t* TileLightCounts = nullptr;
+        uint32_t* TileLightIndices = nullptr;
+        size_t LightTilesX = 0;
+        size_t LightTilesY = 0;
+        Matrix Projection;
+
+        ShadowMap Shadows;
+        // View space to light clip space, set every frame, because the cached shadow map doesn't depend on the camera.
+        Matrix ViewToShadowMap;
+
+        // Untextured meshes with the same color for every vertex are drawn with SingleColorLayout.
+        bool HasVertexColors = false;
+        Color SingleColor = Color::White;
+
+        bool ToneMapping = false;
+        MathAccuracy Accuracy = MathAccuracy::Exact;
+        TextureFilter Filter = TextureFilter::Nearest;
+
+        // Z buffer is cleared per tile when a triangle touches the tile for the first time in a frame.
+        // G and T buffers are never cleared, they are only valid where Z buffer is not ClearDepth.
+        // G buffer is planar, one plane per Layout channel, so shading can load the same channel of several pixels at once.
+        // The buffer fits the widest layout.
+        std::vector<float> GBuffer;
         std::vector<uint32_t> TBuffer;
 
-        float Lerp(float begin, float end, float lerpAmount)
+        size_t TilesX = 0;
+        size_t TilesY = 0;
+        std::vector<uint32_t> TileEpochs;
+        uint32_t FrameEpoch = 0;
+
+        void Resize(size_t width, size_t height)
         {
-            return begin + (end - begin) * lerpAmount;
+            if (OutputWidth == width && OutputHeight == height)
+            {
+                return;
+            }
+
+            OutputWidth = width;
+            OutputHeight = height;
+
+            BackBuffer.resize(OutputWidth * OutputHeight);
+            ZBuffer.resize(OutputWidth * OutputHeight);
+            GBuffer.resize(OutputWidth * OutputHeight * MaxInterpolantsSize);
+            TBuffer.resize(OutputWidth * OutputHeight);
+
+            TilesX = (OutputWidth + TileSize - 1) / TileSize;
+            TilesY = (OutputHeight + TileSize - 1) / TileSize;
+            TileEpochs.assign(TilesX * TilesY, 0u);
+            FrameEpoch = 0;
+
+            LightTilesX = (OutputWidth + LightTileSize - 1) / LightTileSize;
+            LightTilesY = (OutputHeight + LightTileSize - 1) / LightTileSize;
         }
 
-        void FillZBuffer(Triangle& tr)
+        float* GetGBufferPlane(uint32_t channel)
         {
-            for (int32_t y = tr.minMax.pixelYBegin; y < tr.minMax.pixelYEnd; y++)
+            return GBuffer.data() + channel * OutputWidth * OutputHeight;
+        }
+
+        // Marks all tiles as stale without touching the buffers.
+        void BeginFrame()
+        {
+            FrameEpoch++;
+
+            if (FrameEpoch == 0)
             {
-                Edge* left = &tr.minMax;
-                Edge* right = y >= tr.middleMax.pixelYBegin ? &tr.middleMax : &tr.minMiddle;
+                std::fill(TileEpochs.begin(), TileEpochs.end(), 0u);
+                FrameEpoch = 1;
+            }
+        }
+
+        bool IsTileFresh(size_t tileX, size_t tileY) const
+        {
+            return TileEpochs[tileY * TilesX + tileX] == FrameEpoch;
+        }
 
-                left->CalculateCForZOnly(tr.interpolants, y);
-                right->CalculateCForZOnly(tr.interpolants, y);
+        void ClearTile(size_t tileX, size_t tileY)
+        {
+            size_t endX = std::min((tileX + 1) * TileSize, OutputWidth);
+            size_t endY = std::min((tileY + 1) * TileSize, OutputHeight);
 
-                if (left->pixelX > right->pixelX)
-                {
-                    Edge* temp = left;
-                    left = right;
-                    right = temp;
-                }
+            for (size_t y = tileY * TileSize; y < endY; y++)
+            {
+                std::fill(ZBuffer.begin() + y * OutputWidth + tileX * TileSize, ZBuffer.begin() + y * OutputWidth + endX, ClearDepth);
+            }
+
+            TileEpochs[tileY * TilesX + tileX] = FrameEpoch;
+        }
+
+        // Clears stale tiles under the triangle bounds, must be called before the triangle is rasterized into Z buffer.
+        void PrepareTiles(const Triangle& tr)
+        {
+            if (tr.minMax.pixelYBegin >= tr.minMax.pixelYEnd)
+            {
+                return;
+            }
+
+            float minX = std::min({ tr.positions[0].x, tr.positions[1].x, tr.positions[2].x });
+            float maxX = std::max({ tr.positions[0].x, tr.positions[1].x, tr.positions[2].x });
 
-                for (int32_t x = left->pixelX; x < right->pixelX; x++)
+            size_t beginTileX = static_cast<size_t>(floor(minX)) / TileSize;
+            size_t endTileX = std::min(static_cast<size_t>(ceil(maxX)) / TileSize, TilesX - 1);
+            size_t beginTileY = static_cast<size_t>(tr.minMax.pixelYBegin) / TileSize;
+            size_t endTileY = std::min(static_cast<size_t>(tr.minMax.pixelYEnd - 1) / TileSize, TilesY - 1);
+
+            for (size_t tileY = beginTileY; tileY <= endTileY; tileY++)
+            {
+                for (size_t tileX = beginTileX; tileX <= endTileX; tileX++)
                 {
-                    float percent = static_cast<float>(x - left->pixelX) / static_cast<float>(right->pixelX - left->pixelX);
-                    float z = Lerp(left->currentC[12], right->currentC[12], percent);
-                    if (z < ZBuffer[y * OutputWidth + x])
+                    if (!IsTileFresh(tileX, tileY))
                     {
-                        ZBuffer[y * OutputWidth + x] = z;
+                        ClearTile(tileX, tileY);
                     }
                 }
             }
         }
 
-        void FillGBuffer(Triangle& tr)
+        static float Lerp(float begin, float end, float lerpAmount)
         {
-            for (int32_t y = tr.minMax.pixelYBegin; y < tr.minMax.pixelYEnd; y++)
+            return begin + (end - begin) * lerpAmount;
+        }
+
+        void FillZBuffer(const Triangle& tr)
+        {
+            PrepareTiles(tr);
+            FillDepth(tr, ZBuffer.data(), OutputWidth, tr.minMax.pixelYBegin, tr.minMax.pixelYEnd);
+        }
+
+        // Depth only rasterization of the rows from beginY to endY into a depth buffer of the given width,
+        // shared by the Z buffer pass and the shadow map.
+        static void FillDepth(const Triangle& tr, float* depth, size_t width, int32_t beginY, int32_t endY)
+        {
+            for (int32_t y = std::max(tr.minMax.pixelYBegin, beginY); y < std::min(tr.minMax.pixelYEnd, endY); y++)
             {
-                Edge* left = &tr.minMax;
-                Edge* right = y >= tr.middleMax.pixelYBegin ? &tr.middleMax : &tr.minMiddle;
+                const Edge* left = &tr.minMax;
+                const Edge* right = y >= tr.middleMax.pixelYBegin ? &tr.middleMax : &tr.minMiddle;
 
-                left->CalculateC(tr.interpolants, y);
-                right->CalculateC(tr.interpolants, y);
+                int32_t leftX = left->GetPixelX(y);
+                int32_t rightX = right->GetPixelX(y);
 
-                if (left->pixelX > right->pixelX)
+                if (leftX > rightX)
                 {
-                    Edge* temp = left;
-                    left = right;
-                    right = temp;
+                    std::swap(left, right);
+                    std::swap(leftX, rightX);
                 }
 
-                for (int32_t x = left->pixelX; x < right->pixelX; x++)
+                float leftZ = left->CalculateC(tr.depth, leftX, y);
+                float rightZ = right->CalculateC(tr.depth, rightX, y);
+
+                for (int32_t x = leftX; x < rightX; x++)
                 {
-                    float percent = static_cast<float>(x - left->pixelX) / static_cast<float>(right->pixelX - left->pixelX);
-                    float z = Lerp(left->currentC[12], right->currentC[12], percent);
-                    if (z == ZBuffer[y * OutputWidth + x])
+                    float percent = static_cast<float>(x - leftX) / static_cast<float>(rightX - leftX);
+                    float z = Lerp(leftZ, rightZ, percent);
+                    if (z < depth[y * width + x])
                     {
-                        for (uint32_t i = 0; i < InterpolantsSize - 1; i++)
-                        {
-                            assert(GBuffer[y * OutputWidth + x][i] == 0.0f);
-                            GBuffer[y * OutputWidth + x][i] = Lerp(left->currentC[i], right->currentC[i], percent);
-                        }
-                        TBuffer[y * OutputWidth + x] = tr.texture;
-                        GBuffer[y * OutputWidth + x][12] = z;
+                        depth[y * width + x] = z;
                     }
                 }
             }
         }
 
-        void ShadePixels()
+        // Calculates interpolants of the layout attributes, 1/w is copied from the setup record.
+        template<typename Layout>
+        void SetupAttributes(const Triangle& tr, std::array<Interpolant, Layout::Size>& interpolants)
         {
-            auto r = std::ranges::iota_view<int32_t, int32_t>{ 0, static_cast<int32_t>(OutputWidth * OutputHeight) };
-            std::for_each(std::execution::par, r.begin(), r.end(), [this](int32_t i) {
-                std::array<float, InterpolantsSize>& interpolants_raw = GBuffer[i];
+            const Model& model = scene.models[0];
+
+            std::array<std::array<float, Layout::AttributesSize>, 3> source;
+            for (size_t i = 0; i < 3; i++)
+            {
+                const Vertex& v = model.vertices[model.indices[tr.sourceIndex * 3 + i]];
+
+                if constexpr (Layout::HasColor)
+                {
+                    Vec color = v.color.GetVec();
+                    source[i][Layout::Color + 0] = color.x;
+                    source[i][Layout::Color + 1] = color.y;
+                    source[i][Layout::Color + 2] = color.z;
+                }
+
+                if constexpr (Layout::HasTexCoord)
+                {
+                    source[i][Layout::TexCoord + 0] = v.textureCoord.x;
+                    source[i][Layout::TexCoord + 1] = v.textureCoord.y;
+                }
+
+                // This is possible because we do not do non-uniform scale in transform. If we are about to do non-uniform scale, we should calculate the normal matrix.
+                Vec normal = View * v.normal;
+                source[i][Layout::Normal + 0] = normal.x;
+                source[i][Layout::Normal + 1] = normal.y;
+                source[i][Layout::Normal + 2] = normal.z;
+
+                Vec posView = View * v.position;
+                source[i][Layout::PositionView + 0] = posView.x;
+                source[i][Layout::PositionView + 1] = posView.y;
+                source[i][Layout::PositionView + 2] = posView.z;
+            }
 
-                if (interpolants_raw[12] != 0.0f)
+            std::array<std::array<float, Layout::AttributesSize>, 3> values;
+            for (size_t k = 0; k < 3; k++)
+            {
+                const std::array<float, 3>& weights = tr.barycentrics[k];
+                for (size_t i = 0; i < Layout::AttributesSize; i++)
                 {
-                    float tintRed = interpolants_raw[0] / interpolants_raw[11];
-                    float tintGreen = interpolants_raw[1] / interpolants_raw[11];
-                    float tintBlue = interpolants_raw[2] / interpolants_raw[11];
+                    values[k][i] = weights[0] * source[0][i] + weights[1] * source[1][i] + weights[2] * source[2][i];
+                }
+            }
 
-                    float texX = interpolants_raw[3] / interpolants_raw[11];
-                    float texY = interpolants_raw[4] / interpolants_raw[11];
+            for (size_t i = 0; i < Layout::AttributesSize; i++)
+            {
+                interpolants[i] = Interpolant(
+                    { tr.positions[0].x, tr.positions[0].y, values[0][i] / tr.positions[0].w },
+                    { tr.positions[1].x, tr.positions[1].y, values[1][i] / tr.positions[1].w },
+                    { tr.positions[2].x, tr.positions[2].y, values[2][i] / tr.positions[2].w }
+                );
+            }
 
-                    float normalX = interpolants_raw[5] / interpolants_raw[11];
-                    float normalY = interpolants_raw[6] / interpolants_raw[11];
-                    float normalZ = interpolants_raw[7] / interpolants_raw[11];
+            interpolants[Layout::InverseW] = tr.inverseW;
+        }
 
-                    float viewX = interpolants_raw[8] / interpolants_raw[11];
-                    float viewY = interpolants_raw[9] / interpolants_raw[11];
-                    float viewZ = interpolants_raw[10] / interpolants_raw[11];
+        // With depth write the triangle is depth tested on its own, otherwise only pixels that won the Z buffer pass are written.
+        template<typename Layout, bool WriteDepth>
+        void FillGBuffer(const Triangle& tr)
+        {
+            if constexpr (WriteDepth)
+            {
+                PrepareTiles(tr);
+            }
 
-                    Vec pos_view{ viewX, viewY, viewZ, 1.0f };
-                    Vec normal_vec = normalize({ normalX, normalY, normalZ, 0.0f });
-                    Vec light_vec = normalize(light.position_view - pos_view);
+            std::array<Interpolant, Layout::Size> interpolants;
+            bool hasAttributes = false;
 
-                    Vec diffuse = light.light.color.GetVec() * static_cast<float>(std::max<float>(dot(normal_vec, light_vec), 0.0f));
-                    Vec ambient = light.light.color.GetVec() * light.light.ambientStrength;
+            for (int32_t y = tr.minMax.pixelYBegin; y < tr.minMax.pixelYEnd; y++)
+            {
+                const Edge* left = &tr.minMax;
+                const Edge* right = y >= tr.middleMax.pixelYBegin ? &tr.middleMax : &tr.minMiddle;
 
-                    float specAmount = static_cast<float>(std::max<float>(dot(normalize(pos_view), reflect(normal_vec, light_vec * -1.0f)), 0.0f));
-                    Vec specular = light.light.color.GetVec() * pow(specAmount, light.light.specularShininess) * light.light.specularStrength;
+                int32_t leftX = left->GetPixelX(y);
+                int32_t rightX = right->GetPixelX(y);
 
-                    Vec final_color{ tintRed, tintGreen, tintBlue, 1.0f };
-                    if (Textures.size() > 0)
-                    {
-                        uint32_t materialId = TBuffer[i];
-                        assert(Textures[materialId].GetHeight() > 0 && Textures[materialId].GetWidth() > 0);
+                if (leftX > rightX)
+                {
+                    std::swap(left, right);
+                    std::swap(leftX, rightX);
+                }
 
-                        // From 0 to TextureWidth - 1 (TextureWidth pixels in total)
-                        size_t textureX = static_cast<size_t>(texX * (Textures[materialId].GetWidth() - 1));
-                        // From 0 to TextureHeight - 1 (TextureHeight pixels in total)
-                        size_t textureY = static_cast<size_t>(texY * (Textures[materialId].GetHeight() - 1));
+                float leftZ = left->CalculateC(tr.depth, leftX, y);
+                float rightZ = right->CalculateC(tr.depth, rightX, y);
 
-                        textureY = (Textures[materialId].GetHeight() - 1) - textureY; // invert texture coords
+                // values of the interpolants on both ends of the span, calculated when the first pixel in the row is visible
+                std::array<float, Layout::Size> leftC;
+                std::array<float, Layout::Size> rightC;
+                bool hasRow = false;
 
-                        assert(textureY < Textures[materialId].GetHeight() && textureX < Textures[materialId].GetWidth());
-                        size_t texelBase = textureY * Textures[materialId].GetWidth() + textureX;
+                for (int32_t x = leftX; x < rightX; x++)
+                {
+                    float percent = static_cast<float>(x - leftX) / static_cast<float>(rightX - leftX);
+                    float z = Lerp(leftZ, rightZ, percent);
+                    if (WriteDepth ? z < ZBuffer[y * OutputWidth + x] : z == ZBuffer[y * OutputWidth + x])
+                    {
+                        if constexpr (WriteDepth)
+                        {
+                            ZBuffer[y * OutputWidth + x] = z;
+                        }
 
-                        final_color = Textures[materialId].GetColor(texelBase).GetVec();
-                    }
+                        if (!hasAttributes)
+                        {
+                            SetupAttributes<Layout>(tr, interpolants);
+                            hasAttributes = true;
+                        }
 
-                    final_color = (diffuse + ambient + specular) * final_color;
-                    final_color.x = std::clamp(final_color.x, 0.0f, 1.0f);
-                    final_color.y = std::clamp(final_color.y, 0.0f, 1.0f);
-                    final_color.z = std::clamp(final_color.z, 0.0f, 1.0f);
-                    final_color.w = 1.0f; // fix the alpha being affected by light, noticable only in tests, because in application we correct alpha manually when copying to backbuffer
+                        if (!hasRow)
+                        {
+                            for (uint32_t i = 0; i < Layout::Size; i++)
+                            {
+                                leftC[i] = left->CalculateC(interpolants[i], leftX, y);
+                                rightC[i] = right->CalculateC(interpolants[i], rightX, y);
+                            }
+                            hasRow = true;
+                        }
 
-                    assert(OutputWidth > 0);
-                    assert(OutputHeight > 0);
-                    size_t coefficient1 = OutputWidth * OutputHeight - OutputWidth;
-                    size_t coefficient2 = 2 * OutputWidth;
-                    BackBuffer[coefficient1 - (i / OutputWidth) * coefficient2 + i] = Color(final_color).rgba;
+                        for (uint32_t i = 0; i < Layout::Size; i++)
+                        {
+                            GetGBufferPlane(i)[y * OutputWidth + x] = Lerp(leftC[i], rightC[i], percent);
+                        }
+                        TBuffer[y * OutputWidth + x] = tr.texture;
+                    }
                 }
-            });
+            }
         }
 
-        VertexS Lerp(const VertexS& begin, const VertexS& end, float lerpAmount)
+        size_t GetTextureWidth(uint32_t materialId) const
         {
-            VertexS result;
-            result.v.position.x = Lerp(begin.v.position.x, end.v.position.x, lerpAmount);
-            result.v.position.y = Lerp(begin.v.position.y, end.v.position.y, lerpAmount);
-            result.v.position.z = Lerp(begin.v.position.z, end.v.position.z, lerpAmount);
-            result.v.position.w = Lerp(begin.v.position.w, end.v.position.w, lerpAmount);
-            result.pos_view.x = Lerp(begin.pos_view.x, end.pos_view.x, lerpAmount);
-            result.pos_view.y = Lerp(begin.pos_view.y, end.pos_view.y, lerpAmount);
-            result.pos_view.z = Lerp(begin.pos_view.z, end.pos_view.z, lerpAmount);
-            result.pos_view.w = Lerp(begin.pos_view.w, end.pos_view.w, lerpAmount);
-            result.v.textureCoord.x = Lerp(begin.v.textureCoord.x, end.v.textureCoord.x, lerpAmount);
-            result.v.textureCoord.y = Lerp(begin.v.textureCoord.y, end.v.textureCoord.y, lerpAmount);
-            result.red = Lerp(begin.red, end.red, lerpAmount);
-            result.green = Lerp(begin.green, end.green, lerpAmount);
-            result.blue = Lerp(begin.blue, end.blue, lerpAmount);
-            result.v.normal.x = Lerp(begin.v.normal.x, end.v.normal.x, lerpAmount);
-            result.v.normal.y = Lerp(begin.v.normal.y, end.v.normal.y, lerpAmount);
-            result.v.normal.z = Lerp(begin.v.normal.z, end.v.normal.z, lerpAmount);
-            result.v.normal.w = Lerp(begin.v.normal.w, end.v.normal.w, lerpAmount);
-            result.v.materialId = begin.v.materialId;
-            return result;
+            return MaterialTextures[materialId].rect.width;
         }
 
-        Interpolant GetInterpolant(std::vector<VertexS>& vertices, const std::function<float(const VertexS& v)>& c)
+        size_t GetTextureHeight(uint32_t materialId) const
         {
-            return Interpolant(
-                { vertices[0].v.position.x, vertices[0].v.position.y, c(vertices[0]) / vertices[0].v.position.w },
-                { vertices[1].v.position.x, vertices[1].v.position.y, c(vertices[1]) / vertices[1].v.position.w },
-                { vertices[2].v.position.x, vertices[2].v.position.y, c(vertices[2]) / vertices[2].v.position.w }
-            );
+            return MaterialTextures[materialId].rect.height;
         }
 
-        void AddRawTriangle(Triangle& tr)
+        Vec SampleTexture(uint32_t materialId, float texX, float texY) const
         {
-            assert(tr.vertices.size() == 3);
-
-            for (VertexS& v : tr.vertices)
+            const MaterialTexture& material = MaterialTextures[materialId];
+            if (VirtualTexturing)
             {
-                v.v.position.x /= v.v.position.w;
-                v.v.position.y /= v.v.position.w;
-                v.v.position.z /= v.v.position.w;
+                return SampleNearest(VirtualTextureView(VirtualPages, material.texture, 0), material.rect, texX, texY);
             }
 
-            std::sort(std::begin(tr.vertices), std::end(tr.vertices), [](const VertexS& lhs, const VertexS& rhs) { return lhs.v.position.y < rhs.v.position.y; });
+            return SampleNearest(TextureViews[material.texture][0], material.rect, texX, texY);
+        }
 
-            for (VertexS& v : tr.vertices)
-            {
-                // todo.pavelza: Clipping might result in some vertices being slightly outside of -1 to 1 range, so we clamp. Will need to think how to avoid this.
-                v.v.position.x = std::clamp(v.v.position.x, -1.0f, 1.0f);
-                v.v.position.y = std::clamp(v.v.position.y, -1.0f, 1.0f);
-                v.v.position.z = std::clamp(v.v.position.z, -1.0f, 1.0f);
+        // Texels of the level within the rect of level 0, rects in atlases start at multiples of their size in the levels they have.
+        static TextureRect GetMipRect(const TextureRect& rect, size_t level)
+        {
+            return { rect.x >> level, rect.y >> level, std::max<size_t>(rect.width >> level, 1), std::max<size_t>(rect.height >> level, 1) };
+        }
 
-                v.v.position.x = (OutputWidth - 1) * ((v.v.position.x + 1) / 2.0f);
-                v.v.position.y = (OutputHeight - 1) * ((v.v.position.y + 1) / 2.0f);
-            }
+        template<typename View>
+        static Vec SampleNearest(const View& texture, const TextureRect& rect, float texX, float texY)
+        {
+            assert(rect.height > 0 && rect.width > 0);
 
-            tr.interpolants[0] = GetInterpolant(tr.vertices, [](const VertexS& v) { return v.red; });
-            tr.interpolants[1] = GetInterpolant(tr.vertices, [](const VertexS& v) { return v.green; });
-            tr.interpolants[2] = GetInterpolant(tr.vertices, [](const VertexS& v) { return v.blue; });
+            // From 0 to TextureWidth - 1 (TextureWidth pixels in total)
+            size_t textureX = static_cast<size_t>(texX * (rect.width - 1));
+            // From 0 to TextureHeight - 1 (TextureHeight pixels in total)
+            size_t textureY = static_cast<size_t>(texY * (rect.height - 1));
 
-            tr.interpolants[3] = GetInterpolant(tr.vertices, [](const VertexS& v) { return v.v.textureCoord.x; });
-            tr.interpolants[4] = GetInterpolant(tr.vertices, [](const VertexS& v) { return v.v.textureCoord.y; });
+            textureY = (rect.height - 1) - textureY; // invert texture coords
+
+            assert(textureY < rect.height && textureX < rect.width);
+            return texture.GetTexel(rect.x + textureX, rect.y + textureY);
+        }
+
+        // Texel centers are at half integer coordinates, texels outside of the rect repeat its edge, so textures in an atlas don't bleed.
+        template<typename View>
+        static Vec SampleBilinear(const View& texture, const TextureRect& rect, float texX, float texY)
+        {
+            float x = texX * rect.width - 0.5f;
+            float y = (1.0f - texY) * rect.height - 0.5f; // invert texture coords
+            float floorX = floor(x);
+            float floorY = floor(y);
+            float fractionX = x - floorX;
+            float fractionY = y - floorY;
+
+            int32_t lastX = static_cast<int32_t>(rect.width) - 1;
+            int32_t lastY = static_cast<int32_t>(rect.height) - 1;
+            size_t x0 = rect.x + std::clamp(static_cast<int32_t>(floorX), 0, lastX);
+            size_t y0 = rect.y + std::clamp(static_cast<int32_t>(floorY), 0, lastY);
+            size_t x1 = rect.x + std::min(std::max(static_cast<int32_t>(floorX) + 1, 0), lastX);
+            size_t y1 = rect.y + std::min(std::max(static_cast<int32_t>(floorY) + 1, 0), lastY);
+
+            Vec topLeft = texture.GetTexel(x0, y0);
+            Vec bottomLeft = texture.GetTexel(x0, y1);
+            Vec top = topLeft + (texture.GetTexel(x1, y0) - topLeft) * fractionX;
+            Vec bottom = bottomLeft + (texture.GetTexel(x1, y1) - bottomLeft) * fractionX;
+            return top + (bottom - top) * fractionY;
+        }
 
-            tr.interpolants[5] = GetInterpolant(tr.vertices, [](const VertexS& v) { return v.v.normal.x; });
-            tr.interpolants[6] = GetInterpolant(tr.vertices, [](const VertexS& v) { return v.v.normal.y; });
-            tr.interpolants[7] = GetInterpolant(tr.vertices, [](const VertexS& v) { return v.v.normal.z; });
+        Vec SampleTextureFiltered(uint32_t materialId, float texX, float texY, float lod) const
+        {
+            const MaterialTexture& material = MaterialTextures[materialId];
+            if (VirtualTexturing)
+            {
+                auto getMip = [this, &material](size_t level) { return VirtualTextureView(VirtualPages, material.texture, level); };
+                return SampleMips(getMip, material, texX, texY, lod);
+            }
 
-            tr.interpolants[8] = GetInterpolant(tr.vertices, [](const VertexS& v) { return v.pos_view.x; });
-            tr.interpolants[9] = GetInterpolant(tr.vertices, [](const VertexS& v) { return v.pos_view.y; });
-            tr.interpolants[10] = GetInterpolant(tr.vertices, [](const VertexS& v) { return v.pos_view.z; });
+            const std::vector<TextureView>& mips = TextureViews[material.texture];
+            auto getMip = [&mips](size_t level) -> const TextureView& { return mips[level]; };
+            return SampleMips(getMip, material, texX, texY, lod);
+        }
 
-            tr.interpolants[11] = GetInterpolant(tr.vertices, [](const VertexS& v) { return 1.0f; });
+        template<typename GetMip>
+        Vec SampleMips(const GetMip& getMip, const MaterialTexture& material, float texX, float texY, float lod) const
+        {
+            lod = std::min(lod, static_cast<float>(material.mipCount - 1));
 
-            // No division by w, because it is already divided by w.
-            tr.interpolants[12] = Interpolant(
-                { tr.vertices[0].v.position.x, tr.vertices[0].v.position.y, tr.vertices[0].v.position.z },
-                { tr.vertices[1].v.position.x, tr.vertices[1].v.position.y, tr.vertices[1].v.position.z },
-                { tr.vertices[2].v.position.x, tr.vertices[2].v.position.y, tr.vertices[2].v.position.z });
+            if (Filter == TextureFilter::Bilinear)
+            {
+                size_t level = static_cast<size_t>(lod + 0.5f);
+                return SampleBilinear(getMip(level), GetMipRect(material.rect, level), texX, texY);
+            }
 
-            tr.texture = tr.vertices[0].v.materialId;
+            size_t level = static_cast<size_t>(lod);
+            float blend = lod - level;
+            Vec color = SampleBilinear(getMip(level), GetMipRect(material.rect, level), texX, texY);
+            if (blend > 0.0f)
+            {
+                color = color + (SampleBilinear(getMip(level + 1), GetMipRect(material.rect, level + 1), texX, texY) - color) * blend;
+            }
 
-            tr.minMax = Edge(tr.vertices[0].v.position, tr.vertices[2].v.position, true);
-            tr.minMiddle = Edge(tr.vertices[0].v.position, tr.vertices[1].v.position, true);
-            tr.middleMax = Edge(tr.vertices[1].v.position, tr.vertices[2].v.position, false);
+            return color;
         }
 
-        static bool IsVertexInside(const VertexS& point, int32_t axis, int32_t plane)
+        // Level of detail from the texture coordinate differences to the other pixels of the 2x2 quad, 0 when the texture is magnified.
+        // A neighbour without the material doesn't count, so edges of a surface only use the other direction.
+        template<typename Permutation, typename Float>
+        Float GetTextureLod(size_t begin, uint32_t material, Float texX, Float texY, Float covered)
         {
-            return point.v.position.Get(axis) * plane <= point.v.position.w;
+            using Layout = typename Permutation::Attributes;
+
+            const Float zero = Float::Broadcast(0.0f);
+            const Float one = Float::Broadcast(1.0f);
+            const Float width = Float::Broadcast(static_cast<float>(GetTextureWidth(material)));
+            const Float height = Float::Broadcast(static_cast<float>(GetTextureHeight(material)));
+
+            // spans start at even x, so horizontal neighbours are in the same register
+            Float horizontal = And(covered, SwapAdjacent(covered));
+            Float dxU = And(horizontal, (SwapAdjacent(texX) - texX) * width);
+            Float dxV = And(horizontal, (SwapAdjacent(texY) - texY) * height);
+
+            size_t y = begin / OutputWidth;
+            size_t neighbourY = (y ^ 1) < OutputHeight ? y ^ 1 : y;
+            size_t neighbour = neighbourY * OutputWidth + begin % OutputWidth;
+
+            Float vertical = And(NotEqual(Float::Load(&ZBuffer[neighbour]), Float::Broadcast(ClearDepth)), Float::LoadEqual(&TBuffer[neighbour], material));
+            vertical = And(covered, vertical);
+            Float neighbourInverseW = Float::Load(GetGBufferPlane(Layout::InverseW) + neighbour);
+            Float dyU = And(vertical, (Float::Load(GetGBufferPlane(Layout::TexCoord + 0) + neighbour) / neighbourInverseW - texX) * width);
+            Float dyV = And(vertical, (Float::Load(GetGBufferPlane(Layout::TexCoord + 1) + neighbour) / neighbourInverseW - texY) * height);
+
+            // log2 of the longer derivative is half of log2 of its squared length
+            Float lengthSquared = Max(dxU * dxU + dxV * dxV, dyU * dyU + dyV * dyV);
+            return Max(Log2<Permutation::Accuracy>(Max(lengthSquared, one)) * Float::Broadcast(0.5f), zero);
         }
 
-        // todo.pavelza: There is an issue somewhere - we render black 1px line on the border sometimes when the triangle is outside of frustum (compared to dx12 renderer).
-        // And after introducing the backface culling we can sometimes see pixels from some triangles on the back in the first left 1px line.
-        // Looks like front triangle is clipped not precisely by frustum.
-        void ClipTrianglePlane(std::vector<VertexS>& vertices, int32_t axis, int32_t plane)
+        template<typename Permutation>
+        float GetTextureLod(size_t pixel, uint32_t material)
         {
-            std::vector<VertexS> result;
-            size_t previousElement = vertices.size() - 1;
-
-            for (size_t currentElement = 0; currentElement < vertices.size(); currentElement++)
-            {
-                bool isPreviousInside = IsVertexInside(vertices[previousElement], axis, plane);
-                bool isCurrentInside = IsVertexInside(vertices[currentElement], axis, plane);
+            using Layout = typename Permutation::Attributes;
 
-                if (isPreviousInside != isCurrentInside)
+            auto getTexCoord = [this, material](size_t i, float& texX, float& texY) {
+                if (ZBuffer[i] == ClearDepth || TBuffer[i] != material)
                 {
-                    float k = (vertices[previousElement].v.position.w - vertices[previousElement].v.position.Get(axis) * plane);
-                    float lerpAmount = k / (k - vertices[currentElement].v.position.w + vertices[currentElement].v.position.Get(axis) * plane);
-                    result.push_back(Lerp(vertices[previousElement], vertices[currentElement], lerpAmount));
+                    return false;
                 }
 
-                if (isCurrentInside)
-                {
-                    result.push_back(vertices[currentElement]);
-                }
+                float inverseW = GetGBufferPlane(Layout::InverseW)[i];
+                texX = GetGBufferPlane(Layout::TexCoord + 0)[i] / inverseW;
+                texY = GetGBufferPlane(Layout::TexCoord + 1)[i] / inverseW;
+                return true;
+            };
 
-                previousElement = currentElement;
+            float width = static_cast<float>(GetTextureWidth(material));
+            float height = static_cast<float>(GetTextureHeight(material));
+            size_t x = pixel % OutputWidth;
+            size_t y = pixel / OutputWidth;
+
+            float texX = 0.0f;
+            float texY = 0.0f;
+            getTexCoord(pixel, texX, texY);
+
+            float neighbourX = 0.0f;
+            float neighbourY = 0.0f;
+            float lengthSquared = 0.0f;
+            if ((x ^ 1) < OutputWidth && getTexCoord(y * OutputWidth + (x ^ 1), neighbourX, neighbourY))
+            {
+                float du = (neighbourX - texX) * width;
+                float dv = (neighbourY - texY) * height;
+                lengthSquared = du * du + dv * dv;
+            }
+
+            if ((y ^ 1) < OutputHeight && getTexCoord((y ^ 1) * OutputWidth + x, neighbourX, neighbourY))
+            {
+                float du = (neighbourX - texX) * width;
+                float dv = (neighbourY - texY) * height;
+                lengthSquared = std::max(lengthSquared, du * du + dv * dv);
             }
 
-            swap(vertices, result);
+            return std::max(Log2<Permutation::Accuracy>(std::max(lengthSquared, 1.0f)) * 0.5f, 0.0f);
         }
 
-        bool ClipTriangleAxis(std::vector<VertexS>& vertices, int32_t axis)
+        // Rows x, y and z of the result are the light's right, up and backward directions, like in ViewTransform.
+        static Matrix LookAt(const Vec& eye, const Vec& target)
         {
-            ClipTrianglePlane(vertices, axis, 1);
-
-            if (vertices.size() == 0)
+            Vec backward = normalize(Vec{ eye.x - target.x, eye.y - target.y, eye.z - target.z, 0.0f });
+            Vec up = std::abs(backward.y) < 0.99f ? Vec{ 0.0f, 1.0f, 0.0f, 0.0f } : Vec{ 0.0f, 0.0f, 1.0f, 0.0f };
+            Vec right = normalize(cross(up, backward));
+            up = cross(backward, right);
+
+            Matrix m;
+            const Vec* rows[] = { &right, &up, &backward };
+            for (size_t row = 0; row < 3; row++)
             {
-                return false;
+                m.m[row * 4 + 0] = rows[row]->x;
+                m.m[row * 4 + 1] = rows[row]->y;
+                m.m[row * 4 + 2] = rows[row]->z;
+                m.m[row * 4 + 3] = -(rows[row]->x * eye.x + rows[row]->y * eye.y + rows[row]->z * eye.z);
             }
 
-            ClipTrianglePlane(vertices, axis, -1);
+            m.m[12] = 0.0f;
+            m.m[13] = 0.0f;
+            m.m[14] = 0.0f;
+            m.m[15] = 1.0f;
 
-            return vertices.size() != 0;
+            return m;
         }
 
-        void AddTriangle(Triangle& tr, const Matrix& transform, std::vector<Triangle>& trianglesCache)
+        // Renders the shadow map of the main light through the depth only rasterization, unless the cached one is still valid.
+        // The model is the same as long as its buffers and its version are, so checking the cache doesn't touch the vertices.
+        // Triangles are set up and rasterized a chunk at a time in the frame arena. Returns false when the budget can't fit a chunk.
+        bool UpdateShadowMap(size_t resolution)
         {
-            for (VertexS& v : tr.vertices)
+            if (resolution == 0)
             {
-                v.v.position = PerspectiveTransform(scene.camera, static_cast<float>(OutputWidth), static_cast<float>(OutputHeight)) * transform * v.v.position;
-                v.pos_view = transform * v.pos_view;
-                // This is possible because we do not do non-uniform scale in transform. If we are about to do non-uniform scale, we should calculate the normal matrix.
-                v.v.normal = transform * v.v.normal;
+                Shadows.depth = {};
+                Shadows.resolution = 0;
+                Shadows.valid = false;
+                return true;
             }
 
-            // Backface culling produces very rough results in view space (maybe need to figure out why some day). So we do it in clip space. And it seems to be the right (identical to hardware) way.
-            // Doing clipspace culling before we split triangles that penetrate camera frustum gives us additional ~10ms gain for a frame in reference scene.
-            // Front is counter clockwise.
-            Vec v0 { tr.vertices[0].v.position.x / tr.vertices[0].v.position.w, tr.vertices[0].v.position.y / tr.vertices[0].v.position.w, tr.vertices[0].v.position.z / tr.vertices[0].v.position.w, 1.0f };
-            Vec v1 { tr.vertices[1].v.position.x / tr.vertices[1].v.position.w, tr.vertices[1].v.position.y / tr.vertices[1].v.position.w, tr.vertices[1].v.position.z / tr.vertices[1].v.position.w, 1.0f };
-            Vec v2 { tr.vertices[2].v.position.x / tr.vertices[2].v.position.w, tr.vertices[2].v.position.y / tr.vertices[2].v.position.w, tr.vertices[2].v.position.z / tr.vertices[2].v.position.w, 1.0f };
-            if (cross(v2 - v0, v1 - v0).z > 0)
+            const Model& model = scene.models[0];
+            if (Shadows.resolution == resolution && Shadows.lightPosition == scene.light.position && Shadows.vertices == model.vertices.data() &&
+                Shadows.vertexCount == model.vertices.size() && Shadows.indexCount == model.indices.size() && Shadows.modelVersion == model.version)
             {
-                return;
+                return true;
             }
 
-            // We must check that all triangle lies on outside of one of the planes,
-            // since if we check that some vertices lie on the outside of one plane and others on outside of the other,
-            // then part of the triangle might still be visible.
-            std::array<bool, 6> planesToOutsideness { false };
-            for (const VertexS& v : tr.vertices)
+            Shadows.resolution = resolution;
+            Shadows.lightPosition = scene.light.position;
+            Shadows.vertices = model.vertices.data();
+            Shadows.vertexCount = model.vertices.size();
+            Shadows.indexCount = model.indices.size();
+            Shadows.modelVersion = model.version;
+            Shadows.valid = false;
+
+            if (model.vertices.empty())
             {
-                planesToOutsideness[0] |= IsVertexInside(v, 0, 1);
-                planesToOutsideness[1] |= IsVertexInside(v, 1, 1);
-                planesToOutsideness[2] |= IsVertexInside(v, 2, 1);
-                planesToOutsideness[3] |= IsVertexInside(v, 0, -1);
-                planesToOutsideness[4] |= IsVertexInside(v, 1, -1);
-                planesToOutsideness[5] |= IsVertexInside(v, 2, -1);
+                return true;
             }
 
-            // This check doesn't give us a big performance boost in a general case,
-            // but it doesn't seem to hit performance in general case too much to remove it either.
-            if (std::any_of(planesToOutsideness.begin(), planesToOutsideness.end(), [](bool val) { return !val; }))
+            Vec boundsMin{ FLT_MAX, FLT_MAX, FLT_MAX, 1.0f };
+            Vec boundsMax{ -FLT_MAX, -FLT_MAX, -FLT_MAX, 1.0f };
+            for (const Vertex& v : model.vertices)
             {
-                return;
+                for (int32_t axis = 0; axis < 3; axis++)
+                {
+                    boundsMin.Set(axis, std::min(boundsMin.Get(axis), v.position.Get(axis)));
+                    boundsMax.Set(axis, std::max(boundsMax.Get(axis), v.position.Get(axis)));
+                }
             }
 
-            if (std::all_of(tr.vertices.begin(), tr.vertices.end(), [](const VertexS& v){ return IsVertexInside(v, 0, 1) && IsVertexInside(v, 1, 1) && IsVertexInside(v, 2, 1) && IsVertexInside(v, 0, -1) && IsVertexInside(v, 1, -1) && IsVertexInside(v, 2, -1); }))
+            Vec center = (boundsMin + boundsMax) * 0.5f;
+            center.w = 1.0f;
+            Vec extent = boundsMax - boundsMin;
+            float radius = 0.5f * sqrt(extent.x * extent.x + extent.y * extent.y + extent.z * extent.z);
+
+            Vec toCenter = center - scene.light.position;
+            float distance = sqrt(toCenter.x * toCenter.x + toCenter.y * toCenter.y + toCenter.z * toCenter.z);
+            if (distance <= radius * 1.01f)
             {
-                AddRawTriangle(tr);
-                trianglesCache.push_back(std::move(tr));
-                return;
+                LOG("Light is inside of the model bounds, shadow map is not rendered.");
+                return true;
             }
 
-            std::vector<VertexS> vertices = std::move(tr.vertices);
-            if (ClipTriangleAxis(vertices, 0) && ClipTriangleAxis(vertices, 1) && ClipTriangleAxis(vertices, 2))
+            // PerspectiveTransform takes half of the field of view in degrees.
+            Camera lightCamera;
+            lightCamera.nearPlane = distance - radius;
+            lightCamera.farPlane = distance + radius;
+            lightCamera.fieldOfView = asinf(radius / distance) * 180.0f / static_cast<float>(M_PI);
+
+            Shadows.lightViewProjection = PerspectiveTransform(lightCamera, 1.0f, 1.0f) * LookAt(scene.light.position, center);
+            Shadows.texelSize = 2.0f * lightCamera.farPlane * (radius / sqrt(distance * distance - radius * radius)) / resolution;
+
+            PERF_START("Shadow map");
+            // a triangle clipped by all the planes turns into a fan of MaxClippedVertices - 2 triangles
+            constexpr size_t MaxTrianglesPerClip = MaxClippedVertices - 2;
+            arena.SetStage("Shadow map");
+            TriangleBatch batch = AllocateTriangleBatch(ShadowChunkSize);
+            if (batch.capacity < MaxTrianglesPerClip)
             {
-                assert(vertices.size() >= 3);
+                arena.Rewind(batch.marker);
+                PERF_END();
 
-                for (size_t i = 2; i < vertices.size(); i++)
-                {
-                    Triangle newTr;
-                    newTr.vertices.resize(3);
+                // tried again next frame
+                Shadows.resolution = 0;
+                return false;
+            }
+
+            Shadows.depth.assign(resolution * resolution, ClearDepth);
+
+            // Bands of rows are rasterized in parallel, every band goes over the triangles of the chunk that overlap it.
+            // The depth test keeps the nearest depth whatever the order of the triangles is, so chunks give the same map.
+            size_t bandsCount = (resolution + TileSize - 1) / TileSize;
+            auto flush = [this, resolution, bandsCount, &batch]() {
+                auto r = std::ranges::iota_view<size_t, size_t>{ 0, bandsCount };
+                std::for_each(std::execution::par, r.begin(), r.end(), [this, resolution, &batch](size_t band) {
+                    int32_t beginY = static_cast<int32_t>(band * TileSize);
+                    int32_t endY = static_cast<int32_t>(std::min((band + 1) * TileSize, resolution));
+                    for (size_t i = 0; i < batch.size; i++)
+                    {
+                        const Triangle& tr = batch.triangles[i];
+                        if (tr.minMax.pixelYBegin < endY && tr.minMax.pixelYEnd > beginY)
+                        {
+                            FillDepth(tr, Shadows.depth.data(), resolution, beginY, endY);
+                        }
+                    }
+                });
 
-                    newTr.vertices[0] = vertices[0];
-                    newTr.vertices[1] = vertices[i - 1];
-                    newTr.vertices[2] = vertices[i];
+                batch.size = 0;
+            };
 
-                    AddRawTriangle(newTr);
-                    trianglesCache.push_back(std::move(newTr));
+            for (uint32_t index = 0; index < model.indices.size() / 3; index++)
+            {
+                if (batch.capacity - batch.size < MaxTrianglesPerClip)
+                {
+                    flush();
                 }
+
+                ClipTriangle(index, Shadows.lightViewProjection, [this, index, resolution, &batch](std::array<VertexS, 3>& vertices) {
+                    batch.triangles[batch.size++] = SetupTriangle(vertices, index, resolution, resolution);
+                });
             }
+
+            flush();
+            arena.Rewind(batch.marker);
+            PERF_END();
+
+            Utils::MemoryCounter::GetInstance().Set("Shadow map", Shadows.depth.size() * sizeof(float));
+
+            Shadows.valid = true;
+            Shadows.renderCount++;
+            return true;
         }
 
-        void GetTriangleFromModel(uint32_t index, const Model& model, Triangle& triangle)
+        // Fraction of the main light that reaches the view space positions of the covered lanes, filtered over 3x3 shadow map texels.
+        // Lanes that fall outside of the map are lit.
+        template<typename Float>
+        Float GetShadow(Float viewX, Float viewY, Float viewZ, Float normalX, Float normalY, Float normalZ, uint32_t coveredBits) const
         {
-            triangle.vertices.resize(3);
+            const Float one = Float::Broadcast(1.0f);
+            const Float half = Float::Broadcast(0.5f);
+            const float* m = ViewToShadowMap.m;
+
+            Float offset = Float::Broadcast(Shadows.texelSize * ShadowNormalOffset);
+            Float positionX = viewX + normalX * offset;
+            Float positionY = viewY + normalY * offset;
+            Float positionZ = viewZ + normalZ * offset;
+
+            Float clipX = Float::Broadcast(m[0]) * positionX + Float::Broadcast(m[1]) * positionY + Float::Broadcast(m[2]) * positionZ + Float::Broadcast(m[3]);
+            Float clipY = Float::Broadcast(m[4]) * positionX + Float::Broadcast(m[5]) * positionY + Float::Broadcast(m[6]) * positionZ + Float::Broadcast(m[7]);
+            Float clipZ = Float::Broadcast(m[8]) * positionX + Float::Broadcast(m[9]) * positionY + Float::Broadcast(m[10]) * positionZ + Float::Broadcast(m[11]);
+            Float clipW = Float::Broadcast(m[12]) * positionX + Float::Broadcast(m[13]) * positionY + Float::Broadcast(m[14]) * positionZ + Float::Broadcast(m[15]);
+
+            // the same viewport transform as in SetupTriangle, rounded to the nearest texel
+            Float scale = Float::Broadcast(static_cast<float>(Shadows.resolution - 1));
+            alignas(32) float texelsX[Float::Width];
+            alignas(32) float texelsY[Float::Width];
+            alignas(32) float depths[Float::Width];
+            alignas(32) float ws[Float::Width];
+            Floor(scale * ((clipX / clipW + one) * half) + half).Store(texelsX);
+            Floor(scale * ((clipY / clipW + one) * half) + half).Store(texelsY);
+            (clipZ / clipW).Store(depths);
+            clipW.Store(ws);
+
+            int32_t last = static_cast<int32_t>(Shadows.resolution) - 1;
+            alignas(32) float shadows[Float::Width];
+            for (size_t lane = 0; lane < Float::Width; lane++)
+            {
+                shadows[lane] = 1.0f;
 
-            const Vertex& a = model.vertices[model.indices[index * 3 + 0]];
-            const Vertex& b = model.vertices[model.indices[index * 3 + 1]];
-            const Vertex& c = model.vertices[model.indices[index * 3 + 2]];
+                // checked as floats first, converting an infinity or a NaN to an integer is undefined
+                bool inside = texelsX[lane] >= 0.0f && texelsY[lane] >= 0.0f && texelsX[lane] <= static_cast<float>(last) && texelsY[lane] <= static_cast<float>(last);
+                if ((coveredBits & (1u << lane)) == 0 || !(ws[lane] > 0.0f) || !(depths[lane] <= 1.0f) || !inside)
+                {
+                    continue;
+                }
 
-            triangle.vertices[0] = VertexS{
-                a,
-                a.position,
-                a.color.GetVec().x,
-                a.color.GetVec().y,
-                a.color.GetVec().z
-            };
+                int32_t centerX = static_cast<int32_t>(texelsX[lane]);
+                int32_t centerY = static_cast<int32_t>(texelsY[lane]);
 
-            triangle.vertices[1] = VertexS{
-                b,
-                b.position,
-                b.color.GetVec().x,
-                b.color.GetVec().y,
-                b.color.GetVec().z
-            };
+                uint32_t lit = 0;
+                for (int32_t dy = -1; dy <= 1; dy++)
+                {
+                    const float* row = Shadows.depth.data() + std::clamp(centerY + dy, 0, last) * Shadows.resolution;
+                    lit += depths[lane] <= row[std::max(centerX - 1, 0)] ? 1 : 0;
+                    lit += depths[lane] <= row[centerX] ? 1 : 0;
+                    lit += depths[lane] <= row[std::min(centerX + 1, last)] ? 1 : 0;
+                }
 
-            triangle.vertices[2] = VertexS{
-                c,
-                c.position,
-                c.color.GetVec().x,
-                c.color.GetVec().y,
-                c.color.GetVec().z
-            };
+                shadows[lane] = lit / 9.0f;
+            }
+
+            return Float::Load(shadows);
         }
-    };
 
-    bool SceneRendererSoftware::Render(const Scene& scene, Texture& texture)
-    {
-        if (texture.GetWidth() == 0 || texture.GetHeight() == 0)
+        // Scalar version computes a single SSE lane, so it gives the same result as the SIMD version.
+        float GetShadow(const Vec& pos_view, const Vec& normal_view) const
         {
-            return false;
+            return GetShadow(Float4::Broadcast(pos_view.x), Float4::Broadcast(pos_view.y), Float4::Broadcast(pos_view.z),
+                Float4::Broadcast(normal_view.x), Float4::Broadcast(normal_view.y), Float4::Broadcast(normal_view.z), 1u).GetFirst();
         }
 
-        if (context == nullptr || context->scene.name != scene.name)
+        std::ranges::subrange<const uint32_t*> GetTileLights(size_t pixel) const
         {
-            context = std::make_shared<SceneRendererSoftwareContext>(scene);
+            size_t x = pixel % OutputWidth;
+            size_t y = pixel / OutputWidth;
+            size_t tile = (y / LightTileSize) * LightTilesX + x / LightTileSize;
+            const uint32_t* begin = TileLightIndices + TileLightOffsets[tile];
+            return { begin, begin + TileLightCounts[tile] };
         }
 
-        context->OutputWidth = texture.GetWidth();
-        context->OutputHeight = texture.GetHeight();
-
-        PERF_START("Clean buffers");
-        context->BackBuffer.resize(context->OutputWidth * context->OutputHeight);
-        context->ZBuffer.resize(context->OutputWidth * context->OutputHeight);
-        context->GBuffer.resize(context->OutputWidth * context->OutputHeight);
-        context->TBuffer.resize(context->OutputWidth * context->OutputHeight);
-
-        std::fill(context->BackBuffer.begin(), context->BackBuffer.end(), Color::Black.rgba);
-        std::fill(context->ZBuffer.begin(), context->ZBuffer.end(), 2.0f);
-        std::fill(context->TBuffer.begin(), context->TBuffer.end(), 0u);
-        PERF_END();
+        // Finds the lights that reach the geometry of each light tile. The tile volume is the part of the tile frustum
+        // between the nearest and the farthest depth of the tile, so a light in front of or behind the geometry is skipped
+        // even if it covers the tile on screen. A light without a radius reaches every tile with geometry.
+        // The light indices are stored per tile in the frame arena, the lights of every tile are counted in a first pass and
+        // written in a second one. Returns false when the budget can't fit them.
+        bool CullLights()
+        {
+            if (Lights.empty())
+            {
+                return true;
+            }
 
-        PERF_START("Clean G buffers");
-        auto r = std::ranges::iota_view<size_t, size_t>{ 0, context->GBuffer.size() };
-        std::for_each(std::execution::par, r.begin(), r.end(), [this](size_t i) { std::fill(context->GBuffer[i].begin(), context->GBuffer[i].end(), 0.0f); });
-        PERF_END();
+            size_t tilesCount = LightTilesX * LightTilesY;
+            arena.SetStage("Light tiles");
+            TileLightOffsets = arena.Allocate<uint32_t>(tilesCount);
+            TileLightCounts = arena.Allocate<uint32_t>(tilesCount);
+            if (TileLightOffsets == nullptr || TileLightCounts == nullptr)
+            {
+                return false;
+            }
 
-        PERF_START("Light transform");
-        // calculate light's position in view space
-        context->light.position_view = ViewTransform(scene.camera) * scene.light.position;
-        context->light.light = scene.light;
-        PERF_END();
+            auto r = std::ranges::iota_view<size_t, size_t>{ 0, tilesCount };
+            std::for_each(std::execution::par, r.begin(), r.end(), [this](size_t tile) {
+                TileLightCounts[tile] = 0;
+                ForEachTileLight(tile, [this, tile](uint32_t) { TileLightCounts[tile]++; });
+            });
 
-        PERF_START("Materials");
-        if (context->Textures.size() == 0)
-        {
-            context->Textures.resize(scene.models[0].materials.size());
-            for (size_t i = 0; i < context->Textures.size(); i++)
+            uint32_t total = 0;
+            for (size_t tile = 0; tile < tilesCount; tile++)
             {
-                Load(scene.models[0].materials[i].textureName, context->Textures[i]);
+                TileLightOffsets[tile] = total;
+                total += TileLightCounts[tile];
             }
-        }
-        PERF_END();
 
-        PERF_START("Triangle cache");
-        const Model& model = scene.models[0];
+            TileLightIndices = arena.Allocate<uint32_t>(total);
+            if (TileLightIndices == nullptr)
+            {
+                return false;
+            }
 
-        static std::vector<Triangle> trianglesCache;
-        trianglesCache.reserve(model.indices.size() / 3 * 2);
-        trianglesCache.clear();
-        PERF_END();
+            std::for_each(std::execution::par, r.begin(), r.end(), [this](size_t tile) {
+                uint32_t* indices = TileLightIndices + TileLightOffsets[tile];
+                ForEachTileLight(tile, [&indices](uint32_t index) { *indices++ = index; });
+            });
 
-        PERF_START("Add triangles");
-        for (uint32_t i = 0; i < model.indices.size() / 3; i++)
-        {
-            Triangle triangle;
-            context->GetTriangleFromModel(i, model, triangle);
-            context->AddTriangle(triangle, ViewTransform(scene.camera), trianglesCache);
+            return true;
         }
-        PERF_END();
 
-        PERF_START("ZBuffer");
-        for (Triangle& tr : trianglesCache)
+        // Calls the function with the index of every light that reaches the geometry of the tile, in order.
+        template<typename Function>
+        void ForEachTileLight(size_t tile, Function&& function) const
         {
-            context->FillZBuffer(tr);
-        }
-        PERF_END();
+            size_t tileX = tile % LightTilesX;
+            size_t tileY = tile / LightTilesX;
+            if (!IsTileFresh(tileX * LightTileSize / TileSize, tileY * LightTileSize / TileSize))
+            {
+                return;
+            }
 
-        PERF_START("GBuffer");
-        std::for_each(std::execution::par, trianglesCache.begin(), trianglesCache.end(), [this](Triangle& tr) { context->FillGBuffer(tr); });
-        PERF_END();
+            size_t beginX = tileX * LightTileSize;
+            size_t beginY = tileY * LightTileSize;
+            size_t endX = std::min(beginX + LightTileSize, OutputWidth);
+            size_t endY = std::min(beginY + LightTileSize, OutputHeight);
 
-        PERF_START("Shading");
-        context->ShadePixels();
+            float minDepth = ClearDepth;
+            float maxDepth = -ClearDepth;
+            for (size_t y = beginY; y < endY; y++)
+            {
+                for (size_t x = beginX; x < endX; x++)
+                {
+                    float depth = ZBuffer[y * OutputWidth + x];
+                    if (depth != ClearDepth)
+                    {
+                        minDepth = std::min(minDepth, depth);
+                        maxDepth = std::max(maxDepth, depth);
+                    }
+                }
+            }
+
+            if (minDepth > maxDepth)
+            {
+                return;
+            }
+
+            // Inverse of the z row of the projection, view z is negative.
+            float nearZ = -Projection.m[11] / (minDepth + Projection.m[10]);
+            float farZ = -Projection.m[11] / (maxDepth + Projection.m[10]);
+
+            // Pixel centers back to normalized device coordinates, the inverse of the viewport transform in AddRawTriangle,
+            // then to view space at both depths, the box holds every pixel of the tile within the depth range.
+            float width = static_cast<float>(std::max<size_t>(OutputWidth - 1, 1));
+            float height = static_cast<float>(std::max<size_t>(OutputHeight - 1, 1));
+            float ndcMinX = 2.0f * beginX / width - 1.0f;
+            float ndcMaxX = 2.0f * (endX - 1) / width - 1.0f;
+            float ndcMinY = 2.0f * beginY / height - 1.0f;
+            float ndcMaxY = 2.0f * (endY - 1) / height - 1.0f;
+
+            Vec boxMin{ std::min(ndcMinX * -nearZ, ndcMinX * -farZ) / Projection.m[0], std::min(ndcMinY * -nearZ, ndcMinY * -farZ) / Projection.m[5], farZ, 1.0f };
+            Vec boxMax{ std::max(ndcMaxX * -nearZ, ndcMaxX * -farZ) / Projection.m[0], std::max(ndcMaxY * -nearZ, ndcMaxY * -farZ) / Projection.m[5], nearZ, 1.0f };
+
+            for (uint32_t index = 0; index < Lights.size(); index++)
+            {
+                const LightS& pointLight = Lights[index];
+                if (pointLight.light.radius > 0.0f)
+                {
+                    const Vec& center = pointLight.position_view;
+                    float dx = center.x - std::clamp(center.x, boxMin.x, boxMax.x);
+                    float dy = center.y - std::clamp(center.y, boxMin.y, boxMax.y);
+                    float dz = center.z - std::clamp(center.z, boxMin.z, boxMax.z);
+                    if (dx * dx + dy * dy + dz * dz > pointLight.light.radius * pointLight.light.radius)
+                    {
+                        continue;
+                    }
+                }
+
+                function(index);
+            }
+        }
+
+        // Light of a point light at the pixel, the light fades out smoothly towards its radius.
+        template<typename Permutation>
+        Vec ShadePointLight(const LightS& pointLight, const Vec& pos_view, const Vec& normal_vec)
+        {
+            Vec to_light = pointLight.position_view - pos_view;
+            float attenuation = std::max<float>(1.0f - dot(to_light, to_light) * pointLight.inverseRadiusSquared, 0.0f);
+            attenuation *= attenuation;
+
+            Vec light_vec = Normalize<Permutation::Accuracy>(to_light);
+            float amount = std::max<float>(dot(normal_vec, light_vec), 0.0f) + pointLight.light.ambientStrength;
+            if constexpr (Permutation::HasSpecular)
+            {
+                float specAmount = std::max<float>(dot(Normalize<Permutation::Accuracy>(pos_view), reflect(normal_vec, light_vec * -1.0f)), 0.0f);
+                amount += Pow<Permutation::Accuracy>(specAmount, pointLight.light.specularShininess) * pointLight.light.specularStrength;
+            }
+
+            return pointLight.light.color.GetVec() * (amount * attenuation);
+        }
+
+        // SIMD version of ShadePointLight, adds the light to the color channels.
+        template<typename Permutation, typename Float>
+        void ShadePointLight(const LightS& pointLight, Float viewX, Float viewY, Float viewZ, Float normalX, Float normalY, Float normalZ, Float& red, Float& green, Float& blue)
+        {
+            const Float zero = Float::Broadcast(0.0f);
+            const Float one = Float::Broadcast(1.0f);
+
+            Float lightX = Float::Broadcast(pointLight.position_view.x) - viewX;
+            Float lightY = Float::Broadcast(pointLight.position_view.y) - viewY;
+            Float lightZ = Float::Broadcast(pointLight.position_view.z) - viewZ;
+            Float distanceSquared = lightX * lightX + lightY * lightY + lightZ * lightZ;
+
+            Float attenuation = Max(one - distanceSquared * Float::Broadcast(pointLight.inverseRadiusSquared), zero);
+            attenuation = attenuation * attenuation;
+
+            Float lightNorm = Rsqrt<Permutation::Accuracy>(distanceSquared);
+            lightX = lightX * lightNorm;
+            lightY = lightY * lightNorm;
+            lightZ = lightZ * lightNorm;
+
+            Float amount = Max(normalX * lightX + normalY * lightY + normalZ * lightZ, zero) + Float::Broadcast(pointLight.light.ambientStrength);
+            if constexpr (Permutation::HasSpecular)
+            {
+                Float scale = (zero - lightX * normalX - lightY * normalY - lightZ * normalZ) / (normalX * normalX + normalY * normalY + normalZ * normalZ);
+                Float reflectedX = zero - ((zero - lightX) - normalX * scale * Float::Broadcast(2.0f));
+                Float reflectedY = zero - ((zero - lightY) - normalY * scale * Float::Broadcast(2.0f));
+                Float reflectedZ = zero - ((zero - lightZ) - normalZ * scale * Float::Broadcast(2.0f));
+
+                Float viewNorm = Rsqrt<Permutation::Accuracy>(viewX * viewX + viewY * viewY + viewZ * viewZ + one);
+                Float specAmount = Max((viewX * viewNorm) * reflectedX + (viewY * viewNorm) * reflectedY + (viewZ * viewNorm) * reflectedZ, zero);
+                amount = amount + Pow<Permutation::Accuracy>(specAmount, Float::Broadcast(pointLight.light.specularShininess)) * Float::Broadcast(pointLight.light.specularStrength);
+            }
+
+            amount = amount * attenuation;
+
+            const Vec& lightColor = pointLight.light.color.GetVec();
+            red = red + Float::Broadcast(lightColor.x) * amount;
+            green = green + Float::Broadcast(lightColor.y) * amount;
+            blue = blue + Float::Broadcast(lightColor.z) * amount;
+        }
+
+        // Scalar reference of the shading, used for the pixels that don't fill a whole SIMD register.
+        template<typename Permutation>
+        Vec ShadePixel(size_t i)
+        {
+            using Layout = typename Permutation::Attributes;
+
+            if (ZBuffer[i] == ClearDepth)
+            {
+                return Color::Black.GetVec();
+            }
+
+            float inverseW = GetGBufferPlane(Layout::InverseW)[i];
+
+            float normalX = GetGBufferPlane(Layout::Normal + 0)[i] / inverseW;
+            float normalY = GetGBufferPlane(Layout::Normal + 1)[i] / inverseW;
+            float normalZ = GetGBufferPlane(Layout::Normal + 2)[i] / inverseW;
+
+            float viewX = GetGBufferPlane(Layout::PositionView + 0)[i] / inverseW;
+            float viewY = GetGBufferPlane(Layout::PositionView + 1)[i] / inverseW;
+            float viewZ = GetGBufferPlane(Layout::PositionView + 2)[i] / inverseW;
+
+            Vec pos_view{ viewX, viewY, viewZ, 1.0f };
+            Vec normal_vec = Normalize<Permutation::Accuracy>({ normalX, normalY, normalZ, 0.0f });
+            Vec light_vec = Normalize<Permutation::Accuracy>(light.position_view - pos_view);
+
+            float shadow = Shadows.valid ? GetShadow(pos_view, normal_vec) : 1.0f;
+
+            Vec diffuse = light.light.color.GetVec() * static_cast<float>(std::max<float>(dot(normal_vec, light_vec), 0.0f));
+            Vec ambient = light.light.color.GetVec() * light.light.ambientStrength;
+            if (Shadows.valid)
+            {
+                diffuse = diffuse * shadow;
+            }
+
+            Vec lighting = diffuse + ambient;
+            if constexpr (Permutation::HasSpecular)
+            {
+                float specAmount = static_cast<float>(std::max<float>(dot(Normalize<Permutation::Accuracy>(pos_view), reflect(normal_vec, light_vec * -1.0f)), 0.0f));
+                Vec specular = light.light.color.GetVec() * Pow<Permutation::Accuracy>(specAmount, light.light.specularShininess) * light.light.specularStrength;
+                if (Shadows.valid)
+                {
+                    specular = specular * shadow;
+                }
+                lighting = lighting + specular;
+            }
+
+            if (!Lights.empty())
+            {
+                for (uint32_t index : GetTileLights(i))
+                {
+                    lighting = lighting + ShadePointLight<Permutation>(Lights[index], pos_view, normal_vec);
+                }
+            }
+
+            Vec final_color = SingleColor.GetVec();
+            if constexpr (Layout::HasColor)
+            {
+                float tintRed = GetGBufferPlane(Layout::Color + 0)[i] / inverseW;
+                float tintGreen = GetGBufferPlane(Layout::Color + 1)[i] / inverseW;
+                float tintBlue = GetGBufferPlane(Layout::Color + 2)[i] / inverseW;
+                final_color = { tintRed, tintGreen, tintBlue, 1.0f };
+            }
+
+            if constexpr (Layout::HasTexCoord)
+            {
+                float texX = GetGBufferPlane(Layout::TexCoord + 0)[i] / inverseW;
+                float texY = GetGBufferPlane(Layout::TexCoord + 1)[i] / inverseW;
+                final_color = Filter == TextureFilter::Nearest ? SampleTexture(TBuffer[i], texX, texY) : SampleTextureFiltered(TBuffer[i], texX, texY, GetTextureLod<Permutation>(i, TBuffer[i]));
+            }
+
+            final_color = lighting * final_color;
+
+            if constexpr (Permutation::HasToneMapping)
+            {
+                final_color.x = final_color.x / (1.0f + final_color.x);
+                final_color.y = final_color.y / (1.0f + final_color.y);
+                final_color.z = final_color.z / (1.0f + final_color.z);
+            }
+
+            final_color.w = 1.0f; // fix the alpha being affected by light, noticable only in tests, because in application we correct alpha manually when copying to backbuffer
+
+            // Clamping is done by the batch conversion.
+            return final_color;
+        }
+
+        // SIMD version of ShadePixel for the pixels of the material among Float::Width consecutive pixels starting at begin,
+        // the result goes straight to the back buffer, other pixels are not touched.
+        // Operations follow the scalar code one to one, so with exact math the only differences come from the compiler contracting scalar
+        // multiplies and adds into FMA, the output stays within 1/255 per channel of the scalar reference.
+        template<typename Permutation, typename Float>
+        void ShadeLanes(size_t begin, uint32_t material)
+        {
+            using Layout = typename Permutation::Attributes;
+
+            const Float zero = Float::Broadcast(0.0f);
+            const Float one = Float::Broadcast(1.0f);
+
+            Float covered = NotEqual(Float::Load(&ZBuffer[begin]), Float::Broadcast(ClearDepth));
+            if constexpr (Layout::HasTexCoord)
+            {
+                covered = And(covered, Float::LoadEqual(&TBuffer[begin], material));
+            }
+
+            uint32_t coveredBits = GetMaskBits(covered);
+            Float inverseW = Float::Load(GetGBufferPlane(Layout::InverseW) + begin);
+
+            Float normalX = Float::Load(GetGBufferPlane(Layout::Normal + 0) + begin) / inverseW;
+            Float normalY = Float::Load(GetGBufferPlane(Layout::Normal + 1) + begin) / inverseW;
+            Float normalZ = Float::Load(GetGBufferPlane(Layout::Normal + 2) + begin) / inverseW;
+
+            Float viewX = Float::Load(GetGBufferPlane(Layout::PositionView + 0) + begin) / inverseW;
+            Float viewY = Float::Load(GetGBufferPlane(Layout::PositionView + 1) + begin) / inverseW;
+            Float viewZ = Float::Load(GetGBufferPlane(Layout::PositionView + 2) + begin) / inverseW;
+
+            Float normalNorm = Rsqrt<Permutation::Accuracy>(normalX * normalX + normalY * normalY + normalZ * normalZ);
+            normalX = normalX * normalNorm;
+            normalY = normalY * normalNorm;
+            normalZ = normalZ * normalNorm;
+
+            // view position has w equal to 1
+            Float lightX = Float::Broadcast(light.position_view.x) - viewX;
+            Float lightY = Float::Broadcast(light.position_view.y) - viewY;
+            Float lightZ = Float::Broadcast(light.position_view.z) - viewZ;
+            Float lightW = Float::Broadcast(light.position_view.w - 1.0f);
+            Float lightNorm = Rsqrt<Permutation::Accuracy>(lightX * lightX + lightY * lightY + lightZ * lightZ + lightW * lightW);
+            lightX = lightX * lightNorm;
+            lightY = lightY * lightNorm;
+            lightZ = lightZ * lightNorm;
+            lightW = lightW * lightNorm;
+
+            Float diffuseAmount = Max(normalX * lightX + normalY * lightY + normalZ * lightZ, zero);
+
+            Float shadow = one;
+            if (Shadows.valid)
+            {
+                shadow = GetShadow(viewX, viewY, viewZ, normalX, normalY, normalZ, coveredBits);
+                diffuseAmount = diffuseAmount * shadow;
+            }
+
+            const Vec& lightColor = light.light.color.GetVec();
+            Float red = Float::Broadcast(lightColor.x) * diffuseAmount + Float::Broadcast(lightColor.x * light.light.ambientStrength);
+            Float green = Float::Broadcast(lightColor.y) * diffuseAmount + Float::Broadcast(lightColor.y * light.light.ambientStrength);
+            Float blue = Float::Broadcast(lightColor.z) * diffuseAmount + Float::Broadcast(lightColor.z * light.light.ambientStrength);
+
+            if constexpr (Permutation::HasSpecular)
+            {
+                // reflect(normal, -light), normal has unit length
+                Float scale = (zero - lightX * normalX - lightY * normalY - lightZ * normalZ) / (normalX * normalX + normalY * normalY + normalZ * normalZ);
+                Float reflectedX = zero - ((zero - lightX) - normalX * scale * Float::Broadcast(2.0f));
+                Float reflectedY = zero - ((zero - lightY) - normalY * scale * Float::Broadcast(2.0f));
+                Float reflectedZ = zero - ((zero - lightZ) - normalZ * scale * Float::Broadcast(2.0f));
+
+                Float viewNorm = Rsqrt<Permutation::Accuracy>(viewX * viewX + viewY * viewY + viewZ * viewZ + one);
+                Float specAmount = Max((viewX * viewNorm) * reflectedX + (viewY * viewNorm) * reflectedY + (viewZ * viewNorm) * reflectedZ, zero);
+                specAmount = Pow<Permutation::Accuracy>(specAmount, Float::Broadcast(light.light.specularShininess));
+                if (Shadows.valid)
+                {
+                    specAmount = specAmount * shadow;
+                }
+
+                red = red + Float::Broadcast(lightColor.x) * specAmount * Float::Broadcast(light.light.specularStrength);
+                green = green + Float::Broadcast(lightColor.y) * specAmount * Float::Broadcast(light.light.specularStrength);
+                blue = blue + Float::Broadcast(lightColor.z) * specAmount * Float::Broadcast(light.light.specularStrength);
+            }
+
+            if (!Lights.empty())
+            {
+                for (uint32_t index : GetTileLights(begin))
+                {
+                    ShadePointLight<Permutation>(Lights[index], viewX, viewY, viewZ, normalX, normalY, normalZ, red, green, blue);
+                }
+            }
+
+            if constexpr (Layout::HasTexCoord)
+            {
+                Float texX = Float::Load(GetGBufferPlane(Layout::TexCoord + 0) + begin) / inverseW;
+                Float texY = Float::Load(GetGBufferPlane(Layout::TexCoord + 1) + begin) / inverseW;
+
+                alignas(32) float texXs[Float::Width];
+                alignas(32) float texYs[Float::Width];
+                texX.Store(texXs);
+                texY.Store(texYs);
+
+                alignas(32) float lods[Float::Width];
+                if (Filter != TextureFilter::Nearest)
+                {
+                    GetTextureLod<Permutation>(begin, material, texX, texY, covered).Store(lods);
+                }
+
+                alignas(32) float texelRed[Float::Width];
+                alignas(32) float texelGreen[Float::Width];
+                alignas(32) float texelBlue[Float::Width];
+                for (size_t lane = 0; lane < Float::Width; lane++)
+                {
+                    Vec texel;
+                    if ((coveredBits & (1u << lane)) != 0)
+                    {
+                        texel = Filter == TextureFilter::Nearest ? SampleTexture(material, texXs[lane], texYs[lane]) : SampleTextureFiltered(material, texXs[lane], texYs[lane], lods[lane]);
+                    }
+                    texelRed[lane] = texel.x;
+                    texelGreen[lane] = texel.y;
+                    texelBlue[lane] = texel.z;
+                }
+
+                red = red * Float::Load(texelRed);
+                green = green * Float::Load(texelGreen);
+                blue = blue * Float::Load(texelBlue);
+            }
+            else if constexpr (Layout::HasColor)
+            {
+                red = red * (Float::Load(GetGBufferPlane(Layout::Color + 0) + begin) / inverseW);
+                green = green * (Float::Load(GetGBufferPlane(Layout::Color + 1) + begin) / inverseW);
+                blue = blue * (Float::Load(GetGBufferPlane(Layout::Color + 2) + begin) / inverseW);
+            }
+            else
+            {
+                red = red * Float::Broadcast(SingleColor.GetVec().x);
+                green = green * Float::Broadcast(SingleColor.GetVec().y);
+                blue = blue * Float::Broadcast(SingleColor.GetVec().z);
+            }
+
+            if constexpr (Permutation::HasToneMapping)
+            {
+                red = red / (one + red);
+                green = green / (one + green);
+                blue = blue / (one + blue);
+            }
+
+            StoreRGBA8(red, green, blue, covered, &BackBuffer[begin]);
+        }
+
+        // Calls the function once for every material the covered lanes of the span have, without textures for the first material.
+        template<typename Layout, typename Float, typename Function>
+        void ForEachSpanMaterial(size_t span, Function&& function)
+        {
+            uint32_t coveredBits = GetMaskBits(NotEqual(Float::Load(&ZBuffer[span]), Float::Broadcast(ClearDepth)));
+            if (coveredBits == 0)
+            {
+                return;
+            }
+
+            if constexpr (!Layout::HasTexCoord)
+            {
+                function(0u);
+            }
+            else
+            {
+                std::array<uint32_t, Float::Width> materials;
+                size_t materialsCount = 0;
+                for (size_t lane = 0; lane < Float::Width; lane++)
+                {
+                    uint32_t material = TBuffer[span + lane];
+                    if ((coveredBits & (1u << lane)) != 0 && std::find(materials.begin(), materials.begin() + materialsCount, material) == materials.begin() + materialsCount)
+                    {
+                        materials[materialsCount++] = material;
+                        function(material);
+                    }
+                }
+            }
+        }
+
+        // Counts the spans BinSpans puts into every work list of the band.
+        template<typename Permutation, typename Float>
+        void CountSpans(size_t tileY, uint32_t* counts)
+        {
+            using Layout = typename Permutation::Attributes;
+
+            size_t endY = std::min((tileY + 1) * TileSize, OutputHeight);
+            for (size_t y = tileY * TileSize; y < endY; y++)
+            {
+                for (size_t tileX = 0; tileX < TilesX; tileX++)
+                {
+                    if (!IsTileFresh(tileX, tileY))
+                    {
+                        continue;
+                    }
+
+                    size_t begin = y * OutputWidth + tileX * TileSize;
+                    size_t count = std::min(TileSize, OutputWidth - tileX * TileSize);
+                    for (size_t i = 0; i + Float::Width <= count; i += Float::Width)
+                    {
+                        ForEachSpanMaterial<Layout, Float>(begin + i, [counts](uint32_t material) { counts[material]++; });
+                    }
+                }
+            }
+        }
+
+        // Fills the work lists of the band with spans of Float::Width pixels that have the material, a span goes to every material it has.
+        // The list of a material starts at spans + begins[material] and has room for the spans CountSpans counted, counts are zero on entry.
+        // Without a list the spans are shaded right away.
+        // Spans without geometry are made black right away and pixels that don't fill a span are shaded here.
+        template<typename Permutation, typename Float>
+        void BinSpans(size_t tileY, uint32_t* spans, const uint32_t* begins, uint32_t* counts)
+        {
+            using Layout = typename Permutation::Attributes;
+
+            const uint32_t black = ToRGBA8(Color::Black);
+            size_t endY = std::min((tileY + 1) * TileSize, OutputHeight);
+
+            for (size_t y = tileY * TileSize; y < endY; y++)
+            {
+                for (size_t tileX = 0; tileX < TilesX; tileX++)
+                {
+                    size_t x = tileX * TileSize;
+                    size_t count = std::min(TileSize, OutputWidth - x);
+                    size_t begin = y * OutputWidth + x;
+
+                    if (!IsTileFresh(tileX, tileY))
+                    {
+                        // Nothing was rasterized into the tile, depth and G data are stale and not read.
+                        std::fill(BackBuffer.begin() + begin, BackBuffer.begin() + begin + count, black);
+                        continue;
+                    }
+
+                    size_t i = 0;
+                    for (; i + Float::Width <= count; i += Float::Width)
+                    {
+                        size_t span = begin + i;
+                        std::fill(BackBuffer.begin() + span, BackBuffer.begin() + span + Float::Width, black);
+
+                        ForEachSpanMaterial<Layout, Float>(span, [this, span, spans, begins, counts](uint32_t material) {
+                            if (spans != nullptr)
+                            {
+                                spans[begins[material] + counts[material]++] = static_cast<uint32_t>(span);
+                            }
+                            else
+                            {
+                                ShadeLanes<Permutation, Float>(span, material);
+                            }
+                        });
+                    }
+
+                    std::array<Vec, Float::Width> colors;
+                    for (size_t j = i; j < count; j++)
+                    {
+                        colors[j - i] = ShadePixel<Permutation>(begin + j);
+                    }
+
+                    ConvertFloatToRGBA8(colors.data(), reinterpret_cast<uint8_t*>(&BackBuffer[begin + i]), count - i);
+                }
+            }
+        }
+
+        // Feedback pass of virtual texturing, every band records the pages of the texels its pixels are going to sample, then the pages
+        // are made resident before any pixel is shaded. Filtered lookups request the two levels around the level of detail, so
+        // small differences between the scalar and the SIMD level of detail don't turn into page faults.
+        template<typename Permutation>
+        void RequestPages()
+        {
+            using Layout = typename Permutation::Attributes;
+
+            // Every band gets room for as many keys as there are pages, plus some, in the frame arena. A full band sorts and dedups
+            // its keys to make room, a band that still has no room drops the rest of its requests, they become page faults.
+            size_t bandPixels = TileSize * OutputWidth;
+            size_t capacity = std::min(bandPixels * MaxPageRequestsPerPixel, VirtualPages.GetPageCount() + PageRequestsSlack);
+            capacity = std::min(capacity, arena.GetAvailable() / (TilesY * (sizeof(uint64_t) + sizeof(size_t))));
+
+            arena.SetStage("Page requests");
+            size_t* counts = arena.Allocate<size_t>(TilesY);
+            uint64_t* pages = capacity >= MaxPageRequestsPerPixel ? arena.Allocate<uint64_t>(TilesY * capacity) : nullptr;
+            if (counts == nullptr || pages == nullptr)
+            {
+                LOG("Frame memory budget of " << arena.GetCapacity() << " bytes can't fit the page requests, no pages are made resident.");
+                VirtualPages.Update(nullptr, 0);
+                return;
+            }
+
+            auto r = std::ranges::iota_view<size_t, size_t>{ 0, TilesY };
+            std::for_each(std::execution::par, r.begin(), r.end(), [this, pages, counts, capacity](size_t tileY) {
+                uint64_t* requests = pages + tileY * capacity;
+                size_t& count = counts[tileY];
+                count = 0;
+
+                auto compact = [requests, &count]() {
+                    std::sort(requests, requests + count);
+                    count = std::unique(requests, requests + count) - requests;
+                };
+
+                // neighbouring pixels mostly sample the same pages
+                auto request = [requests, capacity, &count, &compact](uint32_t material, size_t level, size_t x, size_t y) {
+                    uint64_t key = VirtualTextures::GetPageKey(material, level, x, y);
+                    if (count > 0 && requests[count - 1] == key)
+                    {
+                        return;
+                    }
+
+                    if (count == capacity)
+                    {
+                        compact();
+                    }
+
+                    if (count < capacity)
+                    {
+                        requests[count++] = key;
+                    }
+                };
+
+                // the texels SampleBilinear reads
+                auto requestFootprint = [this, &request](uint32_t material, size_t level, float texX, float texY) {
+                    int32_t lastX = static_cast<int32_t>(VirtualPages.GetWidth(material, level)) - 1;
+                    int32_t lastY = static_cast<int32_t>(VirtualPages.GetHeight(material, level)) - 1;
+                    float floorX = floor(texX * (lastX + 1) - 0.5f);
+                    float floorY = floor((1.0f - texY) * (lastY + 1) - 0.5f);
+                    for (int32_t y : { static_cast<int32_t>(floorY), static_cast<int32_t>(floorY) + 1 })
+                    {
+                        for (int32_t x : { static_cast<int32_t>(floorX), static_cast<int32_t>(floorX) + 1 })
+                        {
+                            request(material, level, std::clamp(x, 0, lastX), std::clamp(y, 0, lastY));
+                        }
+                    }
+                };
+
+                size_t endY = std::min((tileY + 1) * TileSize, OutputHeight);
+                for (size_t y = tileY * TileSize; y < endY; y++)
+                {
+                    for (size_t tileX = 0; tileX < TilesX; tileX++)
+                    {
+                        if (!IsTileFresh(tileX, tileY))
+                        {
+                            continue;
+                        }
+
+                        size_t endX = std::min((tileX + 1) * TileSize, OutputWidth);
+                        for (size_t i = y * OutputWidth + tileX * TileSize; i < y * OutputWidth + endX; i++)
+                        {
+                            if (ZBuffer[i] == ClearDepth)
+                            {
+                                continue;
+                            }
+
+                            uint32_t material = TBuffer[i];
+                            float inverseW = GetGBufferPlane(Layout::InverseW)[i];
+                            float texX = GetGBufferPlane(Layout::TexCoord + 0)[i] / inverseW;
+                            float texY = GetGBufferPlane(Layout::TexCoord + 1)[i] / inverseW;
+
+                            if (Filter == TextureFilter::Nearest)
+                            {
+                                // the texel SampleTexture reads
+                                size_t width = VirtualPages.GetWidth(material, 0);
+                                size_t height = VirtualPages.GetHeight(material, 0);
+                                request(material, 0, static_cast<size_t>(texX * (width - 1)), (height - 1) - static_cast<size_t>(texY * (height - 1)));
+                                continue;
+                            }
+
+                            size_t mipCount = VirtualPages.GetMipCount(material);
+                            size_t level = std::min(static_cast<size_t>(GetTextureLod<Permutation>(i, material)), mipCount - 1);
+                            requestFootprint(material, level, texX, texY);
+                            if (level + 1 < mipCount)
+                            {
+                                requestFootprint(material, level + 1, texX, texY);
+                            }
+                        }
+                    }
+                }
+
+                compact();
+            });
+
+            // bands are moved next to each other, pages requested by several bands are left to Update
+            size_t total = 0;
+            for (size_t tileY = 0; tileY < TilesY; tileY++)
+            {
+                std::memmove(pages + total, pages + tileY * capacity, counts[tileY] * sizeof(uint64_t));
+                total += counts[tileY];
+            }
+            VirtualPages.Update(pages, total);
+        }
+
+        // Shading runs band by band in parallel, inside of a band material by material, so only one texture is hot at a time
+        // and pixels without geometry cost nothing.
+        template<typename Permutation>
+        void ShadePixels()
+        {
+            assert(OutputWidth > 0);
+            assert(OutputHeight > 0);
+
+            if constexpr (Permutation::Attributes::HasTexCoord)
+            {
+                if (VirtualTexturing)
+                {
+                    RequestPages<Permutation>();
+                }
+            }
+
+            // Work lists of all the bands are in the frame arena. Spans of every band and material are counted first, then as many bands
+            // as the budget fits are binned and shaded at a time. A band that doesn't fit is shaded in pixel order.
+            size_t materialsCount = std::max<size_t>(scene.models[0].materials.size(), 1);
+            arena.SetStage("Material spans");
+            FrameArena::Marker marker = arena.GetMarker();
+            uint32_t* order = arena.Allocate<uint32_t>(materialsCount);
+            uint32_t* counts = arena.Allocate<uint32_t>(TilesY * materialsCount);
+            uint32_t* begins = arena.Allocate<uint32_t>(TilesY * materialsCount);
+
+            auto r = std::ranges::iota_view<size_t, size_t>{ 0, TilesY };
+            if (order == nullptr || counts == nullptr || begins == nullptr)
+            {
+                arena.Rewind(marker);
+                std::for_each(std::execution::par, r.begin(), r.end(), [this](size_t tileY) { BinSpans<Permutation, FloatLanes>(tileY, nullptr, nullptr, nullptr); });
+                return;
+            }
+
+            // materials sharing a texture are shaded one after another
+            std::iota(order, order + materialsCount, 0u);
+            if (MaterialTextures.size() == materialsCount)
+            {
+                std::sort(order, order + materialsCount, [this](uint32_t lhs, uint32_t rhs) {
+                    return std::make_pair(MaterialTextures[lhs].texture, lhs) < std::make_pair(MaterialTextures[rhs].texture, rhs);
+                });
+            }
+
+            std::fill(counts, counts + TilesY * materialsCount, 0u);
+            std::for_each(std::execution::par, r.begin(), r.end(), [this, counts, materialsCount](size_t tileY) {
+                CountSpans<Permutation, FloatLanes>(tileY, counts + tileY * materialsCount);
+            });
+
+            for (size_t groupBegin = 0; groupBegin < TilesY;)
+            {
+                FrameArena::Marker groupMarker = arena.GetMarker();
+                size_t room = arena.GetAvailable() / sizeof(uint32_t);
+
+                size_t groupEnd = groupBegin;
+                size_t total = 0;
+                for (; groupEnd < TilesY; groupEnd++)
+                {
+                    size_t bandTotal = std::accumulate(counts + groupEnd * materialsCount, counts + (groupEnd + 1) * materialsCount, size_t(0));
+                    if (groupEnd > groupBegin && total + bandTotal > room)
+                    {
+                        break;
+                    }
+
+                    for (size_t material = 0; material < materialsCount; material++)
+                    {
+                        begins[groupEnd * materialsCount + material] = static_cast<uint32_t>(total);
+                        total += counts[groupEnd * materialsCount + material];
+                    }
+                }
+
+                uint32_t* spans = total <= room ? arena.Allocate<uint32_t>(total) : nullptr;
+                std::fill(counts + groupBegin * materialsCount, counts + groupEnd * materialsCount, 0u);
+
+                auto group = std::ranges::iota_view<size_t, size_t>{ groupBegin, groupEnd };
+                std::for_each(std::execution::par, group.begin(), group.end(), [this, spans, begins, counts, order, materialsCount](size_t tileY) {
+                    const uint32_t* bandBegins = begins + tileY * materialsCount;
+                    uint32_t* bandCounts = counts + tileY * materialsCount;
+                    BinSpans<Permutation, FloatLanes>(tileY, spans, bandBegins, bandCounts);
+
+                    if (spans != nullptr)
+                    {
+                        for (const uint32_t* material = order; material < order + materialsCount; material++)
+                        {
+                            for (uint32_t i = 0; i < bandCounts[*material]; i++)
+                            {
+                                ShadeLanes<Permutation, FloatLanes>(spans[bandBegins[*material] + i], *material);
+                            }
+                        }
+                    }
+                });
+
+                arena.Rewind(groupMarker);
+                groupBegin = groupEnd;
+            }
+
+            arena.Rewind(marker);
+        }
+
+        VertexS Lerp(const VertexS& begin, const VertexS& end, float lerpAmount)
+        {
+            VertexS result;
+            result.position.x = Lerp(begin.position.x, end.position.x, lerpAmount);
+            result.position.y = Lerp(begin.position.y, end.position.y, lerpAmount);
+            result.position.z = Lerp(begin.position.z, end.position.z, lerpAmount);
+            result.position.w = Lerp(begin.position.w, end.position.w, lerpAmount);
+            result.barycentric[0] = Lerp(begin.barycentric[0], end.barycentric[0], lerpAmount);
+            result.barycentric[1] = Lerp(begin.barycentric[1], end.barycentric[1], lerpAmount);
+            result.barycentric[2] = Lerp(begin.barycentric[2], end.barycentric[2], lerpAmount);
+            return result;
+        }
+
+        template<typename Layout>
+        void AddRawTriangle(std::array<VertexS, 3>& vertices, uint32_t sourceIndex, TriangleBatch& batch)
+        {
+            AddTriangleToBatch<Layout>(SetupTriangle(vertices, sourceIndex, OutputWidth, OutputHeight), batch);
+        }
+
+        // Sets up a clipped triangle for rasterization into a viewport of the given size.
+        Triangle SetupTriangle(std::array<VertexS, 3>& vertices, uint32_t sourceIndex, size_t width, size_t height) const
+        {
+            for (VertexS& v : vertices)
+            {
+                v.position.x /= v.position.w;
+                v.position.y /= v.position.w;
+                v.position.z /= v.position.w;
+            }
+
+            std::sort(std::begin(vertices), std::end(vertices), [](const VertexS& lhs, const VertexS& rhs) { return lhs.position.y < rhs.position.y; });
+
+            Triangle tr;
+            tr.sourceIndex = sourceIndex;
+            tr.texture = scene.models[0].vertices[scene.models[0].indices[sourceIndex * 3]].materialId;
+
+            for (size_t i = 0; i < 3; i++)
+            {
+                Vec& position = vertices[i].position;
+
+                // todo.pavelza: Clipping might result in some vertices being slightly outside of -1 to 1 range, so we clamp. Will need to think how to avoid this.
+                position.x = std::clamp(position.x, -1.0f, 1.0f);
+                position.y = std::clamp(position.y, -1.0f, 1.0f);
+                position.z = std::clamp(position.z, -1.0f, 1.0f);
+
+                position.x = (width - 1) * ((position.x + 1) / 2.0f);
+                position.y = (height - 1) * ((position.y + 1) / 2.0f);
+
+                tr.positions[i] = position;
+                tr.barycentrics[i] = vertices[i].barycentric;
+            }
+
+            tr.inverseW = Interpolant(
+                { tr.positions[0].x, tr.positions[0].y, 1.0f / tr.positions[0].w },
+                { tr.positions[1].x, tr.positions[1].y, 1.0f / tr.positions[1].w },
+                { tr.positions[2].x, tr.positions[2].y, 1.0f / tr.positions[2].w });
+
+            // No division by w, because it is already divided by w.
+            tr.depth = Interpolant(
+                { tr.positions[0].x, tr.positions[0].y, tr.positions[0].z },
+                { tr.positions[1].x, tr.positions[1].y, tr.positions[1].z },
+                { tr.positions[2].x, tr.positions[2].y, tr.positions[2].z });
+
+            tr.minMax = Edge(tr.positions[0], tr.positions[2], true);
+            tr.minMiddle = Edge(tr.positions[0], tr.positions[1], true);
+            tr.middleMax = Edge(tr.positions[1], tr.positions[2], false);
+
+            return tr;
+        }
+
+        static bool IsVertexInside(const VertexS& point, int32_t axis, int32_t plane)
+        {
+            return point.position.Get(axis) * plane <= point.position.w;
+        }
+
+        // todo.pavelza: There is an issue somewhere - we render black 1px line on the border sometimes when the triangle is outside of frustum (compared to dx12 renderer).
+        // And after introducing the backface culling we can sometimes see pixels from some triangles on the back in the first left 1px line.
+        // Looks like front triangle is clipped not precisely by frustum.
+        void ClipTrianglePlane(ClippedPolygon& polygon, int32_t axis, int32_t plane)
+        {
+            ClippedPolygon result;
+            size_t previousElement = polygon.size - 1;
+
+            for (size_t currentElement = 0; currentElement < polygon.size; currentElement++)
+            {
+                const VertexS& previous = polygon.vertices[previousElement];
+                const VertexS& current = polygon.vertices[currentElement];
+
+                bool isPreviousInside = IsVertexInside(previous, axis, plane);
+                bool isCurrentInside = IsVertexInside(current, axis, plane);
+
+                if (isPreviousInside != isCurrentInside)
+                {
+                    float k = (previous.position.w - previous.position.Get(axis) * plane);
+                    float lerpAmount = k / (k - current.position.w + current.position.Get(axis) * plane);
+                    assert(result.size < MaxClippedVertices);
+                    result.vertices[result.size++] = Lerp(previous, current, lerpAmount);
+                }
+
+                if (isCurrentInside)
+                {
+                    assert(result.size < MaxClippedVertices);
+                    result.vertices[result.size++] = current;
+                }
+
+                previousElement = currentElement;
+            }
+
+            polygon = result;
+        }
+
+        bool ClipTriangleAxis(ClippedPolygon& polygon, int32_t axis)
+        {
+            ClipTrianglePlane(polygon, axis, 1);
+
+            if (polygon.size == 0)
+            {
+                return false;
+            }
+
+            ClipTrianglePlane(polygon, axis, -1);
+
+            return polygon.size != 0;
+        }
+
+        TriangleBatch AllocateTriangleBatch(size_t desiredCapacity)
+        {
+            TriangleBatch batch;
+            batch.marker = arena.GetMarker();
+            batch.capacity = std::min(desiredCapacity, arena.GetAvailable() / sizeof(Triangle));
+            batch.triangles = batch.capacity > 0 ? arena.Allocate<Triangle>(batch.capacity) : nullptr;
+
+            if (batch.triangles == nullptr)
+            {
+                batch.capacity = 0;
+            }
+
+            return batch;
+        }
+
+        // Rasterizes everything in the batch in a single depth tested pass and empties it.
+        template<typename Layout>
+        void FlushTriangleBatch(TriangleBatch& batch)
+        {
+            for (size_t i = 0; i < batch.size; i++)
+            {
+                FillGBuffer<Layout, true>(batch.triangles[i]);
+            }
+
+            batch.size = 0;
+            batch.flushed = true;
+        }
+
+        template<typename Layout>
+        void AddTriangleToBatch(const Triangle& tr, TriangleBatch& batch)
+        {
+            if (batch.size == batch.capacity)
+            {
+                FlushTriangleBatch<Layout>(batch);
+            }
+
+            batch.triangles[batch.size++] = tr;
+        }
+
+        template<typename Layout>
+        void AddTriangle(uint32_t index, TriangleBatch& batch)
+        {
+            ClipTriangle(index, ViewProjection, [this, index, &batch](std::array<VertexS, 3>& vertices) { AddRawTriangle<Layout>(vertices, index, batch); });
+        }
+
+        // Transforms the model triangle to clip space, culls it and clips it against the frustum, the triangles that are left go to addRawTriangle.
+        template<typename Function>
+        void ClipTriangle(uint32_t index, const Matrix& transform, Function&& addRawTriangle)
+        {
+            const Model& model = scene.models[0];
+
+            std::array<VertexS, 3> vertices;
+            for (size_t i = 0; i < 3; i++)
+            {
+                vertices[i].position = transform * model.vertices[model.indices[index * 3 + i]].position;
+                vertices[i].barycentric = { i == 0 ? 1.0f : 0.0f, i == 1 ? 1.0f : 0.0f, i == 2 ? 1.0f : 0.0f };
+            }
+
+            // Backface culling produces very rough results in view space (maybe need to figure out why some day). So we do it in clip space. And it seems to be the right (identical to hardware) way.
+            // Doing clipspace culling before we split triangles that penetrate camera frustum gives us additional ~10ms gain for a frame in reference scene.
+            // Front is counter clockwise.
+            Vec v0 { vertices[0].position.x / vertices[0].position.w, vertices[0].position.y / vertices[0].position.w, vertices[0].position.z / vertices[0].position.w, 1.0f };
+            Vec v1 { vertices[1].position.x / vertices[1].position.w, vertices[1].position.y / vertices[1].position.w, vertices[1].position.z / vertices[1].position.w, 1.0f };
+            Vec v2 { vertices[2].position.x / vertices[2].position.w, vertices[2].position.y / vertices[2].position.w, vertices[2].position.z / vertices[2].position.w, 1.0f };
+            if (cross(v2 - v0, v1 - v0).z > 0)
+            {
+                return;
+            }
+
+            // We must check that all triangle lies on outside of one of the planes,
+            // since if we check that some vertices lie on the outside of one plane and others on outside of the other,
+            // then part of the triangle might still be visible.
+            std::array<bool, 6> planesToOutsideness { false };
+            for (const VertexS& v : vertices)
+            {
+                planesToOutsideness[0] |= IsVertexInside(v, 0, 1);
+                planesToOutsideness[1] |= IsVertexInside(v, 1, 1);
+                planesToOutsideness[2] |= IsVertexInside(v, 2, 1);
+                planesToOutsideness[3] |= IsVertexInside(v, 0, -1);
+                planesToOutsideness[4] |= IsVertexInside(v, 1, -1);
+                planesToOutsideness[5] |= IsVertexInside(v, 2, -1);
+            }
+
+            // This check doesn't give us a big performance boost in a general case,
+            // but it doesn't seem to hit performance in general case too much to remove it either.
+            if (std::any_of(planesToOutsideness.begin(), planesToOutsideness.end(), [](bool val) { return !val; }))
+            {
+                return;
+            }
+
+            if (std::all_of(vertices.begin(), vertices.end(), [](const VertexS& v){ return IsVertexInside(v, 0, 1) && IsVertexInside(v, 1, 1) && IsVertexInside(v, 2, 1) && IsVertexInside(v, 0, -1) && IsVertexInside(v, 1, -1) && IsVertexInside(v, 2, -1); }))
+            {
+                addRawTriangle(vertices);
+                return;
+            }
+
+            ClippedPolygon polygon;
+            std::copy(vertices.begin(), vertices.end(), polygon.vertices.begin());
+            polygon.size = vertices.size();
+
+            if (ClipTriangleAxis(polygon, 0) && ClipTriangleAxis(polygon, 1) && ClipTriangleAxis(polygon, 2))
+            {
+                assert(polygon.size >= 3);
+
+                for (size_t i = 2; i < polygon.size; i++)
+                {
+                    std::array<VertexS, 3> clipped { polygon.vertices[0], polygon.vertices[i - 1], polygon.vertices[i] };
+                    addRawTriangle(clipped);
+                }
+            }
+        }
+
+        template<typename Layout, bool Specular, bool ToneMapping>
+        void ShadePixelsWithAccuracy()
+        {
+            switch (Accuracy)
+            {
+                case MathAccuracy::Exact: ShadePixels<ShadingPermutation<Layout, Specular, ToneMapping, MathAccuracy::Exact>>(); break;
+                case MathAccuracy::Fast: ShadePixels<ShadingPermutation<Layout, Specular, ToneMapping, MathAccuracy::Fast>>(); break;
+                case MathAccuracy::Fastest: ShadePixels<ShadingPermutation<Layout, Specular, ToneMapping, MathAccuracy::Fastest>>(); break;
+            }
+        }
+
+        // Rasterizes and shades all the model triangles, when streaming the batch is flushed after every chunk.
+        // Returns false when the budget can't fit the per-frame data of shading.
+        template<typename Layout>
+        bool Draw(TriangleBatch& batch, size_t trianglesCount, size_t chunkSize, bool streaming)
+        {
+            PERF_START("Add triangles");
+            for (size_t chunkBegin = 0; chunkBegin < trianglesCount; chunkBegin += chunkSize)
+            {
+                size_t chunkEnd = std::min(chunkBegin + chunkSize, trianglesCount);
+                for (size_t i = chunkBegin; i < chunkEnd; i++)
+                {
+                    AddTriangle<Layout>(static_cast<uint32_t>(i), batch);
+                }
+
+                if (streaming)
+                {
+                    FlushTriangleBatch<Layout>(batch);
+                }
+            }
+            PERF_END();
+
+            if (batch.flushed)
+            {
+                // Z buffer already has depth of the flushed triangles, so the rest goes through the same single pass.
+                PERF_START("Flush triangles");
+                FlushTriangleBatch<Layout>(batch);
+                PERF_END();
+            }
+            else
+            {
+                PERF_START("ZBuffer");
+                for (size_t i = 0; i < batch.size; i++)
+                {
+                    FillZBuffer(batch.triangles[i]);
+                }
+                PERF_END();
+
+                PERF_START("GBuffer");
+                std::for_each(std::execution::par, batch.triangles, batch.triangles + batch.size, [this](const Triangle& tr) { FillGBuffer<Layout, false>(tr); });
+                PERF_END();
+            }
+
+            // the rest of the frame allocates from the memory of the batch
+            arena.Rewind(batch.marker);
+            batch = {};
+
+            PERF_START("Light culling");
+            bool lightsFit = CullLights();
+            PERF_END();
+
+            if (!lightsFit)
+            {
+                LOG("Frame memory budget of " << arena.GetCapacity() << " bytes can't fit the lights of the tiles.");
+                return false;
+            }
+
+            PERF_START("Shading");
+            bool specular = light.light.specularStrength != 0.0f || std::ranges::any_of(Lights, [](const LightS& pointLight) { return pointLight.light.specularStrength != 0.0f; });
+            if (specular && ToneMapping)
+            {
+                ShadePixelsWithAccuracy<Layout, true, true>();
+            }
+            else if (specular)
+            {
+                ShadePixelsWithAccuracy<Layout, true, false>();
+            }
+            else if (ToneMapping)
+            {
+                ShadePixelsWithAccuracy<Layout, false, true>();
+            }
+            else
+            {
+                ShadePixelsWithAccuracy<Layout, false, false>();
+            }
+            PERF_END();
+
+            return true;
+        }
+    };
+
+    bool SceneRendererSoftware::Render(const Scene& scene, Texture& texture)
+    {
+        if (texture.GetWidth() == 0 || texture.GetHeight() == 0)
+        {
+            return false;
+        }
+
+        if (context == nullptr || context->scene.name != scene.name)
+        {
+            context = std::make_shared<SceneRendererSoftwareContext>(scene, frameMemoryBudget);
+        }
+
+        PERF_START("Clean buffers");
+        context->Resize(texture.GetWidth(), texture.GetHeight());
+        context->BeginFrame();
         PERF_END();
 
-        PERF_START("Buffer to texture");
-        for (size_t i = 0; i < context->BackBuffer.size(); i++)
+        PERF_START("Light transform");
+        // calculate lights' positions in view space
+        Matrix view = ViewTransform(scene.camera);
+        context->light.position_view = view * scene.light.position;
+        context->light.light = scene.light;
+
+        context->Lights.resize(scene.lights.size());
+        for (size_t i = 0; i < scene.lights.size(); i++)
+        {
+            const Light& pointLight = scene.lights[i];
+            context->Lights[i] = { pointLight, view * pointLight.position, pointLight.radius > 0.0f ? 1.0f / (pointLight.radius * pointLight.radius) : 0.0f };
+        }
+        PERF_END();
+
+        PERF_START("Materials");
+        std::vector<std::string> paths;
+        for (const Material& material : scene.models[0].materials)
+        {
+            paths.push_back(material.textureName);
+        }
+
+        context->VirtualTexturing = virtualTexturing;
+        if (virtualTexturing)
+        {
+            // only the mip tails are read here, pages are read by the frames that sample them
+            if (context->VirtualPages.GetTextureCount() == 0)
+            {
+                context->VirtualPages.Open(paths);
+            }
+
+            if (context->VirtualPages.GetCapacity() != residentTexturePages)
+            {
+                context->VirtualPages.SetCapacity(residentTexturePages);
+            }
+
+            context->Textures.clear();
+            context->TextureViews.clear();
+            context->MaterialTextures.resize(paths.size());
+            for (uint32_t i = 0; i < paths.size(); i++)
+            {
+                context->MaterialTextures[i] = { i, { 0, 0, context->VirtualPages.GetWidth(i, 0), context->VirtualPages.GetHeight(i, 0) }, context->VirtualPages.GetMipCount(i) };
+            }
+        }
+        else if (context->Textures.size() == 0 || context->AtlasSize != textureAtlasSize || context->PreparedLayout != textureLayout || context->PreparedFormat != textureFormat)
+        {
+            context->VirtualPages.Open({});
+
+            std::vector<std::shared_ptr<const Texture>> loaded = TextureCache::GetInstance().Load(paths);
+            std::vector<const Texture*> sources;
+            for (const std::shared_ptr<const Texture>& texture : loaded)
+            {
+                sources.push_back(texture.get());
+            }
+
+            std::vector<AtlasPlacement> placements(loaded.size());
+            context->Textures.clear();
+            if (textureAtlasSize > 0)
+            {
+                PackAtlases(sources, textureAtlasSize, MipFilter::Box, context->Textures, placements);
+            }
+
+            // copies, because the textures are prepared for this renderer, the levels are known once the mips are generated
+            context->MaterialTextures.resize(paths.size());
+            for (size_t i = 0; i < loaded.size(); i++)
+            {
+                const AtlasPlacement& placement = placements[i];
+                if (placement.atlas == AtlasPlacement::NotPacked)
+                {
+                    context->MaterialTextures[i] = { static_cast<uint32_t>(context->Textures.size()), { 0, 0, loaded[i]->GetWidth(), loaded[i]->GetHeight() }, 0 };
+                    context->Textures.push_back(*loaded[i]);
+                }
+                else
+                {
+                    context->MaterialTextures[i] = { placement.atlas, placement.rect, placement.mipCount };
+                }
+            }
+            context->AtlasSize = textureAtlasSize;
+            context->PreparedLayout = textureLayout;
+            context->PreparedFormat = textureFormat;
+        }
+
+        // textures without mips from the texture cache generate them here
+        auto textureRange = std::views::iota(size_t(0), context->Textures.size());
+        std::for_each(std::execution::par, textureRange.begin(), textureRange.end(), [this](size_t i) {
+            context->Textures[i].Prepare(textureLayout, textureFormat);
+        });
+
+        size_t textureBytes = 0;
+        context->TextureViews.resize(context->Textures.size());
+        for (size_t i = 0; i < context->Textures.size(); i++)
+        {
+            const Texture& texture = context->Textures[i];
+            context->TextureViews[i].clear();
+            for (size_t level = 0; level < texture.GetMipCount(); level++)
+            {
+                context->TextureViews[i].push_back(TextureView(texture.GetMip(level)));
+                textureBytes += texture.GetMip(level).GetByteSize();
+            }
+        }
+        Utils::MemoryCounter::GetInstance().Set("Textures", textureBytes);
+
+        for (MaterialTexture& material : context->MaterialTextures)
+        {
+            if (material.mipCount == 0)
+            {
+                material.mipCount = context->Textures[material.texture].GetMipCount();
+            }
+        }
+        PERF_END();
+
+        context->ToneMapping = toneMapping;
+        context->Accuracy = mathAccuracy;
+        context->Filter = textureFilter;
+        context->View = view;
+        context->Projection = PerspectiveTransform(scene.camera, static_cast<float>(texture.GetWidth()), static_cast<float>(texture.GetHeight()));
+        context->ViewProjection = context->Projection * context->View;
+
+        PERF_START("Shadows");
+        bool shadowsFit = context->UpdateShadowMap(shadowMapResolution);
+        // inverse of ViewTransform
+        context->ViewToShadowMap = context->Shadows.lightViewProjection * translate(scene.camera.position.x, scene.camera.position.y, scene.camera.position.z) * CameraTransform(scene.camera);
+        PERF_END();
+
+        if (!shadowsFit)
+        {
+            LOG("Frame memory budget of " << context->arena.GetCapacity() << " bytes can't fit the shadow map triangles.");
+            context->arena.Reset();
+            return false;
+        }
+
+        PERF_START("Triangle cache");
+        const Model& model = scene.models[0];
+        size_t trianglesCount = model.indices.size() / 3;
+
+        // Streaming keeps a fixed number of triangles, otherwise there is room for every triangle to be split in two by clipping.
+        // If the budget doesn't allow it, the batch is smaller and gets flushed early.
+        size_t chunkSize = std::max<size_t>(streamingChunkSize > 0 ? streamingChunkSize : trianglesCount, 1);
+        context->arena.SetStage("Triangles");
+        TriangleBatch batch = context->AllocateTriangleBatch(chunkSize * 2);
+        PERF_END();
+
+        if (batch.capacity == 0)
+        {
+            LOG("Frame memory budget of " << context->arena.GetCapacity() << " bytes can't fit a single triangle.");
+            context->arena.Reset();
+            return false;
+        }
+
+        bool drawn = false;
+        if (context->MaterialTextures.size() > 0)
+        {
+            drawn = context->Draw<TexturedLayout>(batch, trianglesCount, chunkSize, streamingChunkSize > 0);
+        }
+        else if (context->HasVertexColors)
+        {
+            drawn = context->Draw<ColoredLayout>(batch, trianglesCount, chunkSize, streamingChunkSize > 0);
+        }
+        else
+        {
+            drawn = context->Draw<SingleColorLayout>(batch, trianglesCount, chunkSize, streamingChunkSize > 0);
+        }
+
+        if (!drawn)
         {
-            texture.SetColor(i, Color(context->BackBuffer[i]));
+            context->arena.Reset();
+            return false;
         }
+
+        PERF_START("Buffer to texture");
+        // Every back buffer pixel is written by shading, G buffer rows go bottom-up while texture rows go top-down.
+        FlipRows(reinterpret_cast<const uint8_t*>(context->BackBuffer.data()), texture.GetBuffer(), texture.GetWidth() * Texture::BytesPerColor, texture.GetHeight());
         PERF_END();
 
+        context->arena.Reset();
+
         return true;
     }
+
+    void SceneRendererSoftware::SetMathAccuracy(MathAccuracy accuracy)
+    {
+        mathAccuracy = accuracy;
+    }
+
+    void SceneRendererSoftware::SetTextureLayout(TextureLayout layout)
+    {
+        textureLayout = layout;
+    }
+
+    void SceneRendererSoftware::SetTextureFormat(TextureFormat format)
+    {
+        textureFormat = format;
+    }
+
+    void SceneRendererSoftware::SetTextureAtlasSize(size_t texels)
+    {
+        textureAtlasSize = texels;
+    }
+
+    void SceneRendererSoftware::SetVirtualTexturing(bool enabled, size_t residentPages)
+    {
+        virtualTexturing = enabled;
+        residentTexturePages = residentPages;
+    }
+
+    size_t SceneRendererSoftware::GetResidentTexturePageCount() const
+    {
+        return context != nullptr ? context->VirtualPages.GetResidentPageCount() : 0;
+    }
+
+    size_t SceneRendererSoftware::GetTexturePageFaultCount() const
+    {
+        return context != nullptr ? context->VirtualPages.GetFaultCount() : 0;
+    }
+
+    void SceneRendererSoftware::SetTextureFilter(TextureFilter filter)
+    {
+        textureFilter = filter;
+    }
+
+    void SceneRendererSoftware::SetShadowMapResolution(size_t texels)
+    {
+        shadowMapResolution = texels;
+    }
+
+    size_t SceneRendererSoftware::GetShadowMapRenderCount() const
+    {
+        return context != nullptr ? context->Shadows.renderCount : 0;
+    }
+
+    void SceneRendererSoftware::SetToneMapping(bool enabled)
+    {
+        toneMapping = enabled;
+    }
+
+    void SceneRendererSoftware::SetStreamingChunkSize(size_t triangles)
+    {
+        streamingChunkSize = triangles;
+    }
+
+    void SceneRendererSoftware::SetFrameMemoryBudget(size_t bytes)
+    {
+        frameMemoryBudget = bytes;
+
+        if (context != nullptr)
+        {
+            context->arena.SetCapacity(bytes);
+        }
+    }
 }
\ No newline at end of file
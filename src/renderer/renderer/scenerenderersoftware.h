@@ -1,16 +1,81 @@
 #pragma once
 
 #include <renderer/scenerenderer.h>
+#include <renderer/framearena.h>
+#include <renderer/fastmath.h>
+#include <renderer/virtualtextures.h>
 
 namespace Renderer
 {
     struct SceneRendererSoftwareContext;
 
+    // Nearest takes the closest texel of the full size texture.
+    // Bilinear blends 4 texels of the mip level closest to the screen size of the texture, Trilinear blends the two closest levels.
+    enum class TextureFilter
+    {
+        Nearest,
+        Bilinear,
+        Trilinear
+    };
+
     struct SceneRendererSoftware : public SceneRenderer
     {
         bool Render(const Scene& scene, Texture& texture) override;
 
+        // Caps the memory used for per frame data. When the cap is hit, triangles are rasterized in smaller batches instead of failing.
+        void SetFrameMemoryBudget(size_t bytes);
+
+        // Processes the index buffer in chunks of this many triangles. Each chunk is set up, rasterized and discarded before the next one,
+        // so frame memory doesn't grow with the model size. 0 keeps all triangles of the frame and rasterizes them in two passes.
+        void SetStreamingChunkSize(size_t triangles);
+
+        // Compresses the lit color with Reinhard operator instead of clamping it, so bright highlights keep their hue.
+        void SetToneMapping(bool enabled);
+
+        // Quality preset of the shading math, Exact matches the reference images, Fast and Fastest trade precision for speed.
+        void SetMathAccuracy(MathAccuracy accuracy);
+
+        // Filtering of texture lookups, the mip level is chosen from texture coordinate differences across 2x2 pixel quads.
+        void SetTextureFilter(TextureFilter filter);
+
+        // Order of the texels of the scene textures in memory, the image doesn't depend on it.
+        void SetTextureLayout(TextureLayout layout);
+
+        // Format the scene textures are converted to for sampling, float formats skip decoding bytes per sample but use more memory.
+        void SetTextureFormat(TextureFormat format);
+
+        // Packs textures with power of two sides of at most a quarter of this size into shared atlases, so scenes with many small
+        // materials sample a few dense textures. The image doesn't change, unless a non square texture is seen from far enough to
+        // need mips smaller than its shorter side. 0 keeps every texture on its own.
+        void SetTextureAtlasSize(size_t texels);
+
+        // Splits the scene textures into pages and keeps only this many of them in memory, the pages are chosen every frame from what
+        // the visible pixels sample. When they don't fit, pixels are textured from coarser mips. Layout and format don't apply to it.
+        void SetVirtualTexturing(bool enabled, size_t residentPages = VirtualTextures::DefaultCapacity);
+
+        // Texture pages in memory after the last frame, and how many of the pages it sampled didn't fit.
+        size_t GetResidentTexturePageCount() const;
+        size_t GetTexturePageFaultCount() const;
+
+        // Casts shadows from the main light of the scene with a square shadow map of this size, 0 turns shadows off.
+        // The map is kept between frames and rendered again only when the light or the geometry changes.
+        void SetShadowMapResolution(size_t texels);
+
+        // Number of times the shadow map was rendered for the current scene.
+        size_t GetShadowMapRenderCount() const;
+
     private:
         std::shared_ptr<SceneRendererSoftwareContext> context;
+        size_t frameMemoryBudget = FrameArena::DefaultCapacity;
+        size_t streamingChunkSize = 0;
+        bool toneMapping = false;
+        MathAccuracy mathAccuracy = MathAccuracy::Exact;
+        TextureFilter textureFilter = TextureFilter::Nearest;
+        TextureLayout textureLayout = TextureLayout::Linear;
+        TextureFormat textureFormat = TextureFormat::RGBA8;
+        size_t textureAtlasSize = 0;
+        bool virtualTexturing = false;
+        size_t residentTexturePages = VirtualTextures::DefaultCapacity;
+        size_t shadowMapResolution = 0;
     };
 }
\ No newline at end of file
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <immintrin.h>
+
+namespace Renderer
+{
+    // Thin wrappers over SSE and AVX2 registers, so that a kernel can be written once as a template and compiled for both widths.
+    // Comparisons return masks with all bits set in the lanes where the comparison is true.
+    struct Float4
+    {
+        static constexpr size_t Width = 4;
+
+        __m128 v;
+
+        static Float4 Load(const float* source) { return { _mm_loadu_ps(source) }; }
+        static Float4 Broadcast(float value) { return { _mm_set1_ps(value) }; }
+        static Float4 LoadEqual(const uint32_t* source, uint32_t value) { return { _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source)), _mm_set1_epi32(static_cast<int32_t>(value)))) }; }
+        void Store(float* destination) const { _mm_storeu_ps(destination, v); }
+        float GetFirst() const { return _mm_cvtss_f32(v); }
+    };
+
+    inline Float4 operator+(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    inline Float4 operator-(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    inline Float4 operator*(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+    inline Float4 operator/(Float4 a, Float4 b) { return { _mm_div_ps(a.v, b.v) }; }
+    inline Float4 Min(Float4 a, Float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+    inline Float4 Max(Float4 a, Float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+    inline Float4 Sqrt(Float4 a) { return { _mm_sqrt_ps(a.v) }; }
+    inline Float4 NotEqual(Float4 a, Float4 b) { return { _mm_cmpneq_ps(a.v, b.v) }; }
+    inline Float4 Select(Float4 mask, Float4 a, Float4 b) { return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) }; }
+    inline Float4 GreaterThan(Float4 a, Float4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+    inline Float4 LessThan(Float4 a, Float4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+    inline Float4 And(Float4 mask, Float4 a) { return { _mm_and_ps(mask.v, a.v) }; }
+    // Swaps lanes 0 and 1, 2 and 3 and so on, i.e. horizontal neighbours of a 2x2 pixel quad.
+    inline Float4 SwapAdjacent(Float4 a) { return { _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(2, 3, 0, 1)) }; }
+    // One bit per lane, set where the mask is set.
+    inline uint32_t GetMaskBits(Float4 mask) { return static_cast<uint32_t>(_mm_movemask_ps(mask.v)); }
+
+    // About 12 bits of precision.
+    inline Float4 RsqrtApproximate(Float4 a) { return { _mm_rsqrt_ps(a.v) }; }
+
+    // SSE2 has no rounding instructions, values must fit into int32_t.
+    inline Float4 Floor(Float4 a)
+    {
+        __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+        return { _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a.v), _mm_set1_ps(1.0f))) };
+    }
+
+    // 2 to the power of an integral value from -126 to 127.
+    inline Float4 PowerOfTwo(Float4 integral)
+    {
+        return { _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(integral.v), _mm_set1_epi32(127)), 23)) };
+    }
+
+    // Unbiased exponent of positive normal values.
+    inline Float4 GetExponent(Float4 a)
+    {
+        return { _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(a.v), 23), _mm_set1_epi32(127))) };
+    }
+
+    // Mantissa of positive values in 1 to 2 range.
+    inline Float4 GetMantissa(Float4 a)
+    {
+        __m128i bits = _mm_and_si128(_mm_castps_si128(a.v), _mm_set1_epi32(0x007FFFFF));
+        return { _mm_castsi128_ps(_mm_or_si128(bits, _mm_set1_epi32(0x3F800000))) };
+    }
+
+    // Clamps channels to 0 to 1 range, truncates them to bytes the same way ConvertFloatToRGBA8 does and stores opaque RGBA8 pixels
+    // in the lanes where the mask is set, other pixels are left as they are.
+    inline void StoreRGBA8(Float4 r, Float4 g, Float4 b, Float4 mask, uint32_t* destination)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 scale = _mm_set1_ps(255.0f);
+
+        __m128i red = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(r.v, zero), one), scale));
+        __m128i green = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(g.v, zero), one), scale));
+        __m128i blue = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(b.v, zero), one), scale));
+
+        __m128i pixels = _mm_or_si128(_mm_or_si128(red, _mm_slli_epi32(green, 8)), _mm_or_si128(_mm_slli_epi32(blue, 16), _mm_set1_epi32(static_cast<int32_t>(0xFF000000))));
+        __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(destination));
+        __m128i select = _mm_castps_si128(mask.v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_or_si128(_mm_and_si128(select, pixels), _mm_andnot_si128(select, previous)));
+    }
+
+#if defined(__AVX2__)
+    struct Float8
+    {
+        static constexpr size_t Width = 8;
+
+        __m256 v;
+
+        static Float8 Load(const float* source) { return { _mm256_loadu_ps(source) }; }
+        static Float8 Broadcast(float value) { return { _mm256_set1_ps(value) }; }
+        static Float8 LoadEqual(const uint32_t* source, uint32_t value) { return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)), _mm256_set1_epi32(static_cast<int32_t>(value)))) }; }
+        void Store(float* destination) const { _mm256_storeu_ps(destination, v); }
+        float GetFirst() const { return _mm256_cvtss_f32(v); }
+    };
+
+    inline Float8 operator+(Float8 a, Float8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+    inline Float8 operator-(Float8 a, Float8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    inline Float8 operator*(Float8 a, Float8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    inline Float8 operator/(Float8 a, Float8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+    inline Float8 Min(Float8 a, Float8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+    inline Float8 Max(Float8 a, Float8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+    inline Float8 Sqrt(Float8 a) { return { _mm256_sqrt_ps(a.v) }; }
+    inline Float8 NotEqual(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ) }; }
+    inline Float8 Select(Float8 mask, Float8 a, Float8 b) { return { _mm256_blendv_ps(b.v, a.v, mask.v) }; }
+    inline Float8 GreaterThan(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Float8 LessThan(Float8 a, Float8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Float8 And(Float8 mask, Float8 a) { return { _mm256_and_ps(mask.v, a.v) }; }
+    inline Float8 SwapAdjacent(Float8 a) { return { _mm256_permute_ps(a.v, _MM_SHUFFLE(2, 3, 0, 1)) }; }
+    inline uint32_t GetMaskBits(Float8 mask) { return static_cast<uint32_t>(_mm256_movemask_ps(mask.v)); }
+    inline Float8 RsqrtApproximate(Float8 a) { return { _mm256_rsqrt_ps(a.v) }; }
+    inline Float8 Floor(Float8 a) { return { _mm256_floor_ps(a.v) }; }
+
+    inline Float8 PowerOfTwo(Float8 integral)
+    {
+        return { _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(integral.v), _mm256_set1_epi32(127)), 23)) };
+    }
+
+    inline Float8 GetExponent(Float8 a)
+    {
+        return { _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(_mm256_castps_si256(a.v), 23), _mm256_set1_epi32(127))) };
+    }
+
+    inline Float8 GetMantissa(Float8 a)
+    {
+        __m256i bits = _mm256_and_si256(_mm256_castps_si256(a.v), _mm256_set1_epi32(0x007FFFFF));
+        return { _mm256_castsi256_ps(_mm256_or_si256(bits, _mm256_set1_epi32(0x3F800000))) };
+    }
+
+    inline void StoreRGBA8(Float8 r, Float8 g, Float8 b, Float8 mask, uint32_t* destination)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 scale = _mm256_set1_ps(255.0f);
+
+        __m256i red = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(r.v, zero), one), scale));
+        __m256i green = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(g.v, zero), one), scale));
+        __m256i blue = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(b.v, zero), one), scale));
+
+        __m256i pixels = _mm256_or_si256(_mm256_or_si256(red, _mm256_slli_epi32(green, 8)), _mm256_or_si256(_mm256_slli_epi32(blue, 16), _mm256_set1_epi32(static_cast<int32_t>(0xFF000000))));
+        __m256i previous = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(destination));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), _mm256_blendv_epi8(previous, pixels, _mm256_castps_si256(mask.v)));
+    }
+
+    // Widest registers available in this build.
+    using FloatLanes = Float8;
+#else
+    using FloatLanes = Float4;
+#endif
+}
@@ -2,6 +2,8 @@
 
 #include <renderer/texture.h>
 #include <renderer/color.h>
+#include <renderer/pixels.h>
+#include <renderer/scene.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <renderer/thirdparty/stb_image.h>
@@ -10,8 +12,93 @@
 #include "texture.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <charconv>
+#include <cstring>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <ranges>
+
 namespace Renderer
 {
+    namespace
+    {
+        // The same values Color(r, g, b).GetVec() has, so sampling RGBA8 through the table doesn't change the image.
+        constexpr std::array<float, 256> ByteToFloat = []() {
+            std::array<float, 256> table{};
+            for (size_t i = 0; i < table.size(); i++)
+            {
+                table[i] = i / 255.0f;
+            }
+            return table;
+        }();
+
+        // Recently decoded blocks of the calling thread, neighbouring samples mostly fall into the same blocks. Buffers are told apart
+        // by the version the texture got when it was compressed, because a freed buffer can be allocated again for another texture.
+        struct DecodedBlocks
+        {
+            static constexpr size_t Count = 256;
+
+            const uint8_t* blocks[Count] = {};
+            uint64_t versions[Count] = {};
+            uint32_t texels[Count][CompressedBlockSize * CompressedBlockSize];
+        };
+
+        thread_local DecodedBlocks BlockCache;
+        std::atomic<uint64_t> CompressedVersion = 0;
+
+        Vec ReadTexel(const uint8_t* texel, TextureFormat format)
+        {
+            switch (format)
+            {
+                case TextureFormat::RGBA8:
+                    return { ByteToFloat[texel[0]], ByteToFloat[texel[1]], ByteToFloat[texel[2]], ByteToFloat[texel[3]] };
+                case TextureFormat::RGBA16F:
+                {
+                    uint16_t halves[4];
+                    std::memcpy(halves, texel, sizeof(halves));
+                    return { ConvertHalfToFloat(halves[0]), ConvertHalfToFloat(halves[1]), ConvertHalfToFloat(halves[2]), ConvertHalfToFloat(halves[3]) };
+                }
+                default:
+                {
+                    Vec result;
+                    std::memcpy(&result, texel, sizeof(result));
+                    return result;
+                }
+            }
+        }
+
+        void WriteTexel(uint8_t* texel, TextureFormat format, const Vec& value)
+        {
+            const float channels[4] = { value.x, value.y, value.z, value.w };
+            switch (format)
+            {
+                case TextureFormat::RGBA8:
+                    // rounded, so converting back from a float format gives the original bytes
+                    for (size_t channel = 0; channel < 4; channel++)
+                    {
+                        texel[channel] = static_cast<uint8_t>(std::clamp(channels[channel], 0.0f, 1.0f) * 255 + 0.5f);
+                    }
+                    break;
+                case TextureFormat::RGBA16F:
+                    for (size_t channel = 0; channel < 4; channel++)
+                    {
+                        uint16_t half = ConvertFloatToHalf(channels[channel]);
+                        std::memcpy(texel + channel * sizeof(half), &half, sizeof(half));
+                    }
+                    break;
+                default:
+                    std::memcpy(texel, channels, sizeof(channels));
+                    break;
+            }
+        }
+    }
+
     Texture::Texture(size_t width, size_t height)
         : width(width)
         , height(height)
@@ -50,12 +137,22 @@ namespace Renderer
 
     Color Texture::GetColor(size_t index) const
     {
+        if (format != TextureFormat::RGBA8)
+        {
+            assert(index < GetSize());
+            uint8_t texel[BytesPerColor];
+            WriteTexel(texel, TextureFormat::RGBA8, TextureView(*this).GetTexel(index % width, index / width));
+            return Color(texel[0], texel[1], texel[2]);
+        }
+
+        index = GetTexelIndex(index % width, index / width);
         return Color(data.at(index * BytesPerColor), data.at(index * BytesPerColor + 1), data.at(index * BytesPerColor + 2));
     }
 
     void Texture::SetColor(size_t index, Color color)
     {
-        ((uint32_t*)data.data())[index] = (((color.rgba & 0xFF000000) >> 24) | ((color.rgba & 0x00FF0000) >> 8) | ((color.rgba & 0x0000FF00) << 8) | ((color.rgba & 0x000000FF) << 24));
+        assert(format == TextureFormat::RGBA8);
+        ((uint32_t*)data.data())[GetTexelIndex(index % width, index / width)] = ToRGBA8(color);
     }
 
     size_t Texture::GetSize() const
@@ -63,13 +160,312 @@ namespace Renderer
         return width * height;
     }
 
+    void Texture::GenerateMips(MipFilter filter)
+    {
+        assert(layout == TextureLayout::Linear && format == TextureFormat::RGBA8);
+        mips.clear();
+
+        auto downsample = filter == MipFilter::GammaCorrectBox ? DownsampleSRGBA8 : DownsampleRGBA8;
+
+        const Texture* previous = this;
+        while (previous->width > 1 || previous->height > 1)
+        {
+            Texture mip(std::max<size_t>(previous->width / 2, 1), std::max<size_t>(previous->height / 2, 1));
+
+            // odd sizes drop the last row or column
+            size_t stepY = previous->height > 1 ? 1 : 0;
+            auto downsampleRow = [previous, &mip, stepY, downsample](size_t y) {
+                const uint8_t* top = previous->data.data() + y * 2 * previous->width * BytesPerColor;
+                const uint8_t* bottom = top + stepY * previous->width * BytesPerColor;
+                uint8_t* destination = mip.data.data() + y * mip.width * BytesPerColor;
+
+                if (previous->width > 1)
+                {
+                    downsample(top, bottom, destination, mip.width);
+                    return;
+                }
+
+                // a single column averages every texel with itself
+                uint8_t pairs[2][2 * BytesPerColor];
+                for (size_t i = 0; i < 2; i++)
+                {
+                    std::memcpy(pairs[0] + i * BytesPerColor, top, BytesPerColor);
+                    std::memcpy(pairs[1] + i * BytesPerColor, bottom, BytesPerColor);
+                }
+                downsample(pairs[0], pairs[1], destination, 1);
+            };
+
+            // rows of large levels are split between threads, small levels aren't worth it
+            auto r = std::views::iota(size_t(0), mip.height);
+            if (mip.GetSize() >= 64 * 1024)
+            {
+                std::for_each(std::execution::par, r.begin(), r.end(), downsampleRow);
+            }
+            else
+            {
+                std::for_each(r.begin(), r.end(), downsampleRow);
+            }
+
+            mips.push_back(std::move(mip));
+            previous = &mips.back();
+        }
+    }
+
+    size_t Texture::GetMipCount() const
+    {
+        return mips.size() + 1;
+    }
+
+    const Texture& Texture::GetMip(size_t level) const
+    {
+        assert(level < GetMipCount());
+        return level == 0 ? *this : mips[level - 1];
+    }
+
+    void Texture::Prepare(TextureLayout newLayout, TextureFormat newFormat)
+    {
+        if (mips.empty() && layout == TextureLayout::Linear && format == TextureFormat::RGBA8)
+        {
+            GenerateMips();
+        }
+
+        Reorder(newLayout);
+        Convert(newFormat);
+        for (Texture& mip : mips)
+        {
+            mip.Reorder(newLayout);
+            mip.Convert(newFormat);
+        }
+    }
+
+    TextureLayout Texture::GetLayout() const
+    {
+        return layout;
+    }
+
+    TextureFormat Texture::GetFormat() const
+    {
+        return format;
+    }
+
+    bool Texture::IsBlockCompressed(TextureFormat format)
+    {
+        return format == TextureFormat::BC1 || format == TextureFormat::BC3;
+    }
+
+    size_t Texture::GetBytesPerTexel(TextureFormat format)
+    {
+        switch (format)
+        {
+            case TextureFormat::RGBA16F:
+                return 4 * sizeof(uint16_t);
+            case TextureFormat::RGBA32F:
+                return 4 * sizeof(float);
+            case TextureFormat::BC1:
+                return BC1BlockBytes;
+            case TextureFormat::BC3:
+                return BC3BlockBytes;
+            default:
+                return BytesPerColor;
+        }
+    }
+
+    const uint8_t* Texture::GetTexel(size_t x, size_t y) const
+    {
+        assert(!IsBlockCompressed(format));
+        return data.data() + GetTexelIndex(x, y) * GetBytesPerTexel(format);
+    }
+
+    size_t Texture::GetTexelIndex(size_t x, size_t y) const
+    {
+        if (layout == TextureLayout::Linear)
+        {
+            return y * width + x;
+        }
+
+        size_t tilesX = (width + TileSize - 1) / TileSize;
+        return ((y / TileSize) * tilesX + x / TileSize) * TileSize * TileSize + (y % TileSize) * TileSize + x % TileSize;
+    }
+
+    void Texture::Reorder(TextureLayout newLayout)
+    {
+        if (layout == newLayout)
+        {
+            return;
+        }
+
+        if (IsBlockCompressed(format))
+        {
+            layout = newLayout;
+            return;
+        }
+
+        Texture reordered;
+        reordered.width = width;
+        reordered.height = height;
+        reordered.layout = newLayout;
+
+        size_t bytesPerTexel = GetBytesPerTexel(format);
+        size_t paddedWidth = newLayout == TextureLayout::Tiled ? (width + TileSize - 1) / TileSize * TileSize : width;
+        size_t paddedHeight = newLayout == TextureLayout::Tiled ? (height + TileSize - 1) / TileSize * TileSize : height;
+        reordered.data.resize(paddedWidth * paddedHeight * bytesPerTexel);
+
+        for (size_t y = 0; y < height; y++)
+        {
+            for (size_t x = 0; x < width; x++)
+            {
+                std::memcpy(reordered.data.data() + reordered.GetTexelIndex(x, y) * bytesPerTexel, GetTexel(x, y), bytesPerTexel);
+            }
+        }
+
+        data = std::move(reordered.data);
+        layout = newLayout;
+    }
+
+    void Texture::Convert(TextureFormat newFormat)
+    {
+        if (format == newFormat)
+        {
+            return;
+        }
+
+        TextureView source(*this);
+        std::vector<uint8_t> converted;
+
+        if (IsBlockCompressed(newFormat))
+        {
+            size_t blocksX = (width + CompressedBlockSize - 1) / CompressedBlockSize;
+            size_t blocksY = (height + CompressedBlockSize - 1) / CompressedBlockSize;
+            converted.resize(blocksX * blocksY * GetBytesPerTexel(newFormat));
+
+            for (size_t blockY = 0; blockY < blocksY; blockY++)
+            {
+                for (size_t blockX = 0; blockX < blocksX; blockX++)
+                {
+                    // texels past the edge of the texture repeat the last row or column
+                    uint8_t texels[CompressedBlockSize * CompressedBlockSize * BytesPerColor];
+                    for (size_t y = 0; y < CompressedBlockSize; y++)
+                    {
+                        for (size_t x = 0; x < CompressedBlockSize; x++)
+                        {
+                            size_t sourceX = std::min(blockX * CompressedBlockSize + x, width - 1);
+                            size_t sourceY = std::min(blockY * CompressedBlockSize + y, height - 1);
+                            WriteTexel(texels + (y * CompressedBlockSize + x) * BytesPerColor, TextureFormat::RGBA8, source.GetTexel(sourceX, sourceY));
+                        }
+                    }
+
+                    uint8_t* block = converted.data() + (blockY * blocksX + blockX) * GetBytesPerTexel(newFormat);
+                    newFormat == TextureFormat::BC1 ? EncodeBC1Block(texels, block) : EncodeBC3Block(texels, block);
+                }
+            }
+        }
+        else
+        {
+            // padding texels of tiled storage stay 0, the layout doesn't change
+            size_t paddedWidth = layout == TextureLayout::Tiled ? (width + TileSize - 1) / TileSize * TileSize : width;
+            size_t paddedHeight = layout == TextureLayout::Tiled ? (height + TileSize - 1) / TileSize * TileSize : height;
+            converted.resize(paddedWidth * paddedHeight * GetBytesPerTexel(newFormat));
+
+            for (size_t y = 0; y < height; y++)
+            {
+                for (size_t x = 0; x < width; x++)
+                {
+                    WriteTexel(converted.data() + GetTexelIndex(x, y) * GetBytesPerTexel(newFormat), newFormat, source.GetTexel(x, y));
+                }
+            }
+        }
+
+        data = std::move(converted);
+        format = newFormat;
+        if (IsBlockCompressed(newFormat))
+        {
+            version = ++CompressedVersion;
+        }
+    }
+
     bool Texture::operator==(const Texture& other) const
     {
-        return this->width == other.width && this->height == other.height && this->data == other.data;
+        return this->width == other.width && this->height == other.height && this->layout == other.layout && this->format == other.format && this->data == other.data;
+    }
+
+    TextureView::TextureView(const Texture& texture)
+        : data(texture.data.data())
+        , width(texture.width)
+        , height(texture.height)
+        , tilesX((texture.width + Texture::TileSize - 1) / Texture::TileSize)
+        , blocksX((texture.width + CompressedBlockSize - 1) / CompressedBlockSize)
+        , layout(texture.layout)
+        , format(texture.format)
+        , version(texture.version)
+    {
+    }
+
+    TextureView::TextureView()
+    {
+    }
+
+    Vec TextureView::GetTexel(size_t x, size_t y) const
+    {
+        if (Texture::IsBlockCompressed(format))
+        {
+            size_t blockIndex = (y / CompressedBlockSize) * blocksX + x / CompressedBlockSize;
+            const uint8_t* block = data + blockIndex * Texture::GetBytesPerTexel(format);
+
+            DecodedBlocks& cache = BlockCache;
+            size_t slot = (blockIndex + version * 97) % DecodedBlocks::Count;
+            if (cache.blocks[slot] != block || cache.versions[slot] != version)
+            {
+                format == TextureFormat::BC1 ? DecodeBC1Block(block, cache.texels[slot]) : DecodeBC3Block(block, cache.texels[slot]);
+                cache.blocks[slot] = block;
+                cache.versions[slot] = version;
+            }
+
+            uint32_t texel = cache.texels[slot][(y % CompressedBlockSize) * CompressedBlockSize + x % CompressedBlockSize];
+            return { ByteToFloat[texel & 0xFF], ByteToFloat[(texel >> 8) & 0xFF], ByteToFloat[(texel >> 16) & 0xFF], ByteToFloat[texel >> 24] };
+        }
+
+        size_t index = y * width + x;
+        if (layout == TextureLayout::Tiled)
+        {
+            index = ((y / Texture::TileSize) * tilesX + x / Texture::TileSize) * Texture::TileSize * Texture::TileSize + (y % Texture::TileSize) * Texture::TileSize + x % Texture::TileSize;
+        }
+
+        return ReadTexel(data + index * Texture::GetBytesPerTexel(format), format);
+    }
+
+    size_t TextureView::GetWidth() const
+    {
+        return width;
+    }
+
+    size_t TextureView::GetHeight() const
+    {
+        return height;
+    }
+
+    std::string GetImageFileName(const std::string& path)
+    {
+        size_t marker = path.rfind(EmbeddedImageMarker);
+        return marker != std::string::npos ? path.substr(0, marker) : path;
     }
 
     bool Load(const std::string& path, Texture& texture)
     {
+        size_t marker = path.rfind(EmbeddedImageMarker);
+        if (marker != std::string::npos)
+        {
+            size_t imageIndex = SIZE_MAX;
+            const char* index = path.data() + marker + std::strlen(EmbeddedImageMarker);
+            std::from_chars(index, path.data() + path.size(), imageIndex);
+
+            std::vector<uint8_t> bytes;
+            if (!ReadEmbeddedImage(path.substr(0, marker), imageIndex, bytes))
+            {
+                bytes.clear();
+            }
+            return Load(bytes.data(), bytes.size(), texture);
+        }
+
         int32_t width, height, channels;
         if (uint8_t* result = stbi_load(path.c_str(), &width, &height, &channels, Texture::BytesPerColor))
         {
@@ -86,29 +482,369 @@ namespace Renderer
         return false;
     };
 
+    bool Load(const uint8_t* data, size_t size, Texture& texture)
+    {
+        int32_t width, height, channels;
+        uint8_t* result = size > 0 ? stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &channels, Texture::BytesPerColor) : nullptr;
+        if (result != nullptr)
+        {
+            Texture temp(width, height);
+            std::memcpy(temp.GetBuffer(), result, temp.GetByteSize());
+            stbi_image_free(result);
+            texture = std::move(temp);
+            return true;
+        }
+
+        Texture temp(1, 1);
+        temp.SetColor(0, Color::Red);
+        texture = std::move(temp);
+        return false;
+    }
+
     bool Save(const std::string& path, const Texture& texture)
     {
-        return static_cast<bool>(stbi_write_bmp(path.c_str(), static_cast<int>(texture.GetWidth()), static_cast<int>(texture.GetHeight()), Texture::BytesPerColor, texture.GetBuffer()));
+        if (texture.GetLayout() != TextureLayout::Linear || texture.GetFormat() != TextureFormat::RGBA8)
+        {
+            REPORT_ERROR();
+        }
+
+        // 32 bit bitmap with V4 header, the same file stb_image_write produces.
+        // Bitmap rows go bottom-up and pixels are stored as bgra, so the conversion is done row by row while flipping.
+        constexpr uint32_t HeaderSize = 14 + 108;
+
+        uint32_t width = static_cast<uint32_t>(texture.GetWidth());
+        uint32_t height = static_cast<uint32_t>(texture.GetHeight());
+        size_t rowSize = texture.GetWidth() * Texture::BytesPerColor;
+
+        std::vector<uint8_t> file(HeaderSize + texture.GetByteSize());
+        uint8_t* header = file.data();
+
+        auto write = [&header](uint32_t value, uint32_t size)
+        {
+            for (uint32_t i = 0; i < size; i++)
+            {
+                *header++ = static_cast<uint8_t>(value >> (i * 8));
+            }
+        };
+
+        // file header
+        write('B', 1);
+        write('M', 1);
+        write(static_cast<uint32_t>(file.size()), 4);
+        write(0, 2);
+        write(0, 2);
+        write(HeaderSize, 4);
+
+        // bitmap V4 header
+        write(108, 4);
+        write(width, 4);
+        write(height, 4);
+        write(1, 2);
+        write(32, 2);
+        write(3, 4); // BI_BITFIELDS
+        for (uint32_t i = 0; i < 5; i++)
+        {
+            write(0, 4);
+        }
+        write(0x00FF0000, 4);
+        write(0x0000FF00, 4);
+        write(0x000000FF, 4);
+        write(0xFF000000, 4);
+        for (uint32_t i = 0; i < 13; i++)
+        {
+            write(0, 4);
+        }
+
+        assert(header == file.data() + HeaderSize);
+
+        for (size_t y = 0; y < texture.GetHeight(); y++)
+        {
+            ConvertRGBA8ToBGRA8(texture.GetBuffer() + (texture.GetHeight() - 1 - y) * rowSize, file.data() + HeaderSize + y * rowSize, texture.GetWidth());
+        }
+
+        std::ofstream stream(path, std::ios::binary);
+        return static_cast<bool>(stream.write(reinterpret_cast<const char*>(file.data()), file.size()));
     }
 
     bool Diff(const Texture& lhs, const Texture& rhs, Texture& result, uint32_t& differentPixelsCount)
     {
-        if (lhs.GetSize() != rhs.GetSize() || lhs.GetSize() != result.GetSize())
+        if (lhs.GetSize() != rhs.GetSize() || lhs.GetSize() != result.GetSize() || lhs.GetLayout() != TextureLayout::Linear || rhs.GetLayout() != TextureLayout::Linear ||
+            lhs.GetFormat() != TextureFormat::RGBA8 || rhs.GetFormat() != TextureFormat::RGBA8)
+        {
+            REPORT_ERROR();
+        }
+
+        differentPixelsCount = DiffRGBA8(lhs.GetBuffer(), rhs.GetBuffer(), result.GetBuffer(), lhs.GetSize(), ToRGBA8(Color::Pink));
+
+        return true;
+    }
+
+    namespace
+    {
+        constexpr uint32_t DerivedDataMagic = 0x50494D50; // "PMIP"
+        constexpr uint32_t DerivedDataVersion = 2;
+        // A rectangle is read at once when that reads at most this many times its bytes, otherwise row by row.
+        constexpr size_t MaxRectReadRatio = 4;
+
+        struct DerivedDataHeader
+        {
+            uint32_t magic = DerivedDataMagic;
+            uint32_t version = DerivedDataVersion;
+            uint64_t sourceHash = 0;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            uint32_t mipCount = 0;
+            uint32_t reserved = 0;
+            uint64_t sourceFileHash = 0;
+            uint64_t sourceFileSize = 0;
+            int64_t sourceFileWriteTime = 0;
+        };
+
+        // The mip chain the header describes is checked against the size of the file before anything is allocated for it.
+        bool ReadDerivedDataHeader(std::ifstream& stream, DerivedDataHeader& header)
+        {
+            if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != DerivedDataMagic || header.version != DerivedDataVersion ||
+                header.mipCount == 0 || header.width == 0 || header.height == 0)
+            {
+                return false;
+            }
+
+            std::streampos levelsStart = stream.tellg();
+            stream.seekg(0, std::ios::end);
+            std::streampos fileEnd = stream.tellg();
+            stream.seekg(levelsStart);
+            if (!stream || fileEnd < levelsStart)
+            {
+                return false;
+            }
+
+            uint64_t left = static_cast<uint64_t>(fileEnd - levelsStart);
+            uint64_t width = header.width;
+            uint64_t height = header.height;
+            for (uint32_t level = 0; level < header.mipCount; level++)
+            {
+                if (width > left / (height * Texture::BytesPerColor))
+                {
+                    return false;
+                }
+
+                left -= width * height * Texture::BytesPerColor;
+                width = std::max<uint64_t>(width / 2, 1);
+                height = std::max<uint64_t>(height / 2, 1);
+            }
+            return left == 0;
+        }
+
+        uint64_t CombineDerivedDataHash(uint64_t fileHash, MipFilter filter)
+        {
+            return (fileHash ^ static_cast<uint64_t>(filter)) * 1099511628211ull;
+        }
+    }
+
+    bool SaveDerivedData(const std::string& path, const Texture& texture, const DerivedDataSource& source)
+    {
+        if (texture.GetLayout() != TextureLayout::Linear || texture.GetFormat() != TextureFormat::RGBA8)
         {
             REPORT_ERROR();
         }
 
-        differentPixelsCount = 0;
-        for (size_t i = 0; i < lhs.GetSize(); i++)
+        DerivedDataHeader header;
+        header.sourceHash = source.hash;
+        header.width = static_cast<uint32_t>(texture.GetWidth());
+        header.height = static_cast<uint32_t>(texture.GetHeight());
+        header.mipCount = static_cast<uint32_t>(texture.GetMipCount());
+        header.sourceFileHash = source.fileHash;
+        header.sourceFileSize = source.fileSize;
+        header.sourceFileWriteTime = source.fileWriteTime;
+
+        // written under another name first, so a reader never sees a half written file
+        std::string temporaryPath = path + ".tmp";
         {
-            if (lhs.GetColor(i).rgba != rhs.GetColor(i).rgba)
+            std::ofstream stream(temporaryPath, std::ios::binary);
+            stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (size_t level = 0; level < texture.GetMipCount(); level++)
             {
-                differentPixelsCount++;
-                result.SetColor(i, Color::Pink);
+                const Texture& mip = texture.GetMip(level);
+                stream.write(reinterpret_cast<const char*>(mip.GetBuffer()), mip.GetByteSize());
             }
-            else
+
+            if (!stream)
+            {
+                REPORT_ERROR();
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, path, error);
+        return !error;
+    }
+
+    bool LoadDerivedData(const std::string& path, uint64_t sourceHash, Texture& texture)
+    {
+        std::ifstream stream(path, std::ios::binary);
+        DerivedDataHeader header;
+        if (!ReadDerivedDataHeader(stream, header) || header.sourceHash != sourceHash)
+        {
+            return false;
+        }
+
+        // every level is read straight into its buffer
+        Texture result(header.width, header.height);
+        for (uint32_t level = 0; level < header.mipCount; level++)
+        {
+            if (level > 0)
+            {
+                const Texture& previous = result.GetMip(level - 1);
+                result.mips.push_back(Texture(std::max<size_t>(previous.GetWidth() / 2, 1), std::max<size_t>(previous.GetHeight() / 2, 1)));
+            }
+
+            Texture& mip = level == 0 ? result : result.mips.back();
+            if (!stream.read(reinterpret_cast<char*>(mip.GetBuffer()), mip.GetByteSize()))
+            {
+                return false;
+            }
+        }
+
+        texture = std::move(result);
+        return true;
+    }
+
+    bool GetDerivedDataSource(const std::string& sourcePath, MipFilter filter, const std::string& derivedDataPath, DerivedDataSource& source)
+    {
+        // embedded images are derived again whenever their model changes
+        std::string filePath = GetImageFileName(sourcePath);
+        std::error_code error;
+        source.fileSize = std::filesystem::file_size(filePath, error);
+        if (error || source.fileSize == 0)
+        {
+            return false;
+        }
+
+        source.fileWriteTime = static_cast<int64_t>(std::filesystem::last_write_time(filePath, error).time_since_epoch().count());
+        if (error)
+        {
+            return false;
+        }
+
+        std::ifstream derived(derivedDataPath, std::ios::binary);
+        DerivedDataHeader header;
+        if (ReadDerivedDataHeader(derived, header) && header.sourceFileSize == source.fileSize && header.sourceFileWriteTime == source.fileWriteTime)
+        {
+            source.fileHash = header.sourceFileHash;
+            source.hash = CombineDerivedDataHash(source.fileHash, filter);
+            return true;
+        }
+
+        std::ifstream stream(filePath, std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+        if (bytes.empty())
+        {
+            return false;
+        }
+
+        // FNV-1a
+        source.fileHash = 14695981039346656037ull;
+        for (char byte : bytes)
+        {
+            source.fileHash = (source.fileHash ^ static_cast<uint8_t>(byte)) * 1099511628211ull;
+        }
+        source.hash = CombineDerivedDataHash(source.fileHash, filter);
+        return true;
+    }
+
+    bool DerivedDataReader::Open(const std::string& path, uint64_t sourceHash)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        stream = std::ifstream(path, std::ios::binary);
+        DerivedDataHeader header;
+        if (!ReadDerivedDataHeader(stream, header) || header.sourceHash != sourceHash)
+        {
+            stream = {};
+            levelOffsets.clear();
+            return false;
+        }
+
+        width = header.width;
+        height = header.height;
+
+        size_t offset = sizeof(header);
+        size_t levelWidth = width;
+        size_t levelHeight = height;
+        levelOffsets.resize(header.mipCount);
+        for (size_t level = 0; level < header.mipCount; level++)
+        {
+            levelOffsets[level] = offset;
+            offset += levelWidth * levelHeight * Texture::BytesPerColor;
+            levelWidth = std::max<size_t>(levelWidth / 2, 1);
+            levelHeight = std::max<size_t>(levelHeight / 2, 1);
+        }
+
+        return true;
+    }
+
+    size_t DerivedDataReader::GetWidth() const
+    {
+        return width;
+    }
+
+    size_t DerivedDataReader::GetHeight() const
+    {
+        return height;
+    }
+
+    size_t DerivedDataReader::GetMipCount() const
+    {
+        return levelOffsets.size();
+    }
+
+    bool DerivedDataReader::ReadRect(size_t level, size_t x, size_t y, size_t rectWidth, size_t rectHeight, uint8_t* destination, size_t pitch)
+    {
+        if (level >= levelOffsets.size())
+        {
+            REPORT_ERROR();
+        }
+
+        size_t levelWidth = std::max<size_t>(width >> level, 1);
+        size_t levelHeight = std::max<size_t>(height >> level, 1);
+        if (x + rectWidth > levelWidth || y + rectHeight > levelHeight || rectWidth == 0 || rectHeight == 0)
+        {
+            REPORT_ERROR();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        size_t rowBytes = rectWidth * Texture::BytesPerColor;
+        size_t levelPitch = levelWidth * Texture::BytesPerColor;
+        size_t first = levelOffsets[level] + (y * levelWidth + x) * Texture::BytesPerColor;
+        size_t spanBytes = (rectHeight - 1) * levelPitch + rowBytes;
+
+        if (spanBytes <= MaxRectReadRatio * rowBytes * rectHeight)
+        {
+            // from the first texel of the rectangle to the last one, then the rows are picked out
+            rows.resize(spanBytes);
+            stream.seekg(first);
+            if (!stream.read(reinterpret_cast<char*>(rows.data()), spanBytes))
+            {
+                stream.clear();
+                REPORT_ERROR();
+            }
+
+            for (size_t row = 0; row < rectHeight; row++)
+            {
+                std::memcpy(destination + row * pitch, rows.data() + row * levelPitch, rowBytes);
+            }
+
+            return true;
+        }
+
+        for (size_t row = 0; row < rectHeight; row++)
+        {
+            stream.seekg(first + row * levelPitch);
+            if (!stream.read(reinterpret_cast<char*>(destination + row * pitch), rowBytes))
             {
-                result.SetColor(i, lhs.GetColor(i).rgba);
+                stream.clear();
+                REPORT_ERROR();
             }
         }
 
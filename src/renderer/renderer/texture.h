@@ -1,16 +1,52 @@
 #pragma once
 
+#include <renderer/math.h>
+
 #include <stdint.h>
+#include <fstream>
+#include <mutex>
 #include <vector>
 #include <string>
 
+#include <utils.h>
+
 namespace Renderer
 {
     struct Color;
 
+    // Order of the texels in memory. Tiled stores tiles of 4x4 texels one after another, so a tile fills a 64 byte cache line
+    // and lookups that walk down the columns or fetch 2x2 footprints touch fewer lines. Tiled storage is padded to whole tiles.
+    enum class TextureLayout
+    {
+        Linear,
+        Tiled
+    };
+
+    // Storage of the texels. RGBA8 is what images load as and the only format that can be written to, saved or compared.
+    // RGBA16F and RGBA32F keep the channels decoded to 0 to 1 floats, so sampling skips the conversion at the cost of 2x and 4x memory.
+    // BC1 and BC3 compress blocks of 4x4 texels to 1/8 and 1/4 of RGBA8 with some loss, BC1 drops alpha. Blocks are stored row by row
+    // whatever the layout is, sampling decodes the texels it needs.
+    enum class TextureFormat
+    {
+        RGBA8,
+        RGBA16F,
+        RGBA32F,
+        BC1,
+        BC3
+    };
+
+    // Box averages 2x2 texels as they are. GammaCorrectBox treats rgb as sRGB and averages it in linear space, so mips of
+    // contrasting details don't get darker than the texture looks from close.
+    enum class MipFilter
+    {
+        Box,
+        GammaCorrectBox
+    };
+
     struct Texture
     {
         constexpr static size_t BytesPerColor = 4;
+        constexpr static size_t TileSize = 4;
 
         explicit Texture(size_t width, size_t height);
         explicit Texture();
@@ -26,17 +62,128 @@ namespace Renderer
 
         size_t GetSize() const;
 
+        // Builds the chain of mip levels down to 1x1, every texel is the average of up to 2x2 texels of the previous level.
+        // Level 0 is the texture itself, changing the texture doesn't update the chain.
+        void GenerateMips(MipFilter filter = MipFilter::Box);
+        size_t GetMipCount() const;
+        const Texture& GetMip(size_t level) const;
+
+        // Generates the mips, unless there are some already, and converts the texels of all levels to the layout and the format,
+        // so it is done once before sampling. Buffer of a texture that is not linear RGBA8 isn't an image, e.g. it can't be saved.
+        void Prepare(TextureLayout layout, TextureFormat format = TextureFormat::RGBA8);
+        TextureLayout GetLayout() const;
+        TextureFormat GetFormat() const;
+
+        static bool IsBlockCompressed(TextureFormat format);
+        // Size of a texel, or of a 4x4 block for compressed formats.
+        static size_t GetBytesPerTexel(TextureFormat format);
+
+        // Texel in the layout and the format of the texture, coordinates are not checked. Not available for compressed formats.
+        const uint8_t* GetTexel(size_t x, size_t y) const;
+
         bool operator==(const Texture& rhs) const;
 
     private:
+        size_t GetTexelIndex(size_t x, size_t y) const;
+        void Reorder(TextureLayout newLayout);
+        void Convert(TextureFormat newFormat);
+
         size_t width = 0;
         size_t height = 0;
+        TextureLayout layout = TextureLayout::Linear;
+        TextureFormat format = TextureFormat::RGBA8;
+        // Changes whenever the texels are compressed, decoded blocks are cached by it.
+        uint64_t version = 0;
         std::vector<uint8_t> data;
+        std::vector<Texture> mips;
+
+        friend struct TextureView;
+        friend bool LoadDerivedData(const std::string& path, uint64_t sourceHash, Texture& texture);
     };
 
+    // Unchecked reads of one level of a texture for sampling loops, channels come out as 0 to 1 floats whatever the format is.
+    // RGBA8 channels are looked up in a 256 entry table instead of being divided, compressed blocks are decoded whole and the last few
+    // hundred blocks are kept per thread. The view must not outlive the texture.
+    struct TextureView
+    {
+        explicit TextureView(const Texture& texture);
+        explicit TextureView();
+
+        Vec GetTexel(size_t x, size_t y) const;
+
+        size_t GetWidth() const;
+        size_t GetHeight() const;
+
+    private:
+        const uint8_t* data = nullptr;
+        size_t width = 0;
+        size_t height = 0;
+        size_t tilesX = 0;
+        size_t blocksX = 0;
+        TextureLayout layout = TextureLayout::Linear;
+        TextureFormat format = TextureFormat::RGBA8;
+        uint64_t version = 0;
+    };
+
+    // Images embedded in binary glTF models are named "<model>#image<index>" and decoded from the bytes in the model.
+    constexpr const char* EmbeddedImageMarker = "#image";
+
+    // File the image is read from, the model for embedded images.
+    std::string GetImageFileName(const std::string& path);
+
     bool Load(const std::string& path, Texture& texture);
+    // Decodes an image file that is already in memory.
+    bool Load(const uint8_t* data, size_t size, Texture& texture);
 
     bool Save(const std::string& path, const Texture& texture);
 
     bool Diff(const Texture& lhs, const Texture& rhs, Texture& result, uint32_t& differentPixelsCount);
+
+    // Derived data of an image is the texels of all its mip levels as they are in memory, so loading skips decoding and filtering.
+    // The file is tagged with a hash of whatever it was derived from, loading fails when the hash or the file version doesn't match.
+    // The size and the write time of the image are kept in the file next to the hash of its bytes, so the image is only read again
+    // to be hashed when one of them changes.
+    struct DerivedDataSource
+    {
+        // Hash of the bytes of the image and of the filter its mips are generated with.
+        uint64_t hash = 0;
+        uint64_t fileHash = 0;
+        uint64_t fileSize = 0;
+        int64_t fileWriteTime = 0;
+    };
+
+    bool SaveDerivedData(const std::string& path, const Texture& texture, const DerivedDataSource& source);
+    bool LoadDerivedData(const std::string& path, uint64_t sourceHash, Texture& texture);
+
+    // Describes the source image, the hash of its bytes comes from the derived data at derivedDataPath when the image has the size
+    // and the write time stored there. Fails when the image can't be read.
+    bool GetDerivedDataSource(const std::string& sourcePath, MipFilter filter, const std::string& derivedDataPath, DerivedDataSource& source);
+
+    // Reads rectangles of the levels of derived data through a file that is kept open, so a texture can be read in parts.
+    // Reads from several threads take turns.
+    struct DerivedDataReader
+    {
+        DELETE_CTORS(DerivedDataReader);
+        DerivedDataReader() = default;
+
+        // Fails when the file can't be read, has another version or was derived from another source.
+        bool Open(const std::string& path, uint64_t sourceHash);
+
+        size_t GetWidth() const;
+        size_t GetHeight() const;
+        size_t GetMipCount() const;
+
+        // Rows of the rectangle go to rows of pitch bytes.
+        bool ReadRect(size_t level, size_t x, size_t y, size_t width, size_t height, uint8_t* destination, size_t pitch);
+
+    private:
+        std::ifstream stream;
+        std::mutex mutex;
+        // File offset of every level, levels follow each other, every one half the size of the previous.
+        std::vector<size_t> levelOffsets;
+        size_t width = 0;
+        size_t height = 0;
+        // The rows of a rectangle are read at once into here.
+        std::vector<uint8_t> rows;
+    };
 }
\ No newline at end of file
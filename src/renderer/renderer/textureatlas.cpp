@@ -0,0 +1,110 @@
+#include <renderer/textureatlas.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace Renderer
+{
+    void PackAtlases(const std::vector<const Texture*>& textures, size_t atlasSize, MipFilter filter, std::vector<Texture>& atlases, std::vector<AtlasPlacement>& placements)
+    {
+        atlases.clear();
+        placements.assign(textures.size(), AtlasPlacement());
+
+        std::vector<size_t> packed;
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            const Texture& texture = *textures[i];
+            if (texture.GetLayout() == TextureLayout::Linear && texture.GetFormat() == TextureFormat::RGBA8 &&
+                std::has_single_bit(texture.GetWidth()) && std::has_single_bit(texture.GetHeight()) &&
+                std::max(texture.GetWidth(), texture.GetHeight()) <= atlasSize / 4)
+            {
+                packed.push_back(i);
+            }
+        }
+
+        // tallest first, so the rows above a texture add up to a multiple of its height
+        std::ranges::sort(packed, [&textures](size_t lhs, size_t rhs) {
+            const Texture& left = *textures[lhs];
+            const Texture& right = *textures[rhs];
+            return left.GetHeight() != right.GetHeight() ? left.GetHeight() > right.GetHeight() : left.GetWidth() > right.GetWidth();
+        });
+
+        struct Bin
+        {
+            std::vector<size_t> members;
+            size_t width = 0;
+            size_t height = 0;
+        };
+
+        std::vector<Bin> bins(packed.empty() ? 0 : 1);
+        size_t rowY = 0;
+        size_t rowHeight = 0;
+        size_t x = 0;
+        for (size_t i : packed)
+        {
+            const Texture& texture = *textures[i];
+            size_t alignment = std::min(texture.GetWidth(), texture.GetHeight());
+            x = (x + alignment - 1) / alignment * alignment;
+
+            if (x + texture.GetWidth() > atlasSize)
+            {
+                rowY += rowHeight;
+                rowHeight = 0;
+                x = 0;
+            }
+
+            if (rowY + texture.GetHeight() > atlasSize)
+            {
+                bins.push_back(Bin());
+                rowY = 0;
+                rowHeight = 0;
+                x = 0;
+            }
+
+            AtlasPlacement& placement = placements[i];
+            placement.atlas = static_cast<uint32_t>(bins.size() - 1);
+            placement.rect = { x, rowY, texture.GetWidth(), texture.GetHeight() };
+            placement.mipCount = std::bit_width(alignment);
+
+            Bin& bin = bins.back();
+            bin.members.push_back(i);
+            bin.width = std::max(bin.width, x + texture.GetWidth());
+            bin.height = std::max(bin.height, rowY + texture.GetHeight());
+
+            rowHeight = std::max(rowHeight, texture.GetHeight());
+            x += texture.GetWidth();
+        }
+
+        for (const Bin& bin : bins)
+        {
+            // a texture alone gains nothing from being copied
+            if (bin.members.size() < 2)
+            {
+                for (size_t i : bin.members)
+                {
+                    placements[i] = AtlasPlacement();
+                }
+                continue;
+            }
+
+            Texture atlas(std::bit_ceil(bin.width), std::bit_ceil(bin.height));
+            for (size_t i : bin.members)
+            {
+                AtlasPlacement& placement = placements[i];
+                placement.atlas = static_cast<uint32_t>(atlases.size());
+
+                const Texture& texture = *textures[i];
+                size_t rowBytes = texture.GetWidth() * Texture::BytesPerColor;
+                for (size_t y = 0; y < texture.GetHeight(); y++)
+                {
+                    uint8_t* destination = atlas.GetBuffer() + ((placement.rect.y + y) * atlas.GetWidth() + placement.rect.x) * Texture::BytesPerColor;
+                    std::memcpy(destination, texture.GetBuffer() + y * rowBytes, rowBytes);
+                }
+            }
+
+            atlas.GenerateMips(filter);
+            atlases.push_back(std::move(atlas));
+        }
+    }
+}
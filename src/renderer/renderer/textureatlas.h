@@ -0,0 +1,35 @@
+#pragma once
+
+#include <renderer/texture.h>
+
+#include <stdint.h>
+#include <vector>
+
+namespace Renderer
+{
+    // Texels of level 0 a texture covers in an atlas, or in itself when it isn't packed.
+    struct TextureRect
+    {
+        size_t x = 0;
+        size_t y = 0;
+        size_t width = 0;
+        size_t height = 0;
+    };
+
+    // Where a texture ended up, NotPacked textures are left as they are.
+    struct AtlasPlacement
+    {
+        static constexpr uint32_t NotPacked = UINT32_MAX;
+
+        uint32_t atlas = NotPacked;
+        TextureRect rect;
+        // Levels of the atlas that hold the mips of the texture, fewer than the texture has when it isn't square.
+        size_t mipCount = 0;
+    };
+
+    // Packs the linear RGBA8 textures with power of two sides of at most a quarter of atlasSize into atlases of at most atlasSize texels
+    // on a side, row by row from the tallest. Every texture starts at a multiple of its shorter side, so each 2x2 average of the atlas
+    // mips stays within one texture and the atlas mips are the mips of the textures down to where the shorter side is a single texel.
+    // Atlases are cut to the power of two size that fits what is packed, the mips are generated with the filter.
+    void PackAtlases(const std::vector<const Texture*>& textures, size_t atlasSize, MipFilter filter, std::vector<Texture>& atlases, std::vector<AtlasPlacement>& placements);
+}
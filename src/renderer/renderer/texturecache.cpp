@@ -0,0 +1,206 @@
+#include <renderer/texturecache.h>
+
+#include <algorithm>
+#include <atomic>
+#include <execution>
+#include <ranges>
+
+#include "utils.h"
+
+namespace Renderer
+{
+    namespace
+    {
+        size_t GetByteSizeWithMips(const Texture& texture)
+        {
+            size_t bytes = 0;
+            for (size_t level = 0; level < texture.GetMipCount(); level++)
+            {
+                bytes += texture.GetMip(level).GetByteSize();
+            }
+            return bytes;
+        }
+
+        // Reads the mips derived from the image if the image didn't change since, otherwise decodes it and derives them again.
+        // Returns whether the image was decoded.
+        bool LoadWithMips(const std::string& path, MipFilter filter, Texture& texture)
+        {
+            std::string derivedPath = path + ".mips";
+            DerivedDataSource source;
+            bool sourceRead = GetDerivedDataSource(path, filter, derivedPath, source);
+            if (sourceRead && LoadDerivedData(derivedPath, source.hash, texture))
+            {
+                return false;
+            }
+
+            if (Load(path, texture))
+            {
+                texture.GenerateMips(filter);
+                if (sourceRead)
+                {
+                    SaveDerivedData(derivedPath, texture, source);
+                }
+            }
+
+            return true;
+        }
+    }
+
+    TextureCache& TextureCache::GetInstance()
+    {
+        static TextureCache textureCache;
+        return textureCache;
+    }
+
+    std::vector<std::shared_ptr<const Texture>> TextureCache::Load(const std::vector<std::string>& paths)
+    {
+        std::vector<std::shared_ptr<const Texture>> result(paths.size());
+        std::vector<std::string> keys(paths.size());
+        std::vector<std::filesystem::file_time_type> modified(paths.size());
+        std::vector<bool> exists(paths.size());
+
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            std::error_code error;
+            keys[i] = std::filesystem::weakly_canonical(paths[i], error).string();
+            modified[i] = std::filesystem::last_write_time(GetImageFileName(paths[i]), error);
+            exists[i] = !error;
+        }
+
+        // first request of every file that has to be decoded
+        std::vector<size_t> missing;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < paths.size(); i++)
+            {
+                auto entry = entries.find(keys[i]);
+                if (exists[i] && entry != entries.end() && entry->second.modified == modified[i])
+                {
+                    entry->second.lastUse = ++useCounter;
+                    result[i] = entry->second.texture;
+                }
+                else if (std::ranges::none_of(missing, [&](size_t m) { return keys[m] == keys[i]; }))
+                {
+                    missing.push_back(i);
+                }
+            }
+        }
+
+        // decoding doesn't hold the lock, so other threads keep getting cached textures meanwhile
+        std::vector<std::shared_ptr<const Texture>> decoded(missing.size());
+        std::atomic<size_t> decodedCount = 0;
+        bool withMips = false;
+        MipFilter filter = MipFilter::Box;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            withMips = derivedData;
+            filter = mipFilter;
+        }
+
+        auto r = std::views::iota(size_t(0), missing.size());
+        std::for_each(std::execution::par, r.begin(), r.end(), [&paths, &missing, &decoded, &decodedCount, withMips, filter](size_t m) {
+            std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+            bool decodedImage = true;
+            if (withMips)
+            {
+                decodedImage = LoadWithMips(paths[missing[m]], filter, *texture);
+            }
+            else
+            {
+                Renderer::Load(paths[missing[m]], *texture);
+            }
+
+            if (decodedImage)
+            {
+                decodedCount++;
+            }
+            decoded[m] = std::move(texture);
+        });
+
+        std::lock_guard<std::mutex> lock(mutex);
+        decodeCount += decodedCount;
+        for (size_t m = 0; m < missing.size(); m++)
+        {
+            size_t i = missing[m];
+            if (exists[i])
+            {
+                Entry& entry = entries[keys[i]];
+                byteSize -= entry.texture ? GetByteSizeWithMips(*entry.texture) : 0;
+                byteSize += GetByteSizeWithMips(*decoded[m]);
+                entry = { modified[i], decoded[m], ++useCounter };
+            }
+
+            for (size_t j = i; j < paths.size(); j++)
+            {
+                if (!result[j] && keys[j] == keys[i])
+                {
+                    result[j] = decoded[m];
+                }
+            }
+        }
+
+        Evict();
+
+        return result;
+    }
+
+    std::shared_ptr<const Texture> TextureCache::Load(const std::string& path)
+    {
+        return Load(std::vector<std::string>{ path })[0];
+    }
+
+    void TextureCache::SetDerivedDataCache(bool enabled, MipFilter filter)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (derivedData == enabled && mipFilter == filter)
+            {
+                return;
+            }
+
+            derivedData = enabled;
+            mipFilter = filter;
+        }
+
+        Clear();
+    }
+
+    void TextureCache::SetCapacity(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        capacity = bytes;
+        Evict();
+    }
+
+    size_t TextureCache::GetByteSize() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return byteSize;
+    }
+
+    size_t TextureCache::GetDecodeCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return decodeCount;
+    }
+
+    void TextureCache::Clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        byteSize = 0;
+        Utils::MemoryCounter::GetInstance().Set("Texture cache", byteSize);
+    }
+
+    void TextureCache::Evict()
+    {
+        while (byteSize > capacity && !entries.empty())
+        {
+            auto oldest = std::ranges::min_element(entries, {}, [](const auto& entry) { return entry.second.lastUse; });
+            byteSize -= GetByteSizeWithMips(*oldest->second.texture);
+            entries.erase(oldest);
+        }
+
+        Utils::MemoryCounter::GetInstance().Set("Texture cache", byteSize);
+    }
+}
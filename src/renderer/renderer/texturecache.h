@@ -0,0 +1,61 @@
+#pragma once
+
+#include <renderer/texture.h>
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Renderer
+{
+    // Decoded images shared by all renderers and scenes. Entries are keyed by the canonical path and the modification time,
+    // so every file is decoded once until it changes on disk, whichever model or renderer asks for it. Embedded images are keyed
+    // by the path of the model with the image index and go by the modification time of the model, see EmbeddedImageMarker.
+    // When the decoded images exceed the capacity, the least recently used ones are dropped. Textures handed out stay valid,
+    // the cache just stops holding them.
+    struct TextureCache
+    {
+        static constexpr size_t DefaultCapacity = size_t(512) * 1024 * 1024;
+
+        static TextureCache& GetInstance();
+
+        // Files that are not cached yet are decoded in parallel, each of them once even if it is listed several times.
+        // A file that can't be loaded gives the same red texture as Load and isn't cached.
+        std::vector<std::shared_ptr<const Texture>> Load(const std::vector<std::string>& paths);
+        std::shared_ptr<const Texture> Load(const std::string& path);
+
+        // Generates the mips of decoded images and keeps them in a file next to the image, "<image>.mips". Later loads of an unchanged
+        // image, also by later runs, read that file instead of decoding and filtering again. Changing it empties the cache.
+        void SetDerivedDataCache(bool enabled, MipFilter filter = MipFilter::Box);
+
+        void SetCapacity(size_t bytes);
+        size_t GetByteSize() const;
+
+        // Number of images decoded since the cache was created, images read from derived data don't count.
+        size_t GetDecodeCount() const;
+
+        void Clear();
+
+    private:
+        struct Entry
+        {
+            std::filesystem::file_time_type modified;
+            std::shared_ptr<const Texture> texture;
+            uint64_t lastUse = 0;
+        };
+
+        void Evict();
+
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, Entry> entries;
+        size_t capacity = DefaultCapacity;
+        bool derivedData = false;
+        MipFilter mipFilter = MipFilter::Box;
+        size_t byteSize = 0;
+        size_t decodeCount = 0;
+        uint64_t useCounter = 0;
+    };
+}
@@ -0,0 +1,376 @@
+#include <renderer/virtualtextures.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <execution>
+#include <ranges>
+
+#include "utils.h"
+
+namespace Renderer
+{
+    namespace
+    {
+        // texture, level, page row and page column of a page key
+        constexpr uint32_t KeyTextureShift = 48;
+        constexpr uint32_t KeyLevelShift = 40;
+        constexpr uint32_t KeyPageYShift = 20;
+        constexpr uint64_t KeyPageMask = (1ull << KeyPageYShift) - 1;
+
+        uint32_t GetKeyTexture(uint64_t key)
+        {
+            return static_cast<uint32_t>(key >> KeyTextureShift);
+        }
+
+        size_t GetKeyLevel(uint64_t key)
+        {
+            return static_cast<size_t>((key >> KeyLevelShift) & 0xFF);
+        }
+
+        size_t GetKeyPageX(uint64_t key)
+        {
+            return static_cast<size_t>(key & KeyPageMask);
+        }
+
+        size_t GetKeyPageY(uint64_t key)
+        {
+            return static_cast<size_t>((key >> KeyPageYShift) & KeyPageMask);
+        }
+
+        Vec ToVec(uint32_t texel)
+        {
+            return { (texel & 0xFF) / 255.0f, ((texel >> 8) & 0xFF) / 255.0f, ((texel >> 16) & 0xFF) / 255.0f, (texel >> 24) / 255.0f };
+        }
+    }
+
+    bool VirtualTextures::Open(const std::vector<std::string>& paths, MipFilter filter)
+    {
+        textures.clear();
+        textures.resize(paths.size());
+
+        // derived data that is up to date only has its header read
+        std::vector<DerivedDataSource> sources(paths.size());
+        std::vector<uint8_t> sourcesRead(paths.size());
+        auto r = std::views::iota(size_t(0), paths.size());
+        std::for_each(std::execution::par, r.begin(), r.end(), [this, &paths, &sources, &sourcesRead, filter](size_t i) {
+            Entry& entry = textures[i];
+            entry.reader = std::make_unique<DerivedDataReader>();
+            sourcesRead[i] = GetDerivedDataSource(paths[i], filter, paths[i] + ".mips", sources[i]);
+            if (!sourcesRead[i] || !entry.reader->Open(paths[i] + ".mips", sources[i].hash))
+            {
+                entry.reader.reset();
+            }
+        });
+
+        std::atomic<bool> loaded = true;
+        std::for_each(std::execution::par, r.begin(), r.end(), [this, &loaded](size_t i) {
+            Entry& entry = textures[i];
+            if (entry.reader != nullptr && !SetUp(entry, entry.reader->GetWidth(), entry.reader->GetHeight(), entry.reader->GetMipCount(), Texture()))
+            {
+                loaded = false;
+            }
+        });
+
+        // The image is decoded once to derive the data the pages are read from. Images are decoded one at a time,
+        // so a first run over a large scene holds a single decoded image with its mips, GenerateMips is parallel itself.
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            Entry& entry = textures[i];
+            if (entry.reader != nullptr)
+            {
+                continue;
+            }
+
+            Texture texture;
+            if (!Load(paths[i], texture))
+            {
+                loaded = false;
+            }
+
+            texture.GenerateMips(filter);
+            entry.reader = std::make_unique<DerivedDataReader>();
+            if (!sourcesRead[i] || !SaveDerivedData(paths[i] + ".mips", texture, sources[i]) || !entry.reader->Open(paths[i] + ".mips", sources[i].hash))
+            {
+                entry.reader.reset();
+            }
+
+            if (!SetUp(entry, texture.GetWidth(), texture.GetHeight(), texture.GetMipCount(), texture))
+            {
+                loaded = false;
+            }
+        }
+
+        Clear();
+        return loaded;
+    }
+
+    bool VirtualTextures::SetUp(Entry& entry, size_t width, size_t height, size_t mipCount, const Texture& texture)
+    {
+        entry.levels.resize(mipCount);
+        entry.tailLevel = mipCount;
+        for (size_t level = 0; level < mipCount; level++)
+        {
+            Level& mip = entry.levels[level];
+            mip.width = width;
+            mip.height = height;
+            mip.pagesX = (width + PageSize - 1) / PageSize;
+            mip.pages.assign(mip.pagesX * ((height + PageSize - 1) / PageSize), NotResident);
+
+            if (width <= PageSize && height <= PageSize)
+            {
+                entry.tailLevel = std::min(entry.tailLevel, level);
+            }
+
+            width = std::max<size_t>(width / 2, 1);
+            height = std::max<size_t>(height / 2, 1);
+        }
+
+        // without derived data there is nothing to read pages from, the whole texture stays in memory
+        if (entry.reader == nullptr)
+        {
+            entry.tailLevel = 0;
+        }
+
+        bool loaded = true;
+        entry.tail.resize(mipCount - entry.tailLevel);
+        for (size_t level = entry.tailLevel; level < mipCount; level++)
+        {
+            const Level& mip = entry.levels[level];
+            std::vector<uint32_t>& texels = entry.tail[level - entry.tailLevel];
+            texels.resize(mip.width * mip.height);
+
+            if (texture.GetWidth() > 0)
+            {
+                std::memcpy(texels.data(), texture.GetMip(level).GetBuffer(), texels.size() * sizeof(uint32_t));
+            }
+            else if (!entry.reader->ReadRect(level, 0, 0, mip.width, mip.height, reinterpret_cast<uint8_t*>(texels.data()), mip.width * sizeof(uint32_t)))
+            {
+                loaded = false;
+            }
+        }
+
+        return loaded;
+    }
+
+    void VirtualTextures::SetCapacity(size_t pages)
+    {
+        capacity = pages;
+        Clear();
+    }
+
+    size_t VirtualTextures::GetCapacity() const
+    {
+        return capacity;
+    }
+
+    size_t VirtualTextures::GetTextureCount() const
+    {
+        return textures.size();
+    }
+
+    size_t VirtualTextures::GetMipCount(uint32_t texture) const
+    {
+        return textures[texture].levels.size();
+    }
+
+    size_t VirtualTextures::GetWidth(uint32_t texture, size_t level) const
+    {
+        return textures[texture].levels[level].width;
+    }
+
+    size_t VirtualTextures::GetHeight(uint32_t texture, size_t level) const
+    {
+        return textures[texture].levels[level].height;
+    }
+
+    uint64_t VirtualTextures::GetPageKey(uint32_t texture, size_t level, size_t x, size_t y)
+    {
+        return (static_cast<uint64_t>(texture) << KeyTextureShift) | (static_cast<uint64_t>(level) << KeyLevelShift) |
+            (static_cast<uint64_t>(y / PageSize) << KeyPageYShift) | static_cast<uint64_t>(x / PageSize);
+    }
+
+    size_t VirtualTextures::GetPageCount() const
+    {
+        size_t count = 0;
+        for (const Entry& entry : textures)
+        {
+            for (const Level& mip : entry.levels)
+            {
+                count += mip.pages.size();
+            }
+        }
+
+        return count;
+    }
+
+    size_t VirtualTextures::Update(const uint64_t* pages, size_t count)
+    {
+        updateCount++;
+
+        // resident pages are kept, the others have to be read
+        std::vector<uint64_t> missing;
+        for (const uint64_t* page = pages; page < pages + count; page++)
+        {
+            uint64_t key = *page;
+            uint32_t texture = GetKeyTexture(key);
+            size_t level = GetKeyLevel(key);
+            if (texture >= textures.size() || level >= textures[texture].tailLevel)
+            {
+                continue;
+            }
+
+            const Level& mip = textures[texture].levels[level];
+            uint32_t slot = mip.pages[GetKeyPageY(key) * mip.pagesX + GetKeyPageX(key)];
+            if (slot != NotResident)
+            {
+                slots[slot].lastUse = updateCount;
+            }
+            else
+            {
+                missing.push_back(key);
+            }
+        }
+
+        std::ranges::sort(missing);
+        missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+        // coarser pages first, they are what finer pages fall back to
+        std::stable_sort(missing.begin(), missing.end(), [](uint64_t lhs, uint64_t rhs) { return GetKeyLevel(lhs) > GetKeyLevel(rhs); });
+
+        // free slots have never been used, then the least recently used pages that were not requested now
+        std::vector<uint32_t> replaced;
+        for (uint32_t slot = 0; slot < slots.size(); slot++)
+        {
+            if (slots[slot].lastUse < updateCount)
+            {
+                replaced.push_back(slot);
+            }
+        }
+        std::ranges::sort(replaced, {}, [this](uint32_t slot) { return slots[slot].used ? slots[slot].lastUse + 1 : 0; });
+
+        size_t readCount = std::min(missing.size(), replaced.size());
+        faultCount = missing.size() - readCount;
+        for (size_t i = 0; i < readCount; i++)
+        {
+            Slot& slot = slots[replaced[i]];
+            if (slot.used)
+            {
+                Level& mip = textures[GetKeyTexture(slot.key)].levels[GetKeyLevel(slot.key)];
+                mip.pages[GetKeyPageY(slot.key) * mip.pagesX + GetKeyPageX(slot.key)] = NotResident;
+            }
+            else
+            {
+                residentCount++;
+            }
+
+            slot = { missing[i], updateCount, true };
+        }
+
+        auto r = std::views::iota(size_t(0), readCount);
+        std::for_each(std::execution::par, r.begin(), r.end(), [this, &missing, &replaced](size_t i) {
+            uint64_t key = missing[i];
+            const Entry& entry = textures[GetKeyTexture(key)];
+            const Level& mip = entry.levels[GetKeyLevel(key)];
+            size_t x = GetKeyPageX(key) * PageSize;
+            size_t y = GetKeyPageY(key) * PageSize;
+            uint32_t* destination = pool.data() + replaced[i] * PageSize * PageSize;
+            entry.reader->ReadRect(GetKeyLevel(key), x, y, std::min(PageSize, mip.width - x), std::min(PageSize, mip.height - y),
+                reinterpret_cast<uint8_t*>(destination), PageSize * sizeof(uint32_t));
+        });
+
+        // pages are mapped once they are read
+        for (size_t i = 0; i < readCount; i++)
+        {
+            uint64_t key = missing[i];
+            Level& mip = textures[GetKeyTexture(key)].levels[GetKeyLevel(key)];
+            mip.pages[GetKeyPageY(key) * mip.pagesX + GetKeyPageX(key)] = replaced[i];
+        }
+
+        return readCount;
+    }
+
+    size_t VirtualTextures::GetResidentPageCount() const
+    {
+        return residentCount;
+    }
+
+    size_t VirtualTextures::GetFaultCount() const
+    {
+        return faultCount;
+    }
+
+    Vec VirtualTextures::GetTexel(uint32_t texture, size_t level, size_t x, size_t y) const
+    {
+        const Entry& entry = textures[texture];
+        while (level < entry.tailLevel)
+        {
+            const Level& mip = entry.levels[level];
+            uint32_t slot = mip.pages[(y / PageSize) * mip.pagesX + x / PageSize];
+            if (slot != NotResident)
+            {
+                return ToVec(pool[(slot * PageSize + y % PageSize) * PageSize + x % PageSize]);
+            }
+
+            // odd sizes drop the last row or column in the next level
+            level++;
+            x = std::min(x / 2, entry.levels[level].width - 1);
+            y = std::min(y / 2, entry.levels[level].height - 1);
+        }
+
+        return ToVec(entry.tail[level - entry.tailLevel][y * entry.levels[level].width + x]);
+    }
+
+    void VirtualTextures::Clear()
+    {
+        for (Entry& entry : textures)
+        {
+            for (Level& mip : entry.levels)
+            {
+                std::fill(mip.pages.begin(), mip.pages.end(), NotResident);
+            }
+        }
+
+        // no memory for pages until there are textures
+        size_t pages = textures.empty() ? 0 : capacity;
+        slots.assign(pages, Slot());
+        pool.assign(pages * PageSize * PageSize, 0);
+        residentCount = 0;
+        faultCount = 0;
+
+        size_t bytes = pool.size() * sizeof(uint32_t);
+        for (const Entry& entry : textures)
+        {
+            for (const std::vector<uint32_t>& texels : entry.tail)
+            {
+                bytes += texels.size() * sizeof(uint32_t);
+            }
+        }
+        Utils::MemoryCounter::GetInstance().Set("Virtual textures", bytes);
+    }
+
+    VirtualTextureView::VirtualTextureView(const VirtualTextures& textures, uint32_t texture, size_t level)
+        : textures(&textures)
+        , texture(texture)
+        , level(level)
+        , width(textures.GetWidth(texture, level))
+        , height(textures.GetHeight(texture, level))
+    {
+    }
+
+    Vec VirtualTextureView::GetTexel(size_t x, size_t y) const
+    {
+        return textures->GetTexel(texture, level, x, y);
+    }
+
+    size_t VirtualTextureView::GetWidth() const
+    {
+        return width;
+    }
+
+    size_t VirtualTextureView::GetHeight() const
+    {
+        return height;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <renderer/texture.h>
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Renderer
+{
+    // Textures split into pages of PageSize x PageSize texels, of which only the pages asked for are read and kept in memory,
+    // so scenes can have more texels than fit in memory. Texels are read from the derived data of the images (see SaveDerivedData),
+    // which is generated first where it is missing or stale.
+    // Pages of all the textures share a pool of a fixed number of pages, the least recently requested ones are replaced.
+    // Levels that fit in a single page, the mip tail, are always resident, so every lookup finds a texel: a texel of a page that
+    // is not resident comes from the closest coarser level that is.
+    struct VirtualTextures
+    {
+        static constexpr size_t PageSize = 128;
+        static constexpr size_t DefaultCapacity = 256;
+
+        // Replaces the textures and empties the pool. An image that can't be loaded gives a red texture, like Load.
+        bool Open(const std::vector<std::string>& paths, MipFilter filter = MipFilter::Box);
+
+        // Empties the pool, the pages are read again when they are requested.
+        void SetCapacity(size_t pages);
+        size_t GetCapacity() const;
+
+        size_t GetTextureCount() const;
+        size_t GetMipCount(uint32_t texture) const;
+        size_t GetWidth(uint32_t texture, size_t level) const;
+        size_t GetHeight(uint32_t texture, size_t level) const;
+
+        // Number of different page keys of all the levels of the textures, mip tail included.
+        size_t GetPageCount() const;
+
+        // Page holding the texel of the level, pages of the mip tail are never read, requesting them does nothing.
+        static uint64_t GetPageKey(uint32_t texture, size_t level, size_t x, size_t y);
+
+        // Makes the requested pages resident, coarser levels first, as long as there are pages in the pool that are not requested.
+        // Requests that don't fit are page faults, their texels come from coarser levels until a later update fits them.
+        // Pages that stay resident are not read again. Returns the number of pages read.
+        size_t Update(const uint64_t* pages, size_t count);
+
+        size_t GetResidentPageCount() const;
+        // Page faults of the last update.
+        size_t GetFaultCount() const;
+
+        // Texel of the level or, when its page isn't resident, of the closest coarser level that has it. Coordinates are not checked.
+        Vec GetTexel(uint32_t texture, size_t level, size_t x, size_t y) const;
+
+    private:
+        static constexpr uint32_t NotResident = UINT32_MAX;
+
+        struct Level
+        {
+            size_t width = 0;
+            size_t height = 0;
+            size_t pagesX = 0;
+            // Pool slot of every page, NotResident when the page isn't read.
+            std::vector<uint32_t> pages;
+        };
+
+        struct Entry
+        {
+            // pages are read through it when the texture has derived data
+            std::unique_ptr<DerivedDataReader> reader;
+            std::vector<Level> levels;
+            // First level of the tail, the texels of its levels are kept in tail one level after another.
+            size_t tailLevel = 0;
+            std::vector<std::vector<uint32_t>> tail;
+        };
+
+        struct Slot
+        {
+            uint64_t key = 0;
+            uint64_t lastUse = 0;
+            bool used = false;
+        };
+
+        void Clear();
+
+        // Sets up the levels of the entry and reads its mip tail, from the texture when it has texels, otherwise through the reader.
+        static bool SetUp(Entry& entry, size_t width, size_t height, size_t mipCount, const Texture& texture);
+
+        std::vector<Entry> textures;
+        std::vector<Slot> slots;
+        std::vector<uint32_t> pool;
+        size_t capacity = DefaultCapacity;
+        size_t residentCount = 0;
+        size_t faultCount = 0;
+        uint64_t updateCount = 0;
+    };
+
+    // One level of a virtual texture that reads like a TextureView, so the same sampling code works for both.
+    struct VirtualTextureView
+    {
+        explicit VirtualTextureView(const VirtualTextures& textures, uint32_t texture, size_t level);
+
+        Vec GetTexel(size_t x, size_t y) const;
+
+        size_t GetWidth() const;
+        size_t GetHeight() const;
+
+    private:
+        const VirtualTextures* textures = nullptr;
+        uint32_t texture = 0;
+        size_t level = 0;
+        size_t width = 0;
+        size_t height = 0;
+    };
+}
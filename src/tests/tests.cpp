@@ -5,9 +5,19 @@
 #include <renderer/scene.h>
 #include <renderer/scenerendererdx12.h>
 #include <renderer/scenerenderersoftware.h>
+#include <renderer/pixels.h>
+#include <renderer/framearena.h>
+#include <renderer/texturecache.h>
+#include <renderer/textureatlas.h>
+#include <renderer/fastmath.h>
 
 #include <functional>
 #include <filesystem>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <bit>
+#include <cstring>
 
 namespace Microsoft
 {
@@ -181,6 +191,278 @@ namespace Tests
             Assert::IsTrue(secondModel.materials[1].name == "quad_material_1");
         }
 
+        TEST_METHOD(LoadShouldParseObjWithWindowsLineEndingsAndRelativeIndices)
+        {
+            std::string scenePath = BuildDir + "obj_parser_test.sce";
+            std::string modelPath = BuildDir + "obj_parser_test.obj";
+            std::ofstream(scenePath, std::ios::binary) << "obj_parser_test.obj 0 0 0\r\n";
+            std::ofstream(modelPath, std::ios::binary) << "# comment\r\nv +0.5 -0.5 0 1 0 0\r\nv 0.5 0.5 0\r\n\r\nv -0.5\t0.5 0\r\n"
+                "vt 0 0\r\nvt 1 0\r\nvt 1 1\r\nvn 0 0 1\r\nf -3/1/1 -2/2/-1 3/3/1";
+
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(scenePath, scene));
+            const Renderer::Model& model = scene.models[0];
+            Assert::IsTrue(std::vector<uint32_t>{ 0, 1, 2 } == model.indices);
+            Assert::IsTrue(Renderer::Vec{ 0.5f, -0.5f, 0.0f, 1.0f } == model.vertices[0].position);
+            Assert::IsTrue(Renderer::Vec{ -0.5f, 0.5f, 0.0f, 1.0f } == model.vertices[2].position);
+            Assert::IsTrue(Renderer::Vec{ 1.0f, 1.0f, 0.0f, 0.0f } == model.vertices[2].textureCoord);
+            Assert::IsTrue(Renderer::Vec{ 0.0f, 0.0f, 1.0f, 0.0f } == model.vertices[1].normal);
+            Assert::AreEqual(Renderer::Color(255, 0, 0).rgba, model.vertices[0].color.rgba);
+            Assert::AreEqual(Renderer::Color().rgba, model.vertices[1].color.rgba);
+
+            // every vertex of a face needs all three indices, and they have to exist
+            for (const char* face : { "f 1//1 2//1 3//1", "f 1/1/1 2/2/1 4/3/1" })
+            {
+                std::ofstream(modelPath, std::ios::binary) << "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvt 1 0\nvt 1 1\nvn 0 0 1\n" << face << "\n";
+                Renderer::Scene failed;
+                Assert::IsFalse(Renderer::Load(scenePath, failed));
+            }
+
+            std::filesystem::remove(scenePath);
+            std::filesystem::remove(modelPath);
+        }
+
+        TEST_METHOD(LoadShouldKeepObjOrderWhenLargeFilesAreParsedInChunks)
+        {
+            std::string scenePath = BuildDir + "obj_chunks_test.sce";
+            std::string modelPath = BuildDir + "obj_chunks_test.obj";
+            std::string materialPath = BuildDir + "obj_chunks_test.mtl";
+            std::ofstream(scenePath, std::ios::binary) << "obj_chunks_test.obj 0 0 0\n";
+            std::ofstream(materialPath, std::ios::binary) << "newmtl first\nmap_Kd first.png\nnewmtl second\nmap_Kd second.png\n";
+
+            // a few MB of quads, relative and absolute indices and material changes end up in different chunks
+            constexpr size_t QuadCount = 8000;
+            std::ofstream model(modelPath, std::ios::binary);
+            model << "mtllib obj_chunks_test.mtl\n";
+            for (size_t quad = 0; quad < QuadCount; quad++)
+            {
+                if (quad % 1000 == 0)
+                {
+                    model << "usemtl " << (quad / 1000 % 2 == 0 ? "first" : "second") << "\n";
+                }
+
+                model << "v " << quad << " 0 0\nv " << quad << " 1 0\nv " << quad << " 1 1\nv " << quad << " 0 1\n";
+                model << "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\nvn 0 0 1\n";
+                model << "f -4/-4/-1 -3/-3/-1 -2/-2/-1\n";
+                size_t first = quad * 4 + 1;
+                model << "f " << first << "/" << first << "/" << quad + 1 << " " << first + 2 << "/" << first + 2 << "/" << quad + 1 << " "
+                    << first + 3 << "/" << first + 3 << "/" << quad + 1 << "\n";
+            }
+            model.close();
+
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(scenePath, scene));
+            const Renderer::Model& loaded = scene.models[0];
+            Assert::AreEqual(QuadCount * 4, loaded.vertices.size());
+            Assert::AreEqual(QuadCount * 6, loaded.indices.size());
+            for (size_t quad = 0; quad < QuadCount; quad++)
+            {
+                uint32_t first = static_cast<uint32_t>(quad * 4);
+                Assert::IsTrue(std::vector<uint32_t>{ first, first + 1, first + 2, first, first + 2, first + 3 } ==
+                    std::vector<uint32_t>(loaded.indices.begin() + quad * 6, loaded.indices.begin() + quad * 6 + 6));
+                Assert::IsTrue(Renderer::Vec{ static_cast<float>(quad), 1.0f, 1.0f, 1.0f } == loaded.vertices[first + 2].position);
+                Assert::AreEqual(static_cast<int32_t>(quad / 1000 % 2), loaded.vertices[first].materialId);
+            }
+
+            std::filesystem::remove(scenePath);
+            std::filesystem::remove(modelPath);
+            std::filesystem::remove(materialPath);
+        }
+
+        TEST_METHOD(LoadShouldWeldVerticesOnlyWithinTolerance)
+        {
+            std::string scenePath = BuildDir + "obj_weld_test.sce";
+            std::string modelPath = BuildDir + "obj_weld_test.obj";
+            std::ofstream(scenePath, std::ios::binary) << "obj_weld_test.obj 0 0 0\n";
+            // the second triangle repeats two positions of the first and is 0.001 off at the third
+            std::ofstream(modelPath, std::ios::binary) << "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 0 0\nv 0 1 0\nv 0.001 0 0\n"
+                "vt 0 0\nvn 0 0 1\nf 1/1/1 2/1/1 3/1/1\nf 4/1/1 6/1/1 5/1/1\nf 2/1/1 3/1/1 1/1/1\n";
+
+            size_t expectedVertices[] = { 6, 4, 3 };
+            float tolerances[] = { Renderer::NoWelding, 0.0f, 0.01f };
+            for (size_t i = 0; i < std::size(tolerances); i++)
+            {
+                Renderer::Scene scene;
+                Assert::IsTrue(Renderer::Load(scenePath, scene, tolerances[i]));
+                const Renderer::Model& model = scene.models[0];
+                Assert::AreEqual(expectedVertices[i], model.vertices.size());
+                Assert::AreEqual(size_t(9), model.indices.size());
+                // corners written the same way share a vertex whatever the tolerance
+                Assert::IsTrue(std::vector<uint32_t>{ 1, 2, 0 } == std::vector<uint32_t>(model.indices.begin() + 6, model.indices.end()));
+            }
+
+            std::filesystem::remove(scenePath);
+            std::filesystem::remove(modelPath);
+        }
+
+        TEST_METHOD(LoadShouldReadSceneCacheUntilSourcesChange)
+        {
+            std::string scenePath = BuildDir + "scene_cache_test.sce";
+            std::string modelPath = BuildDir + "scene_cache_test.obj";
+            std::string cachePath = scenePath + Renderer::SceneCacheExtension;
+            std::ofstream(scenePath, std::ios::binary) << "scene_cache_test.obj 1 2 3 culling_off\n";
+            auto writeModel = [&modelPath](char x) {
+                std::ofstream(modelPath, std::ios::binary) << "v " << x << " 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvn 0 0 1\nf 1/1/1 2/1/1 3/1/1\n";
+            };
+            auto loadFirstX = [&scenePath]() {
+                Renderer::Scene scene;
+                Assert::IsTrue(Renderer::Load(scenePath, scene, Renderer::NoWelding, true));
+                Assert::IsTrue(Renderer::Vec{ 1.0f, 2.0f, 3.0f, 1.0f } == scene.models[0].position);
+                Assert::IsFalse(scene.models[0].backfaceCulling);
+                Assert::IsTrue(std::vector<uint32_t>{ 0, 1, 2 } == scene.models[0].indices);
+                return scene.models[0].vertices[0].position.x;
+            };
+
+            std::filesystem::remove(cachePath);
+            writeModel('5');
+            Assert::AreEqual(5.0f, loadFirstX());
+            Assert::IsTrue(std::filesystem::exists(cachePath));
+
+            // same size and write time, the cache is trusted
+            auto writeTime = std::filesystem::last_write_time(modelPath);
+            writeModel('7');
+            std::filesystem::last_write_time(modelPath, writeTime);
+            Assert::AreEqual(5.0f, loadFirstX());
+
+            // a new write time makes the contents hash again, they differ
+            std::filesystem::last_write_time(modelPath, writeTime + std::chrono::seconds(10));
+            Assert::AreEqual(7.0f, loadFirstX());
+
+            // the same contents with a new write time are trusted and the cache is saved again with the new time
+            auto cacheTime = std::filesystem::last_write_time(cachePath) - std::chrono::seconds(100);
+            std::filesystem::last_write_time(cachePath, cacheTime);
+            std::filesystem::last_write_time(modelPath, writeTime + std::chrono::seconds(20));
+            Assert::AreEqual(7.0f, loadFirstX());
+            Assert::IsTrue(std::filesystem::last_write_time(cachePath) > cacheTime);
+            cacheTime = std::filesystem::last_write_time(cachePath) - std::chrono::seconds(100);
+            std::filesystem::last_write_time(cachePath, cacheTime);
+            Assert::AreEqual(7.0f, loadFirstX());
+            Assert::IsTrue(std::filesystem::last_write_time(cachePath) == cacheTime);
+
+            // a damaged cache is parsed again
+            std::filesystem::resize_file(cachePath, std::filesystem::file_size(cachePath) - 5);
+            Assert::AreEqual(7.0f, loadFirstX());
+            Assert::IsTrue(Renderer::ConvertToCache(scenePath));
+            Assert::AreEqual(7.0f, loadFirstX());
+
+            std::filesystem::remove(scenePath);
+            std::filesystem::remove(modelPath);
+            std::filesystem::remove(cachePath);
+        }
+
+        TEST_METHOD(LoadShouldReadBinaryGltfWithNodeTransformsAndEmbeddedImage)
+        {
+            std::string scenePath = BuildDir + "gltf_test.sce";
+            std::string modelPath = BuildDir + "gltf_test.glb";
+            std::string imagePath = modelPath + Renderer::EmbeddedImageMarker + "0";
+            std::ofstream(scenePath, std::ios::binary) << "gltf_test.glb 0 0 0\n";
+
+            // 2x2 png, red and green over blue and white
+            const uint8_t png[] = {
+                0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A, 0x00, 0x00, 0x00, 0x0D, 0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02, 0x08,
+                0x06, 0x00, 0x00, 0x00, 0x72, 0xB6, 0x0D, 0x24, 0x00, 0x00, 0x00, 0x12, 0x49, 0x44, 0x41, 0x54, 0x78, 0x9C, 0x63, 0xF8, 0xCF, 0xC0, 0xF0, 0x1F, 0x0C,
+                0x81, 0x34, 0x18, 0x00, 0x00, 0x49, 0xC8, 0x09, 0xF7, 0xF9, 0xAB, 0xB6, 0x0D, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82
+            };
+            const float positions[] = { 0, 0, 0, 1, 0, 0, 0, 1, 0 };
+            const float textureCoords[] = { 0, 0, 1, 0, 0, 1 };
+            const uint16_t indices[] = { 0, 1, 2, 0 };
+
+            std::string binary;
+            binary.append(reinterpret_cast<const char*>(positions), sizeof(positions));
+            binary.append(reinterpret_cast<const char*>(textureCoords), sizeof(textureCoords));
+            binary.append(reinterpret_cast<const char*>(indices), sizeof(indices));
+            binary.append(reinterpret_cast<const char*>(png), sizeof(png));
+            binary.resize((binary.size() + 3) / 4 * 4, '\0');
+
+            std::string json = "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+                "\"nodes\":[{\"translation\":[0,0,-5],\"children\":[1]},{\"mesh\":0,\"scale\":[2,2,2]}],"
+                "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"TEXCOORD_0\":1},\"indices\":2,\"material\":0}]}],"
+                "\"materials\":[{\"name\":\"checker\",\"pbrMetallicRoughness\":{\"baseColorTexture\":{\"index\":0}}}],"
+                "\"textures\":[{\"source\":0}],\"images\":[{\"bufferView\":3,\"mimeType\":\"image/png\"}],"
+                "\"accessors\":[{\"bufferView\":0,\"componentType\":5126,\"count\":3,\"type\":\"VEC3\"},"
+                "{\"bufferView\":1,\"componentType\":5126,\"count\":3,\"type\":\"VEC2\"},"
+                "{\"bufferView\":2,\"componentType\":5123,\"count\":3,\"type\":\"SCALAR\"}],"
+                "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":36},{\"buffer\":0,\"byteOffset\":36,\"byteLength\":24},"
+                "{\"buffer\":0,\"byteOffset\":60,\"byteLength\":8},{\"buffer\":0,\"byteOffset\":68,\"byteLength\":75}],"
+                "\"buffers\":[{\"byteLength\":" + std::to_string(binary.size()) + "}]}";
+            json.resize((json.size() + 3) / 4 * 4, ' ');
+
+            uint32_t header[] = { 0x46546C67, 2, static_cast<uint32_t>(12 + 8 + json.size() + 8 + binary.size()) };
+            uint32_t jsonChunk[] = { static_cast<uint32_t>(json.size()), 0x4E4F534A };
+            uint32_t binaryChunk[] = { static_cast<uint32_t>(binary.size()), 0x004E4942 };
+            {
+                std::ofstream model(modelPath, std::ios::binary);
+                model.write(reinterpret_cast<const char*>(header), sizeof(header));
+                model.write(reinterpret_cast<const char*>(jsonChunk), sizeof(jsonChunk)) << json;
+                model.write(reinterpret_cast<const char*>(binaryChunk), sizeof(binaryChunk)) << binary;
+            }
+
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(scenePath, scene));
+            const Renderer::Model& model = scene.models[0];
+            Assert::IsTrue(std::vector<uint32_t>{ 0, 1, 2 } == model.indices);
+            Assert::IsTrue(Renderer::Vec{ 2.0f, 0.0f, -5.0f, 1.0f } == model.vertices[1].position);
+            // texture coordinates are flipped to start at the bottom like OBJ, missing normals come from the face
+            Assert::IsTrue(Renderer::Vec{ 0.0f, 1.0f, 0.0f, 0.0f } == model.vertices[0].textureCoord);
+            Assert::IsTrue(Renderer::Vec{ 0.0f, 0.0f, 1.0f, 0.0f } == model.vertices[2].normal);
+            Assert::AreEqual(0, model.vertices[0].materialId);
+            Assert::IsTrue(model.materials[0].name == "checker");
+            Assert::IsTrue(model.materials[0].textureName == imagePath);
+            // the image is decoded from the model, nothing is written next to it
+            Assert::IsFalse(std::filesystem::exists(modelPath + ".image0.png"));
+
+            Renderer::Texture texture;
+            Assert::IsTrue(Renderer::Load(imagePath, texture));
+            Assert::AreEqual(size_t(2), texture.GetWidth());
+            const uint8_t* texel = texture.GetTexel(0, 0);
+            Assert::IsTrue(texel[0] == 255 && texel[1] == 0 && texel[2] == 0);
+            texel = texture.GetTexel(1, 1);
+            Assert::IsTrue(texel[0] == 255 && texel[1] == 255 && texel[2] == 255);
+
+            std::filesystem::remove(scenePath);
+            std::filesystem::remove(modelPath);
+        }
+
+        TEST_METHOD(LoadShouldRejectBinaryGltfWithInvalidNodeHierarchy)
+        {
+            std::string scenePath = BuildDir + "gltf_nodes_test.sce";
+            std::string modelPath = BuildDir + "gltf_nodes_test.glb";
+            std::ofstream(scenePath, std::ios::binary) << "gltf_nodes_test.glb 0 0 0\n";
+            auto load = [&](const std::string& scene, std::string nodes) {
+                std::string json = "{\"asset\":{\"version\":\"2.0\"},\"scenes\":[{\"nodes\":" + scene + "}],\"nodes\":" + nodes + "}";
+                json.resize((json.size() + 3) / 4 * 4, ' ');
+                uint32_t header[] = { 0x46546C67, 2, static_cast<uint32_t>(12 + 8 + json.size()) };
+                uint32_t jsonChunk[] = { static_cast<uint32_t>(json.size()), 0x4E4F534A };
+                {
+                    std::ofstream model(modelPath, std::ios::binary);
+                    model.write(reinterpret_cast<const char*>(header), sizeof(header));
+                    model.write(reinterpret_cast<const char*>(jsonChunk), sizeof(jsonChunk)) << json;
+                }
+                Renderer::Scene result;
+                return Renderer::Load(scenePath, result);
+            };
+            auto chain = [](size_t count) {
+                std::string nodes = "[";
+                for (size_t i = 0; i + 1 < count; i++)
+                {
+                    nodes += "{\"children\":[" + std::to_string(i + 1) + "]},";
+                }
+                return nodes + "{}]";
+            };
+
+            Assert::IsTrue(load("[0]", chain(64)));
+            // too deep, a cycle, a child shared by two parents and indices that aren't nodes
+            Assert::IsFalse(load("[0]", chain(66)));
+            Assert::IsFalse(load("[0]", "[{\"children\":[1]},{\"children\":[0]}]"));
+            Assert::IsFalse(load("[0,1]", "[{\"children\":[2]},{\"children\":[2]},{}]"));
+            Assert::IsFalse(load("[0]", "[{\"children\":[-1]}]"));
+            Assert::IsFalse(load("[0]", "[{\"children\":[0.5]}]"));
+            Assert::IsFalse(load("[\"0\"]", "[{}]"));
+
+            std::filesystem::remove(scenePath);
+            std::filesystem::remove(modelPath);
+        }
+
         TEST_METHOD(LoadShouldFailWhenThereIsNoSceneFile)
         {
             Renderer::Scene scene;
@@ -211,6 +493,663 @@ namespace Tests
         }
     };
 
+    TEST_CLASS(Pixels)
+    {
+        TEST_METHOD(ConvertFloatToRGBA8ShouldMatchColorConversion)
+        {
+            std::mt19937 generator(0);
+            std::uniform_real_distribution<float> distribution(-0.5f, 1.5f);
+
+            // odd size to cover the scalar tail
+            std::vector<Renderer::Vec> colors(1027);
+            for (Renderer::Vec& color : colors)
+            {
+                color = { distribution(generator), distribution(generator), distribution(generator), distribution(generator) };
+            }
+
+            Renderer::Texture result(colors.size(), 1);
+            Renderer::ConvertFloatToRGBA8(colors.data(), result.GetBuffer(), colors.size());
+
+            Renderer::Texture expected(colors.size(), 1);
+            for (size_t i = 0; i < colors.size(); i++)
+            {
+                Renderer::Vec clamped{ std::clamp(colors[i].x, 0.0f, 1.0f), std::clamp(colors[i].y, 0.0f, 1.0f), std::clamp(colors[i].z, 0.0f, 1.0f), std::clamp(colors[i].w, 0.0f, 1.0f) };
+                expected.SetColor(i, Renderer::Color(clamped));
+            }
+
+            Assert::IsTrue(expected == result);
+        }
+
+        TEST_METHOD(ConvertRGBA8ToBGRA8ShouldSwapRedAndBlue)
+        {
+            Renderer::Texture texture(13, 1);
+            for (size_t i = 0; i < texture.GetSize(); i++)
+            {
+                texture.SetColor(i, Renderer::Color(uint8_t(i), uint8_t(i + 1), uint8_t(i + 2), uint8_t(i + 3)));
+            }
+
+            Renderer::ConvertRGBA8ToBGRA8(texture.GetBuffer(), texture.GetBuffer(), texture.GetSize());
+
+            for (size_t i = 0; i < texture.GetSize(); i++)
+            {
+                Assert::AreEqual(uint8_t(i + 2), texture.GetBuffer()[i * 4 + 0]);
+                Assert::AreEqual(uint8_t(i + 1), texture.GetBuffer()[i * 4 + 1]);
+                Assert::AreEqual(uint8_t(i + 0), texture.GetBuffer()[i * 4 + 2]);
+                Assert::AreEqual(uint8_t(i + 3), texture.GetBuffer()[i * 4 + 3]);
+            }
+        }
+
+        TEST_METHOD(DiffShouldIgnoreAlphaAndHighlightDifferentPixels)
+        {
+            Renderer::Texture lhs(9, 1);
+            Renderer::Texture rhs(9, 1);
+            for (size_t i = 0; i < lhs.GetSize(); i++)
+            {
+                lhs.SetColor(i, Renderer::Color(10, 20, 30, 0));
+                rhs.SetColor(i, Renderer::Color(10, 20, i % 3 == 0 ? 31 : 30, 128));
+            }
+
+            Renderer::Texture diff(9, 1);
+            uint32_t differentPixelsCount = 0;
+            Assert::IsTrue(Renderer::Diff(lhs, rhs, diff, differentPixelsCount));
+
+            Assert::AreEqual(uint32_t(3), differentPixelsCount);
+            for (size_t i = 0; i < diff.GetSize(); i++)
+            {
+                Assert::AreEqual(i % 3 == 0 ? Renderer::Color::Pink.rgba : Renderer::Color(10, 20, 30).rgba, diff.GetColor(i).rgba);
+            }
+        }
+
+        TEST_METHOD(HalfConversionShouldRoundTripAndRoundToNearestEven)
+        {
+            for (uint32_t bits = 0; bits <= 0xFFFF; bits++)
+            {
+                uint16_t half = static_cast<uint16_t>(bits);
+                float value = Renderer::ConvertHalfToFloat(half);
+                if (value == value) // NaN doesn't keep its payload bits
+                {
+                    Assert::AreEqual(half, Renderer::ConvertFloatToHalf(value));
+                }
+            }
+
+            // 1 + 2^-11 is halfway between 1 and the next half, the even one wins
+            Assert::AreEqual(uint16_t(0x3C00), Renderer::ConvertFloatToHalf(1.0f + 1.0f / 2048.0f));
+            Assert::AreEqual(uint16_t(0x3C02), Renderer::ConvertFloatToHalf(1.0f + 3.0f / 2048.0f));
+            Assert::AreEqual(uint16_t(0x7C00), Renderer::ConvertFloatToHalf(70000.0f));
+            Assert::AreEqual(uint16_t(0x0001), Renderer::ConvertFloatToHalf(1.0f / 16777216.0f));
+        }
+
+        TEST_METHOD(BlockCompressionShouldKeepTwoToneBlocksExact)
+        {
+            // colors and alphas that 565 endpoints and 8 bit alpha endpoints represent exactly
+            const uint32_t light = 0x80FFFFFFu;
+            const uint32_t dark = 0xFF000000u;
+            uint32_t texels[16];
+            for (size_t i = 0; i < 16; i++)
+            {
+                texels[i] = (i * 7) % 3 == 0 ? light : dark;
+            }
+
+            uint8_t bc1[Renderer::BC1BlockBytes];
+            uint8_t bc3[Renderer::BC3BlockBytes];
+            Renderer::EncodeBC1Block(reinterpret_cast<const uint8_t*>(texels), bc1);
+            Renderer::EncodeBC3Block(reinterpret_cast<const uint8_t*>(texels), bc3);
+
+            uint32_t decodedBC1[16];
+            uint32_t decodedBC3[16];
+            Renderer::DecodeBC1Block(bc1, decodedBC1);
+            Renderer::DecodeBC3Block(bc3, decodedBC3);
+
+            for (size_t i = 0; i < 16; i++)
+            {
+                Assert::AreEqual(texels[i] | 0xFF000000u, decodedBC1[i]);
+                Assert::AreEqual(texels[i], decodedBC3[i]);
+            }
+        }
+    };
+
+    TEST_CLASS(FrameArena)
+    {
+        TEST_METHOD(AllocateShouldRespectAlignmentAndCapacity)
+        {
+            Renderer::FrameArena arena(1024 * 1024);
+
+            uint8_t* byte = arena.Allocate<uint8_t>(1);
+            double* doubles = arena.Allocate<double>(16);
+
+            Assert::IsTrue(byte != nullptr);
+            Assert::IsTrue(doubles != nullptr);
+            Assert::AreEqual(size_t(0), reinterpret_cast<uintptr_t>(doubles) % alignof(double));
+
+            Assert::IsTrue(arena.Allocate(2 * 1024 * 1024, 16) == nullptr);
+            Assert::IsTrue(arena.GetUsed() <= arena.GetCapacity());
+        }
+
+        TEST_METHOD(ResetShouldReuseMemoryUpToHighWaterMark)
+        {
+            Renderer::FrameArena arena(16 * 1024 * 1024);
+
+            // grows through several blocks in the first frame
+            for (uint32_t i = 0; i < 64; i++)
+            {
+                Assert::IsTrue(arena.Allocate(64 * 1024, 16) != nullptr);
+            }
+
+            size_t highWaterMark = arena.GetHighWaterMark();
+            arena.Reset();
+
+            Assert::AreEqual(size_t(0), arena.GetUsed());
+            Assert::AreEqual(highWaterMark, arena.GetHighWaterMark());
+
+            // second frame of the same size fits into a single block
+            uint8_t* first = arena.Allocate<uint8_t>(64 * 1024);
+            for (uint32_t i = 1; i < 64; i++)
+            {
+                uint8_t* next = arena.Allocate<uint8_t>(64 * 1024);
+                Assert::IsTrue(next == first + i * 64 * 1024);
+            }
+        }
+
+        TEST_METHOD(AllocateShouldReplaceUnusedBlockLargerThanIt)
+        {
+            Renderer::FrameArena arena(1024 * 1024);
+
+            Assert::IsTrue(arena.Allocate(100 * 1024, 16) != nullptr);
+            arena.Reset();
+
+            // the block kept from the first frame is too small and not in use, it must not count against the budget
+            Assert::IsTrue(arena.Allocate(900 * 1024, 16) != nullptr);
+        }
+
+        TEST_METHOD(RewindShouldMakeMemoryAvailableAgain)
+        {
+            Renderer::FrameArena arena(1024 * 1024);
+
+            uint8_t* kept = arena.Allocate<uint8_t>(1024);
+            Renderer::FrameArena::Marker marker = arena.GetMarker();
+            uint8_t* released = arena.Allocate<uint8_t>(512 * 1024);
+            Assert::IsTrue(kept != nullptr);
+            Assert::IsTrue(released != nullptr);
+
+            arena.Rewind(marker);
+            Assert::AreEqual(size_t(1024), arena.GetUsed());
+            Assert::IsTrue(arena.Allocate(900 * 1024, 16) != nullptr);
+        }
+    };
+
+    TEST_CLASS(Textures)
+    {
+        TEST_METHOD(GenerateMipsShouldAverageTexelsDownToSinglePixel)
+        {
+            Renderer::Texture texture(4, 2);
+            for (size_t i = 0; i < texture.GetSize(); i++)
+            {
+                texture.SetColor(i, i % 2 == 0 ? Renderer::Color::White : Renderer::Color::Black);
+            }
+
+            texture.GenerateMips();
+
+            Assert::AreEqual(size_t(3), texture.GetMipCount());
+            Assert::IsTrue(&texture.GetMip(0) == &texture);
+            Assert::AreEqual(size_t(2), texture.GetMip(1).GetWidth());
+            Assert::AreEqual(size_t(1), texture.GetMip(1).GetHeight());
+            Assert::AreEqual(size_t(1), texture.GetMip(2).GetWidth());
+            Assert::AreEqual(size_t(1), texture.GetMip(2).GetHeight());
+
+            // (255 + 0 + 255 + 0 + 2) / 4
+            Assert::AreEqual(128, static_cast<int32_t>(texture.GetMip(1).GetColor(0).GetVal(0)));
+            Assert::AreEqual(128, static_cast<int32_t>(texture.GetMip(2).GetColor(0).GetVal(0)));
+        }
+
+        TEST_METHOD(GenerateMipsShouldMatchBoxFilterOnOddSizes)
+        {
+            Renderer::Texture texture(37, 23);
+            uint32_t seed = 1;
+            for (size_t i = 0; i < texture.GetSize(); i++)
+            {
+                seed = seed * 1664525 + 1013904223;
+                texture.SetColor(i, Renderer::Color(static_cast<uint8_t>(seed >> 24), static_cast<uint8_t>(seed >> 16), static_cast<uint8_t>(seed >> 8), static_cast<uint8_t>(seed)));
+            }
+
+            texture.GenerateMips();
+
+            // the last row and column of odd levels are dropped, a single column is averaged with itself
+            for (size_t level = 1; level < texture.GetMipCount(); level++)
+            {
+                const Renderer::Texture& source = texture.GetMip(level - 1);
+                const Renderer::Texture& mip = texture.GetMip(level);
+                for (size_t y = 0; y < mip.GetHeight(); y++)
+                {
+                    for (size_t x = 0; x < mip.GetWidth(); x++)
+                    {
+                        size_t x0 = std::min(2 * x, source.GetWidth() - 1);
+                        size_t x1 = std::min(2 * x + 1, source.GetWidth() - 1);
+                        size_t y0 = std::min(2 * y, source.GetHeight() - 1);
+                        size_t y1 = std::min(2 * y + 1, source.GetHeight() - 1);
+                        for (size_t c = 0; c < 4; c++)
+                        {
+                            int32_t sum = source.GetTexel(x0, y0)[c] + source.GetTexel(x1, y0)[c] + source.GetTexel(x0, y1)[c] + source.GetTexel(x1, y1)[c];
+                            Assert::AreEqual((sum + 2) / 4, static_cast<int32_t>(mip.GetTexel(x, y)[c]));
+                        }
+                    }
+                }
+            }
+        }
+
+        TEST_METHOD(GenerateMipsShouldKeepBrightnessWithGammaCorrectFilter)
+        {
+            Renderer::Texture box(2, 2);
+            for (size_t i = 0; i < box.GetSize(); i++)
+            {
+                box.SetColor(i, (i == 0 || i == 3) ? Renderer::Color::White : Renderer::Color::Black);
+            }
+            Renderer::Texture gammaCorrect = box;
+
+            box.GenerateMips(Renderer::MipFilter::Box);
+            gammaCorrect.GenerateMips(Renderer::MipFilter::GammaCorrectBox);
+
+            // half of the light of white is 188 in sRGB, averaging the encoded values makes the checker darker
+            Assert::AreEqual(128, static_cast<int32_t>(box.GetMip(1).GetColor(0).GetVal(0)));
+            Assert::AreEqual(188, static_cast<int32_t>(gammaCorrect.GetMip(1).GetColor(0).GetVal(0)));
+            Assert::AreEqual(255, static_cast<int32_t>(gammaCorrect.GetMip(1).GetColor(0).GetVal(3)));
+        }
+
+        TEST_METHOD(PackAtlasesShouldKeepTexelsAndMipsOfSmallTextures)
+        {
+            std::vector<Renderer::Texture> textures;
+            for (auto [width, height] : { std::pair<size_t, size_t>{ 64, 64 }, { 16, 16 }, { 64, 16 }, { 32, 32 }, { 20, 20 }, { 128, 128 }, { 8, 32 } })
+            {
+                Renderer::Texture texture(width, height);
+                for (size_t i = 0; i < texture.GetSize(); i++)
+                {
+                    texture.SetColor(i, Renderer::Color(static_cast<uint8_t>(i * 7 + width), static_cast<uint8_t>(i * 13), static_cast<uint8_t>(height + i)));
+                }
+                textures.push_back(std::move(texture));
+            }
+
+            std::vector<const Renderer::Texture*> sources;
+            for (const Renderer::Texture& texture : textures)
+            {
+                sources.push_back(&texture);
+            }
+
+            std::vector<Renderer::Texture> atlases;
+            std::vector<Renderer::AtlasPlacement> placements;
+            Renderer::PackAtlases(sources, 256, Renderer::MipFilter::Box, atlases, placements);
+
+            // not a power of two, and more than a quarter of the atlas
+            Assert::AreEqual(Renderer::AtlasPlacement::NotPacked, placements[4].atlas);
+            Assert::AreEqual(Renderer::AtlasPlacement::NotPacked, placements[5].atlas);
+            Assert::AreEqual(size_t(1), atlases.size());
+            Assert::IsTrue(atlases[0].GetWidth() <= 256 && atlases[0].GetHeight() <= 128);
+
+            for (size_t i = 0; i < textures.size(); i++)
+            {
+                if (placements[i].atlas == Renderer::AtlasPlacement::NotPacked)
+                {
+                    continue;
+                }
+
+                // the atlas mips are the mips of the texture down to its shorter side being one texel
+                Renderer::Texture& texture = textures[i];
+                texture.GenerateMips();
+                const Renderer::AtlasPlacement& placement = placements[i];
+                Assert::AreEqual(size_t(std::bit_width(std::min(texture.GetWidth(), texture.GetHeight()))), placement.mipCount);
+                for (size_t level = 0; level < placement.mipCount; level++)
+                {
+                    const Renderer::Texture& mip = texture.GetMip(level);
+                    const Renderer::Texture& atlasMip = atlases[0].GetMip(level);
+                    for (size_t y = 0; y < mip.GetHeight(); y++)
+                    {
+                        for (size_t x = 0; x < mip.GetWidth(); x++)
+                        {
+                            Assert::AreEqual(0, std::memcmp(mip.GetTexel(x, y), atlasMip.GetTexel((placement.rect.x >> level) + x, (placement.rect.y >> level) + y), Renderer::Texture::BytesPerColor));
+                        }
+                    }
+                }
+            }
+        }
+
+        TEST_METHOD(PrepareShouldKeepTexelsWhenChangingLayout)
+        {
+            // sizes that are not multiples of the tile size
+            Renderer::Texture texture(13, 6);
+            for (size_t i = 0; i < texture.GetSize(); i++)
+            {
+                texture.SetColor(i, Renderer::Color(static_cast<uint8_t>(i), static_cast<uint8_t>(i * 3), static_cast<uint8_t>(i * 7)));
+            }
+
+            Renderer::Texture linear = texture;
+            linear.GenerateMips();
+            texture.Prepare(Renderer::TextureLayout::Tiled);
+
+            Assert::IsTrue(texture.GetLayout() == Renderer::TextureLayout::Tiled);
+            Assert::AreEqual(linear.GetMipCount(), texture.GetMipCount());
+            for (size_t level = 0; level < texture.GetMipCount(); level++)
+            {
+                const Renderer::Texture& expected = linear.GetMip(level);
+                const Renderer::Texture& actual = texture.GetMip(level);
+                for (size_t y = 0; y < expected.GetHeight(); y++)
+                {
+                    for (size_t x = 0; x < expected.GetWidth(); x++)
+                    {
+                        Assert::AreEqual(expected.GetColor(y * expected.GetWidth() + x).rgba, actual.GetColor(y * actual.GetWidth() + x).rgba);
+                        Assert::IsTrue(std::memcmp(expected.GetTexel(x, y), actual.GetTexel(x, y), Renderer::Texture::BytesPerColor) == 0);
+                    }
+                }
+            }
+
+            texture.Prepare(Renderer::TextureLayout::Linear);
+            Assert::IsTrue(texture == linear);
+        }
+
+        TEST_METHOD(PrepareShouldKeepTexelsWhenChangingFormat)
+        {
+            Renderer::Texture texture(16, 16);
+            for (size_t i = 0; i < texture.GetSize(); i++)
+            {
+                texture.SetColor(i, Renderer::Color(static_cast<uint8_t>(i), static_cast<uint8_t>(255 - i), static_cast<uint8_t>(i * 7), static_cast<uint8_t>(i * 3)));
+            }
+
+            Renderer::Texture original = texture;
+            original.GenerateMips();
+
+            for (Renderer::TextureFormat format : { Renderer::TextureFormat::RGBA16F, Renderer::TextureFormat::RGBA32F })
+            {
+                Renderer::Texture converted = texture;
+                converted.Prepare(Renderer::TextureLayout::Tiled, format);
+                Assert::IsTrue(converted.GetFormat() == format);
+                Assert::AreEqual(converted.GetSize() * Renderer::Texture::GetBytesPerTexel(format), converted.GetByteSize());
+
+                for (size_t level = 0; level < converted.GetMipCount(); level++)
+                {
+                    const Renderer::Texture& expected = original.GetMip(level);
+                    Renderer::TextureView expectedView(expected);
+                    Renderer::TextureView actualView(converted.GetMip(level));
+                    for (size_t y = 0; y < expected.GetHeight(); y++)
+                    {
+                        for (size_t x = 0; x < expected.GetWidth(); x++)
+                        {
+                            Renderer::Color color = expected.GetColor(y * expected.GetWidth() + x);
+                            Assert::AreEqual(color.rgba, converted.GetMip(level).GetColor(y * expected.GetWidth() + x).rgba);
+
+                            // RGBA8 reads give exactly what Color has, half floats are within their precision
+                            Renderer::Vec expectedTexel = expectedView.GetTexel(x, y);
+                            Renderer::Vec actualTexel = actualView.GetTexel(x, y);
+                            Assert::AreEqual(color.GetVec().x, expectedTexel.x);
+                            Assert::AreEqual(color.GetVec().z, expectedTexel.z);
+                            for (int32_t channel = 0; channel < 4; channel++)
+                            {
+                                Assert::AreEqual(expectedTexel.Get(channel), actualTexel.Get(channel), format == Renderer::TextureFormat::RGBA32F ? 0.0f : 1.0f / 2048.0f);
+                            }
+                        }
+                    }
+                }
+
+                converted.Prepare(Renderer::TextureLayout::Linear, Renderer::TextureFormat::RGBA8);
+                Assert::IsTrue(converted == original);
+            }
+        }
+
+        TEST_METHOD(PrepareShouldCompressTexturesWithBoundedError)
+        {
+            Renderer::Texture texture;
+            Assert::IsTrue(Renderer::Load(CarsDir + "race_car_texture.png", texture));
+            Renderer::Texture original = texture;
+            original.Prepare(Renderer::TextureLayout::Linear);
+
+            for (Renderer::TextureFormat format : { Renderer::TextureFormat::BC1, Renderer::TextureFormat::BC3 })
+            {
+                Renderer::Texture compressed = texture;
+                compressed.Prepare(Renderer::TextureLayout::Linear, format);
+
+                size_t originalBytes = 0;
+                size_t compressedBytes = 0;
+                for (size_t level = 0; level < original.GetMipCount(); level++)
+                {
+                    originalBytes += original.GetMip(level).GetByteSize();
+                    compressedBytes += compressed.GetMip(level).GetByteSize();
+                }
+
+                // small mips still take a whole block
+                size_t ratio = format == Renderer::TextureFormat::BC1 ? 8 : 4;
+                Assert::IsTrue(compressedBytes * ratio < originalBytes * 11 / 10);
+
+                double squaredError = 0.0;
+                for (size_t i = 0; i < original.GetSize(); i++)
+                {
+                    for (int32_t channel = 0; channel < 3; channel++)
+                    {
+                        double difference = original.GetColor(i).GetVal(channel) - compressed.GetColor(i).GetVal(channel);
+                        squaredError += difference * difference;
+                    }
+                }
+
+                double psnr = 10.0 * log10(255.0 * 255.0 / (squaredError / (original.GetSize() * 3)));
+                LOG((format == Renderer::TextureFormat::BC1 ? "BC1" : "BC3") << " race car texture: " << compressedBytes << " bytes instead of " << originalBytes << ", PSNR " << psnr << "dB");
+                Assert::IsTrue(psnr > 30.0);
+            }
+        }
+    };
+
+    TEST_CLASS(TextureCache)
+    {
+        TEST_METHOD(LoadShouldDecodeEveryFileOnce)
+        {
+            Renderer::TextureCache& cache = Renderer::TextureCache::GetInstance();
+            cache.Clear();
+            size_t decodeCount = cache.GetDecodeCount();
+
+            std::vector<std::shared_ptr<const Renderer::Texture>> textures = cache.Load({ CarsDir + "race_car_texture.png", CarsDir + "police_car_texture.png", CarsDir + "race_car_texture.png" });
+            Assert::AreEqual(decodeCount + 2, cache.GetDecodeCount());
+            Assert::IsTrue(textures[0] == textures[2]);
+            Assert::IsTrue(textures[0] != textures[1]);
+
+            Renderer::Texture expected;
+            Assert::IsTrue(Renderer::Load(CarsDir + "race_car_texture.png", expected));
+            Assert::IsTrue(*textures[0] == expected);
+
+            // another renderer or scene asking again
+            Assert::IsTrue(cache.Load(CarsDir + "police_car_texture.png") == textures[1]);
+            Assert::AreEqual(decodeCount + 2, cache.GetDecodeCount());
+            Assert::AreEqual(textures[0]->GetByteSize() + textures[1]->GetByteSize(), cache.GetByteSize());
+        }
+
+        TEST_METHOD(LoadShouldDecodeAgainWhenFileChanges)
+        {
+            Renderer::TextureCache& cache = Renderer::TextureCache::GetInstance();
+            cache.Clear();
+
+            std::string path = BuildDir + "texture_cache_test.png";
+            std::filesystem::copy_file(CarsDir + "race_car_texture.png", path, std::filesystem::copy_options::overwrite_existing);
+            std::shared_ptr<const Renderer::Texture> first = cache.Load(path);
+            size_t decodeCount = cache.GetDecodeCount();
+
+            std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds(10));
+            std::shared_ptr<const Renderer::Texture> second = cache.Load(path);
+
+            Assert::AreEqual(decodeCount + 1, cache.GetDecodeCount());
+            Assert::IsTrue(first != second);
+            Assert::AreEqual(first->GetByteSize(), cache.GetByteSize());
+
+            std::filesystem::remove(path);
+        }
+
+        TEST_METHOD(LoadShouldEvictLeastRecentlyUsedTexturesOverCapacity)
+        {
+            Renderer::TextureCache& cache = Renderer::TextureCache::GetInstance();
+            cache.Clear();
+
+            std::string race = CarsDir + "race_car_texture.png";
+            std::string police = CarsDir + "police_car_texture.png";
+            size_t raceBytes = cache.Load(race)->GetByteSize();
+            size_t policeBytes = cache.Load(police)->GetByteSize();
+            cache.Load(race);
+
+            // only one of them fits, the police car texture was used longer ago
+            cache.SetCapacity(std::max(raceBytes, policeBytes));
+            Assert::AreEqual(raceBytes, cache.GetByteSize());
+
+            size_t decodeCount = cache.GetDecodeCount();
+            cache.Load(race);
+            Assert::AreEqual(decodeCount, cache.GetDecodeCount());
+            cache.Load(police);
+            Assert::AreEqual(decodeCount + 1, cache.GetDecodeCount());
+            Assert::AreEqual(policeBytes, cache.GetByteSize());
+
+            cache.SetCapacity(Renderer::TextureCache::DefaultCapacity);
+            cache.Clear();
+        }
+
+        TEST_METHOD(LoadShouldReadMipsFromDerivedDataOfUnchangedFiles)
+        {
+            Renderer::TextureCache& cache = Renderer::TextureCache::GetInstance();
+            cache.SetDerivedDataCache(true);
+
+            std::string path = BuildDir + "derived_data_test.png";
+            std::filesystem::copy_file(CarsDir + "race_car_texture.png", path, std::filesystem::copy_options::overwrite_existing);
+            std::filesystem::remove(path + ".mips");
+
+            size_t decodeCount = cache.GetDecodeCount();
+            std::shared_ptr<const Renderer::Texture> generated = cache.Load(path);
+            Assert::AreEqual(decodeCount + 1, cache.GetDecodeCount());
+            Assert::IsTrue(std::filesystem::exists(path + ".mips"));
+
+            // a later run starts with an empty cache
+            cache.Clear();
+            std::shared_ptr<const Renderer::Texture> read = cache.Load(path);
+            Assert::AreEqual(decodeCount + 1, cache.GetDecodeCount());
+            Assert::AreEqual(generated->GetMipCount(), read->GetMipCount());
+            for (size_t level = 0; level < read->GetMipCount(); level++)
+            {
+                Assert::IsTrue(generated->GetMip(level) == read->GetMip(level));
+            }
+
+            // derived data of another image is ignored
+            Renderer::Texture texture;
+            Assert::IsFalse(Renderer::LoadDerivedData(path + ".mips", 0, texture));
+
+            // damaged sizes are rejected before the levels are allocated, the source hash follows the magic and the version
+            uint64_t sourceHash = 0;
+            std::ifstream(path + ".mips", std::ios::binary).seekg(8).read(reinterpret_cast<char*>(&sourceHash), sizeof(sourceHash));
+            std::string damagedPath = BuildDir + "derived_data_test_damaged.mips";
+            Assert::IsTrue(Renderer::LoadDerivedData(path + ".mips", sourceHash, texture));
+            for (uint32_t width : { 0u, 0x40000000u, static_cast<uint32_t>(read->GetWidth() + 1) })
+            {
+                std::filesystem::copy_file(path + ".mips", damagedPath, std::filesystem::copy_options::overwrite_existing);
+                std::fstream(damagedPath, std::ios::binary | std::ios::in | std::ios::out).seekp(16).write(reinterpret_cast<const char*>(&width), sizeof(width));
+                Assert::IsFalse(Renderer::LoadDerivedData(damagedPath, sourceHash, texture));
+            }
+            std::filesystem::copy_file(path + ".mips", damagedPath, std::filesystem::copy_options::overwrite_existing);
+            std::filesystem::resize_file(damagedPath, std::filesystem::file_size(damagedPath) - 1);
+            Assert::IsFalse(Renderer::LoadDerivedData(damagedPath, sourceHash, texture));
+            std::filesystem::remove(damagedPath);
+
+            // an image that changed is read and hashed again, then derived again
+            std::filesystem::copy_file(CarsDir + "police_car_texture.png", path, std::filesystem::copy_options::overwrite_existing);
+            cache.Clear();
+            std::shared_ptr<const Renderer::Texture> changed = cache.Load(path);
+            Assert::AreEqual(decodeCount + 2, cache.GetDecodeCount());
+            Assert::IsTrue(*changed == *cache.Load(CarsDir + "police_car_texture.png"));
+
+            cache.SetDerivedDataCache(false);
+            std::filesystem::remove(path);
+            std::filesystem::remove(path + ".mips");
+        }
+    };
+
+    TEST_CLASS(FastMath)
+    {
+        static int64_t GetUlpDistance(float actual, double expected)
+        {
+            auto toOrdered = [](float value) {
+                int32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                return bits < 0 ? static_cast<int64_t>(INT32_MIN) - bits : static_cast<int64_t>(bits);
+            };
+
+            return std::abs(toOrdered(actual) - toOrdered(static_cast<float>(expected)));
+        }
+
+        // Walks the range in small multiplicative steps and returns the largest error.
+        template<typename Function, typename Reference>
+        static int64_t GetMaxUlpError(float begin, float end, float step, Function function, Reference reference)
+        {
+            int64_t maxError = 0;
+            for (float x = begin; x < end; x = x > 0.0f ? x * step : (x < -1e-3f ? x / step : -x))
+            {
+                maxError = std::max(maxError, GetUlpDistance(function(x), reference(x)));
+            }
+            return maxError;
+        }
+
+        template<Renderer::MathAccuracy Accuracy>
+        static int64_t GetMaxPowUlpError()
+        {
+            int64_t maxError = 0;
+            for (float y = 1.0f; y <= 64.0f; y += 0.5f)
+            {
+                for (float x = 1.0f; x > 0.0f && std::pow(static_cast<double>(x), y) > 1e-30; x *= 0.999f)
+                {
+                    maxError = std::max(maxError, GetUlpDistance(Renderer::Pow<Accuracy>(x, y), std::pow(static_cast<double>(x), y)));
+                }
+            }
+            return maxError;
+        }
+
+        TEST_METHOD(RsqrtShouldStayWithinUlpBound)
+        {
+            auto reference = [](float x) { return 1.0 / std::sqrt(static_cast<double>(x)); };
+
+            int64_t exact = GetMaxUlpError(1e-6f, 1e6f, 1.0001f, [](float x) { return Renderer::Rsqrt<Renderer::MathAccuracy::Exact>(x); }, reference);
+            int64_t fast = GetMaxUlpError(1e-6f, 1e6f, 1.0001f, [](float x) { return Renderer::Rsqrt<Renderer::MathAccuracy::Fast>(x); }, reference);
+            int64_t fastest = GetMaxUlpError(1e-6f, 1e6f, 1.0001f, [](float x) { return Renderer::Rsqrt<Renderer::MathAccuracy::Fastest>(x); }, reference);
+            LOG("Rsqrt max ULP error, exact: " << exact << ", fast: " << fast << ", fastest: " << fastest);
+
+            Assert::IsTrue(exact <= 1);
+            Assert::IsTrue(fast <= 4);
+            // hardware estimate has relative error up to 1.5 * 2^-12
+            Assert::IsTrue(fastest <= 6144);
+        }
+
+        TEST_METHOD(Exp2ShouldStayWithinUlpBound)
+        {
+            auto reference = [](float x) { return std::exp2(static_cast<double>(x)); };
+
+            int64_t fast = GetMaxUlpError(-100.0f, 100.0f, 1.0001f, [](float x) { return Renderer::Exp2<Renderer::MathAccuracy::Fast>(x); }, reference);
+            int64_t fastest = GetMaxUlpError(-100.0f, 100.0f, 1.0001f, [](float x) { return Renderer::Exp2<Renderer::MathAccuracy::Fastest>(x); }, reference);
+            LOG("Exp2 max ULP error, fast: " << fast << ", fastest: " << fastest);
+
+            Assert::IsTrue(fast <= 2);
+            Assert::IsTrue(fastest <= 2048);
+        }
+
+        TEST_METHOD(Log2ShouldStayWithinUlpBound)
+        {
+            auto reference = [](float x) { return std::log2(static_cast<double>(x)); };
+
+            int64_t fast = GetMaxUlpError(1e-30f, 1e30f, 1.0001f, [](float x) { return Renderer::Log2<Renderer::MathAccuracy::Fast>(x); }, reference);
+            int64_t fastest = GetMaxUlpError(1e-30f, 1e30f, 1.0001f, [](float x) { return Renderer::Log2<Renderer::MathAccuracy::Fastest>(x); }, reference);
+            LOG("Log2 max ULP error, fast: " << fast << ", fastest: " << fastest);
+
+            Assert::IsTrue(fast <= 4);
+            Assert::IsTrue(fastest <= 8192);
+        }
+
+        TEST_METHOD(PowShouldStayWithinUlpBound)
+        {
+            int64_t exact = GetMaxPowUlpError<Renderer::MathAccuracy::Exact>();
+            int64_t fast = GetMaxPowUlpError<Renderer::MathAccuracy::Fast>();
+            int64_t fastest = GetMaxPowUlpError<Renderer::MathAccuracy::Fastest>();
+            LOG("Pow max ULP error, exact: " << exact << ", fast: " << fast << ", fastest: " << fastest);
+
+            // y * log2(x) is rounded to float before exp2, so the error grows with the magnitude of the product
+            Assert::IsTrue(exact <= 1);
+            Assert::IsTrue(fast <= 256);
+            Assert::IsTrue(fastest <= 262144);
+        }
+    };
+
     void RenderAndCompareToReference(Renderer::SceneRenderer& renderer, const Renderer::Scene& scene, const std::string& coreName)
     {
         constexpr uint32_t width = 200;
@@ -250,6 +1189,22 @@ namespace Tests
         }
     }
 
+    int32_t GetMaxChannelDifference(const Renderer::Texture& lhs, const Renderer::Texture& rhs)
+    {
+        Assert::IsTrue(lhs.GetSize() == rhs.GetSize());
+
+        int32_t maxDifference = 0;
+        for (size_t i = 0; i < lhs.GetSize(); i++)
+        {
+            for (size_t channel = 0; channel < 3; channel++)
+            {
+                maxDifference = std::max(maxDifference, std::abs(lhs.GetColor(i).GetVal(channel) - rhs.GetColor(i).GetVal(channel)));
+            }
+        }
+
+        return maxDifference;
+    }
+
     TEST_CLASS(RendererDX12)
     {
         TEST_METHOD(RenderShouldProperlyRenderSimpleScene)
@@ -359,6 +1314,481 @@ namespace Tests
             Assert::IsFalse(renderer.Render(scene, textureZeroWidth));
         }
 
+        TEST_METHOD(RenderShouldNotReuseBuffersFromPreviousFrame)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            Renderer::Texture previousFrame(200, 150);
+            Assert::IsTrue(renderer.Render(scene, previousFrame));
+
+            // turn the camera away, so most of the tiles covered in previous frame stay empty
+            scene.camera.yaw += 0.5f;
+
+            Renderer::Texture frame(200, 150);
+            Assert::IsTrue(renderer.Render(scene, frame));
+
+            Renderer::SceneRendererSoftware freshRenderer;
+            Renderer::Texture expected(200, 150);
+            Assert::IsTrue(freshRenderer.Render(scene, expected));
+
+            Assert::IsTrue(expected == frame);
+        }
+
+        TEST_METHOD(RenderShouldFlushTrianglesEarlyWhenOutOfFrameMemory)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            renderer.SetFrameMemoryBudget(256 * 1024);
+
+            RenderAndCompareToReference(renderer, scene, "software");
+        }
+
+        TEST_METHOD(RenderShouldKeepFrameMemoryConstantWhenStreaming)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            renderer.SetStreamingChunkSize(256);
+
+            RenderAndCompareToReference(renderer, scene, "software");
+
+            // a chunk of triangles is well below a megabyte, while the whole model takes several
+            Assert::IsTrue(Utils::MemoryCounter::GetInstance().samples["Frame arena high-water mark"] < 1024 * 1024);
+        }
+
+        TEST_METHOD(RenderShouldFailWhenFrameMemoryCanNotFitTriangle)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(TriangleDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            renderer.SetFrameMemoryBudget(16);
+
+            Renderer::Texture texture(200, 150);
+            Assert::IsFalse(renderer.Render(scene, texture));
+        }
+
+        TEST_METHOD(RenderShouldDrawSingleColoredMeshWithoutVertexColors)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(TriangleDir + "scene.sce", scene));
+
+            for (Renderer::Vertex& vertex : scene.models[0].vertices)
+            {
+                vertex.color = Renderer::Color::Pink;
+            }
+
+            Renderer::SceneRendererSoftware renderer;
+            Renderer::Texture frame(200, 150);
+            Assert::IsTrue(renderer.Render(scene, frame));
+
+            // an unreferenced vertex of a different color makes the renderer interpolate vertex colors
+            Renderer::Scene coloredScene = scene;
+            coloredScene.name += "_colored";
+            coloredScene.models[0].vertices.push_back(scene.models[0].vertices[0]);
+            coloredScene.models[0].vertices.back().color = Renderer::Color::Black;
+
+            Renderer::SceneRendererSoftware coloredRenderer;
+            Renderer::Texture expected(200, 150);
+            Assert::IsTrue(coloredRenderer.Render(coloredScene, expected));
+
+            Renderer::Texture diff(200, 150);
+            uint32_t differentPixelsCount = 0;
+            Assert::IsTrue(Renderer::Diff(frame, expected, diff, differentPixelsCount));
+            Assert::IsTrue(differentPixelsCount < 200 * 150 / 100);
+        }
+
+        TEST_METHOD(RenderShouldCompressColorsWhenToneMapping)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(TriangleDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            Renderer::Texture clamped(200, 150);
+            Assert::IsTrue(renderer.Render(scene, clamped));
+
+            renderer.SetToneMapping(true);
+            Renderer::Texture toneMapped(200, 150);
+            Assert::IsTrue(renderer.Render(scene, toneMapped));
+
+            bool hasDarkerPixels = false;
+            for (size_t i = 0; i < 200 * 150; i++)
+            {
+                Renderer::Vec expected = clamped.GetColor(i).GetVec();
+                Renderer::Vec actual = toneMapped.GetColor(i).GetVec();
+
+                Assert::IsTrue(actual.x <= expected.x && actual.y <= expected.y && actual.z <= expected.z);
+                hasDarkerPixels |= actual.x < expected.x || actual.y < expected.y || actual.z < expected.z;
+            }
+
+            Assert::IsTrue(hasDarkerPixels);
+        }
+
+        TEST_METHOD(RenderShouldStayWithinOneLevelOfScalarShading)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            Renderer::Texture texture(200, 150);
+            Assert::IsTrue(renderer.Render(scene, texture));
+
+            // the reference was rendered by scalar shading
+            Renderer::Texture reference;
+            Assert::IsTrue(Renderer::Load(TestsDir + "reference_software.bmp", reference));
+
+            Assert::IsTrue(GetMaxChannelDifference(texture, reference) <= 1);
+        }
+
+        TEST_METHOD(RenderShouldMatchReferenceWithFastMath)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            renderer.SetMathAccuracy(Renderer::MathAccuracy::Fast);
+            RenderAndCompareToReference(renderer, scene, "software");
+
+            Renderer::Texture reference;
+            Assert::IsTrue(Renderer::Load(TestsDir + "reference_software.bmp", reference));
+
+            // fastest math is only good for 8 bit color, so more pixels are off by a level or two
+            renderer.SetMathAccuracy(Renderer::MathAccuracy::Fastest);
+            Renderer::Texture texture(200, 150);
+            Assert::IsTrue(renderer.Render(scene, texture));
+            LOG("Fastest math max channel difference: " << GetMaxChannelDifference(texture, reference));
+            Assert::IsTrue(GetMaxChannelDifference(texture, reference) <= 2);
+        }
+
+        TEST_METHOD(RenderShouldOnlyLightPixelsWithinPointLightRadius)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            Renderer::Texture unlit(200, 150);
+            Assert::IsTrue(renderer.Render(scene, unlit));
+
+            // far away lights are culled for every tile
+            Renderer::Light pointLight;
+            pointLight.radius = 1.0f;
+            pointLight.position = { 0.0f, 0.0f, -100.0f, 1.0f };
+            scene.lights.assign(100, pointLight);
+            RenderAndCompareToReference(renderer, scene, "software");
+
+            pointLight.position = { 0.0f, 0.2f, 0.0f, 1.0f };
+            pointLight.ambientStrength = 0.5f;
+            scene.lights.push_back(pointLight);
+
+            Renderer::Texture lit(200, 150);
+            Assert::IsTrue(renderer.Render(scene, lit));
+
+            size_t brighterPixels = 0;
+            size_t samePixels = 0;
+            for (size_t i = 0; i < 200 * 150; i++)
+            {
+                Renderer::Vec expected = unlit.GetColor(i).GetVec();
+                Renderer::Vec actual = lit.GetColor(i).GetVec();
+
+                Assert::IsTrue(actual.x >= expected.x && actual.y >= expected.y && actual.z >= expected.z);
+                bool brighter = actual.x > expected.x || actual.y > expected.y || actual.z > expected.z;
+                brighterPixels += brighter ? 1 : 0;
+                samePixels += brighter ? 0 : 1;
+            }
+
+            LOG("Point light brightened " << brighterPixels << " pixels, left " << samePixels << " pixels as they were.");
+            Assert::IsTrue(brighterPixels > 0);
+            Assert::IsTrue(samePixels > 0);
+        }
+
+        TEST_METHOD(RenderShouldReduceAliasingOfDistantTexturesWithMips)
+        {
+            // a checkerboard of single texels averages to gray in the small mips
+            Renderer::Texture checkerboard(256, 256);
+            for (size_t i = 0; i < checkerboard.GetSize(); i++)
+            {
+                checkerboard.SetColor(i, (i % 256 + i / 256) % 2 == 0 ? Renderer::Color::White : Renderer::Color::Black);
+            }
+
+            std::string checkerboardPath = BuildDir + "checkerboard.bmp";
+            Assert::IsTrue(Renderer::Save(checkerboardPath, checkerboard));
+
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+            scene.models[0].materials[0].textureName = checkerboardPath;
+            scene.models[0].materials[1].textureName = checkerboardPath;
+            scene.camera.position = { 0.0f, 1.0f, 12.0f, 1.0f };
+
+            // sum of differences between horizontal neighbours, aliasing makes neighbours jump between dark and bright
+            auto getNoise = [&scene](Renderer::TextureFilter filter) {
+                Renderer::SceneRendererSoftware renderer;
+                renderer.SetTextureFilter(filter);
+                Renderer::Texture texture(200, 150);
+                Assert::IsTrue(renderer.Render(scene, texture));
+
+                int64_t noise = 0;
+                for (size_t i = 0; i + 1 < texture.GetSize(); i++)
+                {
+                    noise += std::abs(texture.GetColor(i).GetVal(1) - texture.GetColor(i + 1).GetVal(1));
+                }
+                return noise;
+            };
+
+            int64_t nearest = getNoise(Renderer::TextureFilter::Nearest);
+            int64_t bilinear = getNoise(Renderer::TextureFilter::Bilinear);
+            int64_t trilinear = getNoise(Renderer::TextureFilter::Trilinear);
+            LOG("Neighbour differences, nearest: " << nearest << ", bilinear: " << bilinear << ", trilinear: " << trilinear);
+
+            Assert::IsTrue(bilinear < nearest / 2);
+            Assert::IsTrue(trilinear < nearest / 2);
+        }
+
+        TEST_METHOD(RenderShouldNotDependOnTextureLayout)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            for (Renderer::TextureFilter filter : { Renderer::TextureFilter::Nearest, Renderer::TextureFilter::Trilinear })
+            {
+                Renderer::SceneRendererSoftware renderer;
+                renderer.SetTextureFilter(filter);
+
+                renderer.SetTextureLayout(Renderer::TextureLayout::Linear);
+                Renderer::Texture linear(200, 150);
+                Assert::IsTrue(renderer.Render(scene, linear));
+
+                renderer.SetTextureLayout(Renderer::TextureLayout::Tiled);
+                Renderer::Texture tiled(200, 150);
+                Assert::IsTrue(renderer.Render(scene, tiled));
+
+                Assert::IsTrue(linear == tiled);
+            }
+        }
+
+        TEST_METHOD(RenderShouldNotDependOnTextureFormat)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            for (Renderer::TextureFilter filter : { Renderer::TextureFilter::Nearest, Renderer::TextureFilter::Trilinear })
+            {
+                Renderer::SceneRendererSoftware renderer;
+                renderer.SetTextureFilter(filter);
+
+                Renderer::Texture bytes(200, 150);
+                Assert::IsTrue(renderer.Render(scene, bytes));
+
+                // bytes decoded through the table and stored floats are the same values
+                renderer.SetTextureFormat(Renderer::TextureFormat::RGBA32F);
+                Renderer::Texture floats(200, 150);
+                Assert::IsTrue(renderer.Render(scene, floats));
+                Assert::IsTrue(bytes == floats);
+
+                renderer.SetTextureFormat(Renderer::TextureFormat::RGBA16F);
+                Renderer::Texture halves(200, 150);
+                Assert::IsTrue(renderer.Render(scene, halves));
+                Assert::IsTrue(GetMaxChannelDifference(bytes, halves) <= 1);
+            }
+        }
+
+        TEST_METHOD(RenderShouldNotDependOnTextureAtlas)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            for (Renderer::TextureFilter filter : { Renderer::TextureFilter::Nearest, Renderer::TextureFilter::Bilinear, Renderer::TextureFilter::Trilinear })
+            {
+                Renderer::SceneRendererSoftware renderer;
+                renderer.SetTextureFilter(filter);
+
+                Renderer::Texture separate(200, 150);
+                Assert::IsTrue(renderer.Render(scene, separate));
+
+                // both 512x512 textures go to one atlas
+                renderer.SetTextureAtlasSize(2048);
+                Renderer::Texture packed(200, 150);
+                Assert::IsTrue(renderer.Render(scene, packed));
+                Assert::IsTrue(separate == packed);
+            }
+        }
+
+        TEST_METHOD(RenderShouldNotDependOnVirtualTexturingWhenPagesFit)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            for (Renderer::TextureFilter filter : { Renderer::TextureFilter::Nearest, Renderer::TextureFilter::Bilinear, Renderer::TextureFilter::Trilinear })
+            {
+                Renderer::SceneRendererSoftware renderer;
+                renderer.SetTextureFilter(filter);
+
+                Renderer::Texture resident(200, 150);
+                Assert::IsTrue(renderer.Render(scene, resident));
+
+                renderer.SetVirtualTexturing(true);
+                Renderer::Texture paged(200, 150);
+                Assert::IsTrue(renderer.Render(scene, paged));
+
+                // two 512x512 textures have 2 * (16 + 4) pages above the mip tail, the frame samples some of them
+                Assert::IsTrue(GetMaxChannelDifference(resident, paged) <= 1);
+                Assert::AreEqual(size_t(0), renderer.GetTexturePageFaultCount());
+                Assert::IsTrue(renderer.GetResidentTexturePageCount() > 0 && renderer.GetResidentTexturePageCount() < 40);
+            }
+        }
+
+        TEST_METHOD(RenderShouldFallBackToCoarserMipsOnPageFaults)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            renderer.SetTextureFilter(Renderer::TextureFilter::Trilinear);
+            Renderer::Texture resident(200, 150);
+            Assert::IsTrue(renderer.Render(scene, resident));
+
+            renderer.SetVirtualTexturing(true, 2);
+            Renderer::Texture faulted(200, 150);
+            Assert::IsTrue(renderer.Render(scene, faulted));
+            Assert::AreEqual(size_t(2), renderer.GetResidentTexturePageCount());
+            Assert::IsTrue(renderer.GetTexturePageFaultCount() > 0);
+
+            // blurrier, but still the same image
+            int64_t totalDifference = 0;
+            for (size_t i = 0; i < faulted.GetSize(); i++)
+            {
+                for (int32_t channel = 0; channel < 3; channel++)
+                {
+                    totalDifference += std::abs(resident.GetColor(i).GetVal(channel) - faulted.GetColor(i).GetVal(channel));
+                }
+            }
+            double averageDifference = static_cast<double>(totalDifference) / (faulted.GetSize() * 3);
+            LOG("Average difference with 2 resident pages: " << averageDifference);
+            Assert::IsTrue(averageDifference < 4.0);
+
+            // with room for the pages the next frame is complete again
+            renderer.SetVirtualTexturing(true);
+            Assert::IsTrue(renderer.Render(scene, faulted));
+            Assert::AreEqual(size_t(0), renderer.GetTexturePageFaultCount());
+            Assert::IsTrue(GetMaxChannelDifference(resident, faulted) <= 1);
+        }
+
+        TEST_METHOD(RenderShouldStayCloseToUncompressedTexturesWithBlockCompression)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            Renderer::Texture uncompressed(200, 150);
+            Assert::IsTrue(renderer.Render(scene, uncompressed));
+
+            for (Renderer::TextureFormat format : { Renderer::TextureFormat::BC1, Renderer::TextureFormat::BC3 })
+            {
+                renderer.SetTextureFormat(format);
+                Renderer::Texture compressed(200, 150);
+                Assert::IsTrue(renderer.Render(scene, compressed));
+
+                int64_t totalDifference = 0;
+                for (size_t i = 0; i < compressed.GetSize(); i++)
+                {
+                    for (int32_t channel = 0; channel < 3; channel++)
+                    {
+                        totalDifference += std::abs(uncompressed.GetColor(i).GetVal(channel) - compressed.GetColor(i).GetVal(channel));
+                    }
+                }
+
+                double averageDifference = static_cast<double>(totalDifference) / (compressed.GetSize() * 3);
+                LOG((format == Renderer::TextureFormat::BC1 ? "BC1" : "BC3") << " average channel difference: " << averageDifference << ", max: " << GetMaxChannelDifference(uncompressed, compressed));
+                Assert::IsTrue(averageDifference < 1.0);
+            }
+        }
+
+        TEST_METHOD(RenderShouldNotKeepCompressionLossAfterSwitchingFormatBack)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware freshRenderer;
+            Renderer::Texture expected(200, 150);
+            Assert::IsTrue(freshRenderer.Render(scene, expected));
+
+            Renderer::SceneRendererSoftware renderer;
+            Renderer::Texture texture(200, 150);
+            for (Renderer::TextureFormat format : { Renderer::TextureFormat::RGBA8, Renderer::TextureFormat::BC1, Renderer::TextureFormat::RGBA8 })
+            {
+                renderer.SetTextureFormat(format);
+                Assert::IsTrue(renderer.Render(scene, texture));
+            }
+
+            Assert::IsTrue(expected == texture);
+        }
+
+        TEST_METHOD(RenderShouldOnlyDarkenPixelsWithShadows)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            Renderer::Texture unshadowed(200, 150);
+            Assert::IsTrue(renderer.Render(scene, unshadowed));
+
+            renderer.SetShadowMapResolution(1024);
+            Renderer::Texture shadowed(200, 150);
+            Assert::IsTrue(renderer.Render(scene, shadowed));
+
+            size_t darkerPixels = 0;
+            for (size_t i = 0; i < 200 * 150; i++)
+            {
+                Renderer::Vec expected = unshadowed.GetColor(i).GetVec();
+                Renderer::Vec actual = shadowed.GetColor(i).GetVec();
+
+                Assert::IsTrue(actual.x <= expected.x && actual.y <= expected.y && actual.z <= expected.z);
+                darkerPixels += actual.x < expected.x || actual.y < expected.y || actual.z < expected.z ? 1 : 0;
+            }
+
+            LOG("Shadows darkened " << darkerPixels << " pixels.");
+            Assert::IsTrue(darkerPixels > 0);
+            // lit surfaces must not shadow themselves
+            Assert::IsTrue(darkerPixels < 200 * 150 / 10);
+        }
+
+        TEST_METHOD(RenderShouldRenderShadowMapOnlyWhenLightOrGeometryChanges)
+        {
+            Renderer::Scene scene;
+            Assert::IsTrue(Renderer::Load(CarsDir + "scene.sce", scene));
+
+            Renderer::SceneRendererSoftware renderer;
+            renderer.SetShadowMapResolution(512);
+
+            Renderer::Texture texture(200, 150);
+            Assert::IsTrue(renderer.Render(scene, texture));
+            Assert::AreEqual(size_t(1), renderer.GetShadowMapRenderCount());
+
+            scene.camera.yaw += 0.1f;
+            Assert::IsTrue(renderer.Render(scene, texture));
+            Assert::AreEqual(size_t(1), renderer.GetShadowMapRenderCount());
+
+            // the cached map must give the same image as a fresh one
+            Renderer::SceneRendererSoftware freshRenderer;
+            freshRenderer.SetShadowMapResolution(512);
+            Renderer::Texture expected(200, 150);
+            Assert::IsTrue(freshRenderer.Render(scene, expected));
+            Assert::IsTrue(expected == texture);
+
+            scene.light.position.x -= 10.0f;
+            Assert::IsTrue(renderer.Render(scene, texture));
+            Assert::AreEqual(size_t(2), renderer.GetShadowMapRenderCount());
+
+            scene.models[0].vertices[0].position.y += 0.1f;
+            scene.models[0].version++;
+            Assert::IsTrue(renderer.Render(scene, texture));
+            Assert::AreEqual(size_t(3), renderer.GetShadowMapRenderCount());
+        }
+
         TEST_METHOD(RenderShouldPaintMissingTexturesRed)
         {
             Renderer::Scene scene;